@@ -31,6 +31,22 @@ buffer::buffer(int64_t size) {
     exit(4312);
   }
 
+  set_data(data);
+  this->size = size;
+}
+
+buffer::buffer(void* data, int64_t size, const std::shared_ptr<void>& owner) {
+  m_owner = owner;
+  set_data(data);
+  this->size = size;
+}
+
+buffer::~buffer() {
+  if (m_owner == nullptr) free(data);
+}
+
+void buffer::set_data(void* data) {
+  this->data = data;
   data_u8 = reinterpret_cast<uint8_t*>(data);
   data_u16 = reinterpret_cast<uint16_t*>(data);
   data_u32 = reinterpret_cast<uint32_t*>(data);
@@ -42,12 +58,6 @@ buffer::buffer(int64_t size) {
   data_f32 = reinterpret_cast<float*>(data);
   data_f64 = reinterpret_cast<double*>(data);
   data_char = reinterpret_cast<char*>(data);
-
-  this->size = size;
-}
-
-buffer::~buffer() {
-  free(data);
 }
 
 void buffer::write(void* source, int64_t size) {
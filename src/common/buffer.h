@@ -3,6 +3,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <memory>
 #include "utils/gen_utils.h"
 
 
@@ -25,8 +26,13 @@ namespace potree {
     int64_t size = 0;
     int64_t pos = 0;
 
+    // set for views, which don't own their data. the owner, e.g. a file mapping, lives as long as the view
+    std::shared_ptr<void> m_owner;
+
     buffer() { }
     buffer(int64_t size);
+    // view of size bytes at data, nothing is copied and data isn't freed
+    buffer(void* data, int64_t size, const std::shared_ptr<void>& owner);
     ~buffer();
 
     template<class T>
@@ -49,5 +55,8 @@ namespace potree {
 
     void write(void* source, int64_t size);
 
+  private:
+    void set_data(void* data);
+
   };
 }
\ No newline at end of file
@@ -0,0 +1,144 @@
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cmath>
+#include <algorithm>
+#include "executor.h"
+#include "utils/gen_utils.h"
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+#if !defined(_WIN32)
+#include <tbb/global_control.h>
+#endif
+
+using namespace potree;
+
+// share of the threads that is reserved for io
+static const size_t IO_THREADS_DIVISOR = 4;
+
+// std::execution policies run on tbb with libstdc++, its pool is limited for as long as the control exists.
+// msvc's parallel algorithms use the windows thread pool, which can't be limited from here.
+struct executor::parallelism_limit {
+#if !defined(_WIN32)
+  tbb::global_control m_control;
+
+  parallelism_limit(size_t threads) : m_control(tbb::global_control::max_allowed_parallelism, threads) { }
+#else
+  parallelism_limit(size_t threads) { }
+#endif
+};
+
+#if defined(__linux__)
+// cpu quota of the cgroup of this process in cpus, -1 if there is none
+static double get_cgroup_cpu_quota() {
+  // cgroup v2, the path of the process' cgroup is the entry with hierarchy id 0
+  std::string cgroup_path;
+  {
+    std::ifstream fin("/proc/self/cgroup");
+    std::string line;
+
+    while (std::getline(fin, line)) {
+      if (line.rfind("0::", 0) == 0) cgroup_path = line.substr(3);
+    }
+  }
+
+  // containers usually see their own cgroup mounted at the root
+  for (const std::string& path : { "/sys/fs/cgroup" + cgroup_path + "/cpu.max", std::string("/sys/fs/cgroup/cpu.max") }) {
+    std::ifstream fin(path);
+    if (!fin.good()) continue;
+
+    // "<quota> <period>", quota is "max" without a limit
+    std::string quota;
+    double period = 0;
+    fin >> quota >> period;
+
+    if (quota == "max" || period <= 0) return -1;
+
+    return std::stod(quota) / period;
+  }
+
+  // cgroup v1
+  for (const std::string& dir : { std::string("/sys/fs/cgroup/cpu"), std::string("/sys/fs/cgroup/cpu,cpuacct") }) {
+    std::ifstream fin_quota(dir + "/cpu.cfs_quota_us");
+    std::ifstream fin_period(dir + "/cpu.cfs_period_us");
+    if (!fin_quota.good() || !fin_period.good()) continue;
+
+    double quota = -1;
+    double period = 0;
+    fin_quota >> quota;
+    fin_period >> period;
+
+    if (quota <= 0 || period <= 0) return -1;
+
+    return quota / period;
+  }
+
+  return -1;
+}
+#endif
+
+executor& executor::instance() {
+  static executor instance;
+  return instance;
+}
+
+executor::executor() {
+  configure(0);
+}
+
+size_t executor::get_available_cpus() {
+  size_t cpus = std::max(1u, std::thread::hardware_concurrency());
+
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    cpus = std::max(1, CPU_COUNT(&set));
+  }
+
+  try {
+    double quota = get_cgroup_cpu_quota();
+    if (quota > 0) cpus = std::min(cpus, size_t(std::ceil(quota)));
+  }
+  catch (const std::exception& e) {
+    MWARNING << "executor: failed to read the cgroup cpu quota: " << e.what() << std::endl;
+  }
+#endif
+
+  return cpus;
+}
+
+void executor::configure(int64_t threads) {
+  size_t num_threads = threads > 0 ? size_t(threads) : get_available_cpus();
+
+  std::lock_guard<std::mutex> lock(m_mtx);
+  m_num_threads = num_threads;
+  m_io_threads = std::max(size_t(1), num_threads / IO_THREADS_DIVISOR);
+  m_compute_threads = num_threads > m_io_threads ? num_threads - m_io_threads : 1;
+
+  // the previous limit has to be released before a new one can take effect
+  m_limit = nullptr;
+  m_limit = std::make_shared<parallelism_limit>(m_compute_threads);
+
+  MINFO << "executor: " << m_num_threads << " threads, " << m_compute_threads << " compute, " << m_io_threads << " io" << std::endl;
+}
+
+size_t executor::get_num_threads() const {
+  std::lock_guard<std::mutex> lock(m_mtx);
+  return m_num_threads;
+}
+
+size_t executor::get_compute_threads() const {
+  std::lock_guard<std::mutex> lock(m_mtx);
+  return m_compute_threads;
+}
+
+size_t executor::get_io_threads() const {
+  std::lock_guard<std::mutex> lock(m_mtx);
+  return m_io_threads;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <mutex>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+namespace potree {
+
+  // process-wide thread configuration. task pools, writer threads and the parallel algorithms of the
+  // standard library are all sized from it, so that a conversion doesn't use more threads than it has cpus.
+  // the threads are split into compute threads for the cpu bound pools and io threads for the writers,
+  // pools that alternate between reading and computing use both.
+  class executor {
+  public:
+    static executor& instance();
+
+    // threads: total number of threads, 0 uses all available cpus
+    void configure(int64_t threads = 0);
+
+    size_t get_num_threads() const;
+    size_t get_compute_threads() const;
+    size_t get_io_threads() const;
+
+    // cpus this process may use: the affinity mask, limited by the cgroup cpu quota
+    // (cpu.max, or cpu.cfs_quota_us in cgroup v1). fractional quotas are rounded up.
+    static size_t get_available_cpus();
+
+  private:
+    struct parallelism_limit;
+
+    mutable std::mutex m_mtx;
+    size_t m_num_threads = 1;
+    size_t m_compute_threads = 1;
+    size_t m_io_threads = 1;
+    std::shared_ptr<parallelism_limit> m_limit;
+
+    executor();
+  };
+
+}
@@ -10,14 +10,29 @@ namespace potree {
     std::string m_encoding = "DEFAULT"; // "BROTLI", "UNCOMPRESSED"
     std::string m_outdir = "";
     std::string m_name = "";
-    std::string m_method = "";
+    std::string m_method = ""; // "random", "poisson", "poisson_average", "voxel"
     std::string m_chunk_method = "";
+    std::string m_count_method = "DENSE"; // "SPARSE"
+    std::string m_chunk_store = "FILES"; // "PACKED": all chunks in one pack file, see chunk_store
+    std::string m_chunk_encoding = "RAW"; // "COMPRESSED": intermediate chunks are encoded with chunk_codec
+    int64_t m_chunk_block_size = 16'384; // points per block of compressed chunks
+    std::string m_indexing_mode = "LOCAL"; // "SHARD", "MERGE": after a LOCAL run with m_no_indexing, with m_no_chunking
+    int m_shard_index = 0; // SHARD: the shard indexed by this process
+    int m_shard_count = 1; // SHARD, MERGE
     std::vector<std::string> m_attributes;
     bool m_generate_page = false;
     std::string m_page_name = "";
     std::string m_page_title = "";
     std::string m_projection = "";
+    std::string m_catalog_path = ""; // persistent source catalog, disabled if empty
+    std::string m_copc_path = ""; // also writes the octree to a single copc file, disabled if empty
     bool m_keep_chunks = false;
+    bool m_optimize_layout = false; // rewrites octree.bin in hierarchy order after indexing, see octree_layout
+    int64_t m_prefetch_mb = 2'048; // chunks read ahead of the indexing workers, 0 disables prefetching, as does numa mode, see chunk_prefetcher
+    int64_t m_threads = 0; // 0: all available cpus, honoring the affinity mask and cgroup cpu quotas, see executor
+    bool m_pipelined = false; // indexes chunks while the others are still distributed, LOCAL indexing and LASZIP chunking only
+    bool m_direct_io = false; // large chunk reads bypass the page cache with O_DIRECT, see io_utils
+    bool m_numa = false; // pins workers to numa nodes and keeps their memory local, see numa_utils
     bool m_no_chunking = false;
     bool m_no_indexing = false;
 
@@ -1,5 +1,7 @@
+#include <algorithm>
 #include "task.h"
 #include "utils/gen_utils.h"
+#include "utils/numa_utils.h"
 
 using namespace potree;
 
@@ -15,14 +17,40 @@ task_pool::~task_pool() {
 }
 
 void task_pool::init() {
+  // in numa mode, workers are pinned round-robin to the nodes, so that the buffers they allocate stay local
+  bool numa = numa_utils::is_enabled();
+  int num_nodes = numa_utils::get_num_nodes();
+
   for(int i = 0; i < m_num_threads; i++) {
-    m_threads.emplace_back([this]() {
-      process();
+    int numa_node = numa ? i % num_nodes : -1;
+
+    m_threads.emplace_back([this, numa_node]() {
+      if (numa_node >= 0) numa_utils::bind_thread(numa_node);
+      process(numa_node);
     });
   }
 }
 
-void task_pool::process() {
+// takes the first task of the worker's numa node. tasks of other nodes are taken once there are none left
+// for the worker's node, remote memory accesses are still cheaper than an idle worker
+std::shared_ptr<task> task_pool::pop(int numa_node) {
+  auto it = m_tasks.begin();
+
+  if (numa_node >= 0) {
+    it = std::find_if(m_tasks.begin(), m_tasks.end(), [numa_node](const std::shared_ptr<task>& t) {
+      return t == nullptr || t->m_numa_node < 0 || t->m_numa_node == numa_node;
+    });
+
+    if (it == m_tasks.end()) it = m_tasks.begin();
+  }
+
+  auto t = *it;
+  m_tasks.erase(it);
+
+  return t;
+}
+
+void task_pool::process(int numa_node) {
   while(true) {
     std::shared_ptr<task> task;
     {
@@ -34,8 +62,7 @@ void task_pool::process() {
 
       if (all_done) break;
       else if (task_available) {
-        task = m_tasks.front();
-        m_tasks.pop_front();
+        task = pop(numa_node);
 
         if (task == nullptr) {
           MWARNING << "task_pool::process(): task is nullptr" << std::endl;
@@ -82,11 +109,10 @@ void task_pool::wait() {
 }
 
 void task_pool::close() {
-  if (m_is_closed) return;
+  // threads only exit once the pool is closed and the queue is drained
+  if (m_is_closed.exchange(true)) return;
   
   for(auto& t : m_threads) {
     t.join();
   }
-
-  m_is_closed = true;
 }
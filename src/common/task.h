@@ -12,7 +12,8 @@
 namespace potree {
 
   struct task {
-
+    // numa node whose workers should process the task, any worker if -1. see numa_utils
+    int m_numa_node = -1;
   };
 
   typedef std::function<void(std::shared_ptr<task>)> task_processor;
@@ -37,6 +38,7 @@ namespace potree {
     std::atomic<int> m_busy_threads = 0;
 
     void init();
-    void process();
+    void process(int numa_node);
+    std::shared_ptr<task> pop(int numa_node);
   };
 }
@@ -1,9 +1,15 @@
 #include "converter.h"
+#include "common/executor.h"
 #include "geometry/hierarchy.h"
+#include "las/las_catalog.h"
 #include "sampler/sampler_poisson.h"
+#include "sampler/sampler_poisson_average.h"
 #include "sampler/sampler_random.h"
+#include "sampler/sampler_voxel.h"
 #include "utils/las_utils.h"
 #include "utils/chunk_utils.h"
+#include "utils/numa_utils.h"
+#include "utils/io_utils.h"
 #include <filesystem>
 
 using namespace potree;
@@ -74,13 +80,22 @@ conversion_stats conversion_stats::compute(const std::vector<file_source>& sourc
 	return { min, max, total_bytes, total_points };
 }
 
+converter::converter(const options& opts) {
+  m_options = opts;
+}
+
 void converter::do_chunking(const file_source_container& container, const conversion_stats& stats, attributes& attrs, const std::shared_ptr<gen_utils::monitor>& monitor) {
   if (m_options.skip_chunking()) return;
 
+  // chunking wipes and rewrites the chunks that shard and merge processes share, they run on the chunks of an earlier LOCAL run
+  if (m_options.m_indexing_mode != "LOCAL") {
+    throw std::runtime_error(m_options.m_indexing_mode + " indexing requires existing chunks, run it without chunking after a LOCAL chunking-only run");
+  }
+
   gen_utils::profiler pr("converter::do_chunking()");
 
   if (m_options.m_chunk_method == "LASZIP") {
-    chunk_utils::chunker::do_chunking(container.m_files, m_options.m_outdir, stats.m_min, stats.m_max, m_state, attrs, monitor);
+    chunk_utils::chunker::do_chunking(container.m_files, m_options.m_outdir, m_options, stats.m_min, stats.m_max, m_state, attrs, monitor);
   }
   else if (m_options.m_chunk_method == "LAS_CUSTOM") {
     // TODO implement
@@ -88,38 +103,109 @@ void converter::do_chunking(const file_source_container& container, const conver
   else throw std::runtime_error("Invalid chunk method provided: " + m_options.m_chunk_method);
 }
 
+std::shared_ptr<sampler> converter::create_sampler() const {
+	if (m_options.m_method == "random") {
+		return std::make_shared<sampler_random>();
+	}
+	else if (m_options.m_method == "poisson") {
+		return std::make_shared<sampler_poisson>();
+	}
+	else if (m_options.m_method == "voxel") {
+		return std::make_shared<sampler_voxel>();
+	}
+	else if (m_options.m_method == "poisson_average") {
+		return std::make_shared<sampler_poisson_average>();
+	}
+
+	MWARNING << "Unkown indexing method provided: " << m_options.m_method << std::endl;
+	return nullptr;
+}
+
+bool converter::can_pipeline() const {
+	if (!m_options.m_pipelined) return false;
+
+	if (m_options.skip_chunking() || m_options.m_no_indexing || m_options.m_chunk_method != "LASZIP" || m_options.m_indexing_mode != "LOCAL") {
+		MWARNING << "pipelined indexing requires LASZIP chunking and LOCAL indexing, chunking and indexing run one after the other" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
 void converter::do_indexing(const file_source_container& container) {
 	if (m_options.m_no_indexing) return;
 	
 	auto stats = conversion_stats::compute(container.m_files);
 	hierarchy_indexer idxer(m_options.m_outdir, m_options);
-	std::shared_ptr<sampler> smplr;
+	std::shared_ptr<sampler> smplr = create_sampler();
+	if (smplr == nullptr) return;
 
-	if (m_options.m_method == "random") {
-		smplr = std::make_shared<sampler_random>();
+	// SHARD and MERGE split indexing among processes sharing the target directory:
+	// a LOCAL run without indexing writes the chunks, every shard process indexes its part of them,
+	// then a single MERGE process combines the shards. shard and merge runs skip chunking
+	if (m_options.m_indexing_mode == "LOCAL") {
 		idxer.do_indexing(m_state, smplr);
 	}
-	else if (m_options.m_method == "poisson") {
-		smplr = std::make_shared<sampler_poisson>();
-		idxer.do_indexing(m_state, smplr);
+	else if (m_options.m_indexing_mode == "SHARD") {
+		idxer.index_shard(m_state, smplr, m_options.m_shard_index, m_options.m_shard_count);
 	}
-	else if (m_options.m_method == "poisson_average") {
-		// TODO implement sampler_poisson_average
-		throw std::runtime_error("sampler_poisson_average not implemented");
+	else if (m_options.m_indexing_mode == "MERGE") {
+		idxer.merge_shards(m_state, smplr, m_options.m_shard_count);
 	}
-	else {
-		MWARNING << "Unkown indexing method provided: " << m_options.m_method << std::endl;
+	else throw std::runtime_error("Invalid indexing mode provided: " + m_options.m_indexing_mode);
+
+	// shards only hold part of the octree, the copc file is written once they are merged
+	if (m_options.m_indexing_mode != "SHARD") write_copc();
+}
+
+// chunking and indexing overlap: the distributor hands every complete chunk to the indexer,
+// the chunks that are left, e.g. refined ones, are indexed once chunking is done
+void converter::do_pipelined(const file_source_container& container, const conversion_stats& stats, attributes& attrs, const std::shared_ptr<gen_utils::monitor>& monitor) {
+	gen_utils::profiler pr("converter::do_pipelined()");
+
+	std::shared_ptr<sampler> smplr = create_sampler();
+	if (smplr == nullptr) {
+		do_chunking(container, stats, attrs, monitor);
+		return;
 	}
+
+	// the cube of the chunker, chunk bounding boxes are derived from it
+	double cube_size = (stats.m_max - stats.m_min).max();
+	hierarchy_indexer idxer(m_options.m_outdir, m_options, stats.m_min, stats.m_min + cube_size, attrs);
+	idxer.start_pipeline(smplr);
+
+	chunk_utils::chunker::do_chunking(container.m_files, m_options.m_outdir, m_options, stats.m_min, stats.m_max, m_state, attrs, monitor, [&idxer](const std::shared_ptr<chunk>& c) {
+		idxer.add_chunk(c);
+	});
+
+	idxer.finish_pipeline(m_state, smplr);
+	write_copc();
+}
+
+void converter::write_copc() {
+	if (m_options.m_copc_path.empty()) return;
+
+	copc_options copc_opts;
+	copc_opts.m_target_path = m_options.m_copc_path;
+	las_utils::to_copc(m_options.m_outdir, copc_opts);
 }
 
 void converter::convert() {
   gen_utils::profiler pr("converter::convert()");
-  auto cpu_info = gen_utils::get_cpu_data();
+  executor::instance().configure(m_options.m_threads);
+
+  MINFO << "threads: " << executor::instance().get_num_threads() << std::endl;
+
+  numa_utils::set_enabled(m_options.m_numa);
+  io_utils::set_direct_io(m_options.m_direct_io);
 
-  MINFO << "threads: " << cpu_info.numProcessors << std::endl;
+  auto& catalog = las_catalog::instance();
+  if (!m_options.m_catalog_path.empty()) catalog.load(m_options.m_catalog_path);
 
   auto curated_srcs = las_utils::curate_sources(m_options.m_source);
 
+  if (!m_options.m_catalog_path.empty()) catalog.save(m_options.m_catalog_path);
+
   if (m_options.m_name.empty()) m_options.m_name = curated_srcs.m_name;
 
   auto output_attributes = las_utils::compute_output_attributes(curated_srcs.m_files, m_options.m_attributes);
@@ -134,6 +220,7 @@ void converter::convert() {
   std::filesystem::create_directories(target_dir);
 
   m_state = std::make_shared<potree::status>();
+  m_state->pointsTotal = stats.m_total_points;
   m_state->pointsProcessed = stats.m_total_points;
   m_state->bytesProcessed = stats.m_total_bytes;
 
@@ -141,7 +228,23 @@ void converter::convert() {
   monitor->start();
 
   // this is the real important stuff
-  do_chunking(curated_srcs, stats, output_attributes, monitor);
-  do_indexing(curated_srcs);
+  if (can_pipeline()) {
+    do_pipelined(curated_srcs, stats, output_attributes, monitor);
+  }
+  else {
+    do_chunking(curated_srcs, stats, output_attributes, monitor);
+    do_indexing(curated_srcs);
+  }
+
+  auto io = io_utils::get_stats();
+  m_state->values["io(bytes read)"] = gen_utils::format_number(io.m_bytes_read);
+  m_state->values["io(syscalls)"] = gen_utils::format_number(io.m_syscalls);
+  m_state->values["io(opens)"] = gen_utils::format_number(io.m_opens);
+  m_state->values["io(cache hits)"] = gen_utils::format_number(io.m_cache_hits);
+  m_state->values["io(direct reads)"] = gen_utils::format_number(io.m_direct_reads);
+
+  MINFO << "io: " << gen_utils::format_number(double(io.m_bytes_read) / (1024.0 * 1024.0), 1) << " MB read with "
+    << gen_utils::format_number(io.m_syscalls) << " syscalls, " << io.m_opens << " opens, "
+    << io.m_cache_hits << " cache hits, " << io.m_direct_reads << " direct reads" << std::endl;
 }
 
@@ -3,6 +3,7 @@
 #include "common/file_source.h"
 #include "common/options.h"
 #include "geometry/attributes.h"
+#include "sampler/sampler.h"
 
 
 namespace potree {
@@ -18,11 +19,16 @@ namespace potree {
   
   struct converter {
   public:
+    converter(const options& opts);
     void convert();
   private:
     options m_options;
     std::shared_ptr<potree::status> m_state;
     void do_chunking(const file_source_container& container, const conversion_stats& stats, attributes& attrs, const std::shared_ptr<gen_utils::monitor>& monitor);
     void do_indexing(const file_source_container& container);
+    void do_pipelined(const file_source_container& container, const conversion_stats& stats, attributes& attrs, const std::shared_ptr<gen_utils::monitor>& monitor);
+    void write_copc();
+    std::shared_ptr<sampler> create_sampler() const;
+    bool can_pipeline() const;
   };
 }
\ No newline at end of file
@@ -4,6 +4,9 @@
 #include "utils/gen_utils.h"
 #include "vector3.h"
 #include <vector>
+#include <array>
+#include <algorithm>
+#include <cstdint>
 
 namespace potree {
   struct attribute {
@@ -14,9 +17,14 @@ namespace potree {
     int elementSize = 0;
     attribute_type type = attribute_type::UNDEFINED;
 
-    // TODO: should be type-dependent, not always double. won't work properly with 64 bit integers
+    // min and max are exact for all types but 64 bit integers.
+    // INT64 and UINT64 attributes also keep their exact range in min_int64/max_int64 and min_uint64/max_uint64
     vector3 min = {gen_utils::INF, gen_utils::INF, gen_utils::INF};
     vector3 max = {-gen_utils::INF, -gen_utils::INF, -gen_utils::INF};
+    std::array<int64_t, 3> min_int64 = { INT64_MAX, INT64_MAX, INT64_MAX };
+    std::array<int64_t, 3> max_int64 = { INT64_MIN, INT64_MIN, INT64_MIN };
+    std::array<uint64_t, 3> min_uint64 = { UINT64_MAX, UINT64_MAX, UINT64_MAX };
+    std::array<uint64_t, 3> max_uint64 = { 0, 0, 0 };
 
     vector3 scale = {1.0, 1.0, 1.0};
     vector3 offset = {0.0, 0.0, 0.0};
@@ -35,6 +43,30 @@ namespace potree {
       this->type = type;
     }
 
+    bool has_int64_range() const { return type == attribute_type::INT64 && min_int64[0] <= max_int64[0]; }
+    bool has_uint64_range() const { return type == attribute_type::UINT64 && min_uint64[0] <= max_uint64[0]; }
+
+    // merges the range and histogram of another instance of the same attribute
+    void merge(const attribute& other) {
+      min.x = std::min(min.x, other.min.x);
+      min.y = std::min(min.y, other.min.y);
+      min.z = std::min(min.z, other.min.z);
+      max.x = std::max(max.x, other.max.x);
+      max.y = std::max(max.y, other.max.y);
+      max.z = std::max(max.z, other.max.z);
+
+      for (int i = 0; i < 3; i++) {
+        min_int64[i] = std::min(min_int64[i], other.min_int64[i]);
+        max_int64[i] = std::max(max_int64[i], other.max_int64[i]);
+        min_uint64[i] = std::min(min_uint64[i], other.min_uint64[i]);
+        max_uint64[i] = std::max(max_uint64[i], other.max_uint64[i]);
+      }
+
+      for (size_t i = 0; i < histogram.size() && i < other.histogram.size(); i++) {
+        histogram[i] += other.histogram[i];
+      }
+    }
+
     bool is_rgb() const { return name == "rgb"; }
     bool is_position() const { return name == "position"; }
     bool is_classification() const { return name == "classification"; }
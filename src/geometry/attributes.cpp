@@ -70,6 +70,27 @@ std::string attributes::to_string() const {
   return ss.str();
 }
 
+// 64 bit integer ranges are written exactly, all other ranges as doubles
+static std::string get_min_json(const attribute& attr, int num_elements) {
+  if (attr.has_int64_range()) return json_utils::to_json(std::vector<int64_t>(attr.min_int64.begin(), attr.min_int64.begin() + num_elements));
+  if (attr.has_uint64_range()) return json_utils::to_json(std::vector<uint64_t>(attr.min_uint64.begin(), attr.min_uint64.begin() + num_elements));
+
+  std::vector<double> values = { attr.min.x, attr.min.y, attr.min.z };
+  values.resize(num_elements);
+
+  return json_utils::to_json(values);
+}
+
+static std::string get_max_json(const attribute& attr, int num_elements) {
+  if (attr.has_int64_range()) return json_utils::to_json(std::vector<int64_t>(attr.max_int64.begin(), attr.max_int64.begin() + num_elements));
+  if (attr.has_uint64_range()) return json_utils::to_json(std::vector<uint64_t>(attr.max_uint64.begin(), attr.max_uint64.begin() + num_elements));
+
+  std::vector<double> values = { attr.max.x, attr.max.y, attr.max.z };
+  values.resize(num_elements);
+
+  return json_utils::to_json(values);
+}
+
 std::string attributes::to_json() const {
   std::stringstream ss;
   ss << "[" << std::endl;
@@ -100,20 +121,20 @@ std::string attributes::to_json() const {
     }
 
     if (attribute.numElements == 1) {
-      ss << json_utils::tab(3) << json_utils::str_value("min") << ": " << json_utils::to_json(std::vector<double>{ attribute.min.x }) << "," << std::endl;
-      ss << json_utils::tab(3) << json_utils::str_value("max") << ": " << json_utils::to_json(std::vector<double>{ attribute.max.x }) << ","<< std::endl;
+      ss << json_utils::tab(3) << json_utils::str_value("min") << ": " << get_min_json(attribute, 1) << "," << std::endl;
+      ss << json_utils::tab(3) << json_utils::str_value("max") << ": " << get_max_json(attribute, 1) << ","<< std::endl;
       ss << json_utils::tab(3) << json_utils::str_value("scale") << ": " << json_utils::to_json(std::vector<double>{ attribute.scale.x }) << ","<< std::endl;
       ss << json_utils::tab(3) << json_utils::str_value("offset") << ": " << json_utils::to_json(std::vector<double>{ attribute.offset.x }) << std::endl;
     } 
     else if (attribute.numElements == 2) {
-      ss << json_utils::tab(3) << json_utils::str_value("min") << ": " << json_utils::to_json(std::vector<double>{ attribute.min.x, attribute.min.y }) << "," << std::endl;
-      ss << json_utils::tab(3) << json_utils::str_value("max") << ": " << json_utils::to_json(std::vector<double>{ attribute.max.x, attribute.max.y }) << ","<< std::endl;
+      ss << json_utils::tab(3) << json_utils::str_value("min") << ": " << get_min_json(attribute, 2) << "," << std::endl;
+      ss << json_utils::tab(3) << json_utils::str_value("max") << ": " << get_max_json(attribute, 2) << ","<< std::endl;
       ss << json_utils::tab(3) << json_utils::str_value("scale") << ": " << json_utils::to_json(std::vector<double>{ attribute.scale.x, attribute.scale.y }) << ","<< std::endl;
       ss << json_utils::tab(3) << json_utils::str_value("offset") << ": " << json_utils::to_json(std::vector<double>{ attribute.offset.x, attribute.offset.y }) << std::endl;
     } 
     else if (attribute.numElements == 3) {
-      ss << json_utils::tab(3) << json_utils::str_value("min") << ": " << json_utils::to_json(std::vector<double>{ attribute.min.x, attribute.min.y, attribute.min.z }) << "," << std::endl;
-      ss << json_utils::tab(3) << json_utils::str_value("max") << ": " << json_utils::to_json(std::vector<double>{ attribute.max.x, attribute.max.y, attribute.max.z }) << ","<< std::endl;
+      ss << json_utils::tab(3) << json_utils::str_value("min") << ": " << get_min_json(attribute, 3) << "," << std::endl;
+      ss << json_utils::tab(3) << json_utils::str_value("max") << ": " << get_max_json(attribute, 3) << ","<< std::endl;
       ss << json_utils::tab(3) << json_utils::str_value("scale") << ": " << json_utils::to_json(std::vector<double>{ attribute.scale.x, attribute.scale.y, attribute.scale.z }) << ","<< std::endl;
       ss << json_utils::tab(3) << json_utils::str_value("offset") << ": " << json_utils::to_json(std::vector<double>{ attribute.offset.x, attribute.offset.y, attribute.offset.z }) << std::endl;
     }
@@ -17,6 +17,12 @@ bounding_box bounding_box::child_of(int index) const {
 	return child_of(min, max, index);
 }
 
+bool bounding_box::intersects(const vector3& min, const vector3& max) const {
+	return this->min.x <= max.x && this->max.x >= min.x
+		&& this->min.y <= max.y && this->max.y >= min.y
+		&& this->min.z <= max.z && this->max.z >= min.z;
+}
+
 bounding_box bounding_box::child_of(const vector3& min, const vector3& max, int index) {
 	bounding_box box;
 	auto size = max - min;
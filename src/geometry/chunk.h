@@ -4,9 +4,22 @@
 #include "bounding_box.h"
 
 namespace potree {
+  class chunk_codec;
+
+  // byte range of a chunk in the pack file of a chunk_store
+  struct chunk_extent {
+    int64_t m_offset = 0;
+    int64_t m_size = 0;
+  };
+
   struct chunk : public bounding_box {
     std::string m_id;
     std::string m_file;
+    // empty if the chunk has a file of its own. otherwise m_file is the pack file
+    // and the points of the chunk are the concatenation of these extents
+    std::vector<chunk_extent> m_extents;
+    // codec of compressed chunks, null if the chunk holds raw points
+    std::shared_ptr<chunk_codec> m_codec;
   };
 
   struct chunks : public bounding_box {
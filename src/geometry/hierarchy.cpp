@@ -2,13 +2,21 @@
 #include <deque>
 #include <condition_variable>
 #include <chrono>
+#include <cmath>
+#include <unordered_set>
 #include "common/task.h"
+#include "common/executor.h"
 #include "common/buffer.h"
 #include "utils/string_utils.h"
 #include "utils/file_utils.h"
+#include "utils/io_utils.h"
 #include "utils/brotli_utils.h"
 #include "utils/json_utils.h"
 #include "utils/chunk_utils.h"
+#include "utils/chunk_store.h"
+#include "utils/chunk_prefetcher.h"
+#include "utils/octree_layout.h"
+#include "utils/numa_utils.h"
 #include "hierarchy.h"
 
 using namespace potree;
@@ -84,17 +92,6 @@ int64_t calculate_grid_index(int64_t pointIndex, const std::shared_ptr<potree::b
   return index;
 }
 
-struct load_task : public task {
-  std::shared_ptr<potree::node> node;
-  int64_t offset;
-  int64_t size;
-
-  load_task(const std::shared_ptr<potree::node>& node, int64_t offset, int64_t size) {
-    this->node = node;
-    this->offset = offset;
-    this->size = size;
-  }
-};
 
 struct chunk_task : public task {
   std::shared_ptr<potree::chunk> m_chunk;
@@ -104,6 +101,73 @@ struct chunk_task : public task {
   }
 };
 
+struct chunk_root_task : public task {
+  chunk_node m_node;
+
+  chunk_root_task(const chunk_node& node) {
+    m_node = node;
+  }
+};
+
+// estimated indexing cost of a chunk. the point count comes from the chunk, sorting and sampling
+// take n log n. all chunks are cells of the same counting grid, so point density is proportional to the count.
+static double estimate_cost(const chunk& c, int64_t bpp) {
+  double num_points = double(std::max(int64_t(1), chunk_utils::get_num_points(c, bpp)));
+
+  return num_points * std::log2(num_points + 1.0);
+}
+
+// tail of a task pool: the time between the start of its last task and the end of all tasks.
+// every task that finishes in the tail leaves a worker idle until the end.
+struct tail_tracker {
+  size_t m_num_tasks = 0;
+  size_t m_num_threads = 0;
+  size_t m_num_started = 0;
+  double m_t_start = 0.0;
+  double m_t_last_start = -1.0;
+  std::vector<double> m_tail_finishes;
+  std::mutex m_mtx;
+
+  tail_tracker(size_t num_tasks, size_t num_threads) {
+    m_num_tasks = num_tasks;
+    m_num_threads = num_threads;
+    m_t_start = gen_utils::now();
+  }
+
+  void on_start() {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    if (++m_num_started == m_num_tasks) m_t_last_start = gen_utils::now();
+  }
+
+  void on_finish() {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    if (m_t_last_start >= 0.0) m_tail_finishes.push_back(gen_utils::now());
+  }
+
+  // reports the tail and the idle worker time in it, as seconds and share of all worker time
+  std::string report(const std::string& name) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    if (m_t_last_start < 0.0) return "";
+
+    double t_end = gen_utils::now();
+    double tail = t_end - m_t_last_start;
+    size_t busy_at_last_start = std::min(m_tail_finishes.size(), m_num_threads);
+    double idle = double(m_num_threads - busy_at_last_start) * tail;
+
+    for (double t : m_tail_finishes) {
+      idle += t_end - t;
+    }
+
+    double total = double(m_num_threads) * (t_end - m_t_start);
+    double share = total > 0.0 ? 100.0 * idle / total : 0.0;
+
+    MINFO << name << ": tail of " << gen_utils::format_number(tail, 3) << "s after the last task started, "
+      << gen_utils::format_number(idle, 3) << "s idle worker time (" << gen_utils::format_number(share, 1) << "%)" << std::endl;
+
+    return gen_utils::format_number(tail, 3) + "s, " + gen_utils::format_number(share, 1) + "% idle";
+  }
+};
+
 void check_error(const std::shared_ptr<potree::node>& node, int64_t size) {
   if (size >= 0) return;
 
@@ -125,10 +189,9 @@ std::string hierarchy::to_json(int64_t depth) const {
   return ss.str();
 }
 
-hierarchy_writer::hierarchy_writer(const std::shared_ptr<hierarchy_indexer>& indexer) {
+hierarchy_writer::hierarchy_writer(hierarchy_indexer* indexer, const std::string& path, bool append) {
   m_indexer = indexer;
-  std::string path = indexer->get_target_dir() + "/octree.bin";
-  m_fs_octree.open(path, std::ios::out | std::ios::binary);
+  m_fs_octree.open(path, std::ios::out | std::ios::binary | (append ? std::ios::app : std::ios::trunc));
   launch();
 }
 
@@ -599,14 +662,60 @@ hierarchy_indexer::hierarchy_indexer(const std::string& target_dir, const potree
   m_attributes = m_chunks->m_attributes;
   m_root = std::make_shared<potree::node>("r", m_chunks->min, m_chunks->max);
   m_spacing = (m_chunks->max - m_chunks->min).x / 128.0;
-  m_writer = std::make_unique<hierarchy_writer>(shared_from_this());
-  m_flusher = std::make_unique<hierarchy_flusher>(target_dir + "/.hierarchyChunks");
-  std::string cr_file = target_dir + "/tmpChunkRoots.bin";
-  m_fs_chunk_roots.open(cr_file, std::ios::out | std::ios::binary);
+}
+
+hierarchy_indexer::hierarchy_indexer(const std::string& target_dir, const potree::options& opts, const vector3& min, const vector3& max, const attributes& attrs) {
+  m_target_dir = target_dir;
+  m_options = opts;
+  m_chunks = std::make_shared<potree::chunks>(std::vector<std::shared_ptr<chunk>>(), min, max);
+  m_chunks->m_attributes = attrs;
+  m_attributes = attrs;
+  m_root = std::make_shared<potree::node>("r", min, max);
+  m_spacing = (max - min).x / 128.0;
 }
 
 hierarchy_indexer::~hierarchy_indexer() {
-  m_fs_chunk_roots.close();
+  if (m_chunk_root_spill != nullptr) m_chunk_root_spill->close();
+}
+
+std::string hierarchy_indexer::get_shard_dir(const std::string& target_dir, int shard_index) {
+  return target_dir + "/shards/shard_" + std::to_string(shard_index);
+}
+
+void hierarchy_indexer::open_output(const std::string& output_dir, bool append) {
+  m_output_dir = output_dir;
+  std::filesystem::create_directories(output_dir);
+
+  m_writer = std::make_unique<hierarchy_writer>(this, output_dir + "/octree.bin", append);
+  m_flusher = std::make_shared<hierarchy_flusher>(output_dir + "/.hierarchyChunks");
+  m_chunk_root_spill = std::make_unique<spill_store>(output_dir + "/tmpChunkRoots.bin", append);
+}
+
+// assigns chunks to shards, largest first to the shard with the fewest points.
+// only depends on the chunk files, so every process computes the same assignment.
+std::vector<std::shared_ptr<chunk>> hierarchy_indexer::select_shard(int shard_index, int shard_count) const {
+  std::vector<std::pair<std::shared_ptr<chunk>, int64_t>> sized;
+
+  for (const auto& c : m_chunks->m_list) {
+    sized.push_back({ c, chunk_utils::get_num_points(*c, m_attributes.bytes) });
+  }
+
+  std::sort(sized.begin(), sized.end(), [](const auto& a, const auto& b) {
+    if (a.second != b.second) return a.second > b.second;
+    return a.first->m_id < b.first->m_id;
+  });
+
+  std::vector<int64_t> shard_points(shard_count, 0);
+  std::vector<std::shared_ptr<chunk>> selected;
+
+  for (const auto& [c, num_points] : sized) {
+    auto lightest = std::min_element(shard_points.begin(), shard_points.end()) - shard_points.begin();
+    shard_points[lightest] += num_points;
+
+    if (lightest == shard_index) selected.push_back(c);
+  }
+
+  return selected;
 }
 
 void hierarchy_indexer::wait_for_backlog_below(int max_mb) {
@@ -764,47 +873,29 @@ hierarchy hierarchy_indexer::create_hiearchy(const std::string& path) {
 }
 
 void hierarchy_indexer::flush(const std::shared_ptr<potree::node>& chunk_root) {
-  std::lock_guard<std::mutex> lock(m_root_mtx);
-
-  static int64_t offset = 0;
-  int64_t size = m_root->points->size;
-  m_fs_chunk_roots.write(m_root->points->data_char, size);
+  // the spill store reserves the range, only the bookkeeping needs the lock
+  int64_t size = chunk_root->points->size;
+  int64_t offset = m_chunk_root_spill->append(chunk_root->points->data, size);
 
   node_flush_info fcr;
-  fcr.m_node = m_root;
+  fcr.m_node = chunk_root;
   fcr.offset = offset;
   fcr.size = size;
 
-  m_root->points = nullptr;
+  chunk_root->points = nullptr;
+
+  std::lock_guard<std::mutex> lock(m_root_mtx);
   m_flushed_chunk_roots.push_back(fcr);
-  offset += size;
 }
 
 void hierarchy_indexer::reload() {
   gen_utils::profiler pr("hierarchy_indexer::reload()");
 
-  m_fs_chunk_roots.close();
-
-  std::string targetDir = m_target_dir;
-  task_pool pool(16, [targetDir](std::shared_ptr<task> t) {
-    auto task = std::static_pointer_cast<load_task>(t);
-    std::string octreePath = targetDir + "/tmpChunkRoots.bin";
-    std::shared_ptr<potree::node> node = task->node;
-    int64_t start = task->offset;
-    int64_t size = task->size;
-
-    auto buffer = std::make_shared<potree::buffer>(size);
-    file_utils::read_binary(octreePath, start, size, buffer->data);
-
-    node->points = buffer;
-  });
+  m_chunk_root_spill->seal();
 
   for (auto& fcr : m_flushed_chunk_roots) {
-    auto task = std::make_shared<load_task>(fcr.m_node, fcr.offset, fcr.size);
-    pool.add(task);
+    fcr.m_node->points = m_chunk_root_spill->view(fcr.offset, fcr.size);
   }
-
-  pool.close();
 }
 
 std::vector<chunk_node> hierarchy_indexer::process_chunk_roots() {
@@ -1100,8 +1191,43 @@ void hierarchy_indexer::on_discarded(const std::shared_ptr<potree::node>& node)
   // nothing to do
 }
 
-void hierarchy_indexer::do_indexing(const std::shared_ptr<potree::status>& state, const std::shared_ptr<potree::sampler>& sampler) {
-  gen_utils::profiler pr("hierarchy_indexer::do_indexing()");
+// builds and samples the hierarchy of a chunk, then flushes the chunk root until finish_indexing(). returns the number of points
+int64_t hierarchy_indexer::index_chunk(const std::shared_ptr<chunk>& chunk, const std::shared_ptr<potree::buffer>& points, const std::shared_ptr<potree::sampler>& sampler) {
+  const auto on_complete = [this](auto const & n){
+    on_completed(n);
+  };
+  const auto on_discard = [this](auto const& n){
+    on_discarded(n);
+  };
+
+  auto chunk_root = std::make_shared<potree::node>(chunk->m_id, chunk->min, chunk->max);
+  auto& attrs = m_chunks->m_attributes;
+  int64_t num_points = points->size / attrs.bytes;
+  m_bytes_in_memory += points->size;
+
+  build_hierarchy(chunk_root, points, num_points);
+
+  sampler->sample(chunk_root, attrs, m_spacing, on_complete, on_discard);
+
+	// detach anything below the chunk root. Will be reloaded from
+	// temporarily flushed hierarchy during creation of the hierarchy file
+	chunk_root->children.clear();
+  flush(chunk_root);
+
+  std::lock_guard<std::mutex> lock(m_root_mtx);
+
+  if (chunk_root->name.size() > 1) {
+    // add chunk root, provided it isn't the root.
+    m_root->addDescendant(chunk_root);
+  }
+
+  m_chunk_roots.push_back(chunk_root);
+
+  return num_points;
+}
+
+void hierarchy_indexer::index_chunks(const std::shared_ptr<potree::status>& state, const std::shared_ptr<potree::sampler>& sampler, const std::vector<std::shared_ptr<chunk>>& chunk_list, bool remove_chunks) {
+  gen_utils::profiler pr("hierarchy_indexer::index_chunks()");
 
   state->name = "INDEXING";
   state->currentPass = 3;
@@ -1115,60 +1241,64 @@ void hierarchy_indexer::do_indexing(const std::shared_ptr<potree::status>& state
   int64_t total_bytes = 0;
   int64_t processed_points = 0;
   std::atomic_int64_t active_threads = 0;
-  int num_threads = gen_utils::get_num_processors() + 4;
-  std::vector<std::shared_ptr<potree::node>> nodes;
+  // workers block on chunk reads before they index, so they may use the io threads as well
+  int num_threads = int(executor::instance().get_num_threads());
   std::mutex nodes_mtx;
 
-  for(const auto& chunk : m_chunks->m_list) {
-    auto file_size = file_utils::size(chunk->m_file);
-    total_points += file_size / m_attributes.bytes;
-    total_bytes += file_size;
+  for(const auto& chunk : chunk_list) {
+    total_points += chunk_utils::get_num_points(*chunk, m_attributes.bytes);
+    total_bytes += chunk_utils::get_size(*chunk);
   }
 
-  // create task pool
-  const auto on_complete = [this](auto const & n){
-    on_completed(n);
-  };
-  const auto on_discard = [this](auto const& n){
-    on_discarded(n);
-  };
-  task_pool pool(num_threads, [this, t_start, &state, &nodes, &nodes_mtx, &active_threads, &sampler, &processed_points, &total_points, &last_report, &on_complete, &on_discard](std::shared_ptr<potree::task> t) {
+  // largest first, so that no large chunk starts when all others are done and keeps a single worker busy.
+  // the pool and the prefetcher both follow this order
+  std::vector<std::pair<double, std::shared_ptr<chunk>>> costs;
+  for (const auto& chunk : chunk_list) {
+    costs.push_back({ estimate_cost(*chunk, m_attributes.bytes), chunk });
+  }
+
+  std::stable_sort(costs.begin(), costs.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+  std::vector<std::shared_ptr<chunk>> ordered_chunks;
+  for (const auto& [cost, chunk] : costs) {
+    ordered_chunks.push_back(chunk);
+  }
+
+  tail_tracker tail(ordered_chunks.size(), num_threads);
+
+  // numa mode doesn't prefetch: the prefetcher's threads aren't pinned, their buffers would land on any node.
+  // the pinned workers read their chunks themselves instead, see below
+  bool numa = numa_utils::is_enabled();
+
+  std::unique_ptr<chunk_prefetcher> prefetcher;
+  if (m_options.m_prefetch_mb > 0 && !numa) {
+    prefetcher = std::make_unique<chunk_prefetcher>(ordered_chunks, executor::instance().get_io_threads(), num_threads, m_options.m_prefetch_mb * 1024 * 1024, m_attributes.bytes);
+  }
+
+  task_pool pool(num_threads, [this, t_start, remove_chunks, &state, &nodes_mtx, &active_threads, &sampler, &processed_points, &total_points, &last_report, &prefetcher, &tail](std::shared_ptr<potree::task> t) {
     auto task = std::static_pointer_cast<chunk_task>(t);
+    tail.on_start();
     auto& chunk = task->m_chunk;
-    auto chunk_root = std::make_shared<potree::node>(chunk->m_id, chunk->min, chunk->max);
-    auto& attrs = m_chunks->m_attributes;
-    int64_t bpp = attrs.bytes;
 
     wait_for_backlog_below(1'000);
     active_threads++;
-    size_t file_size = file_utils::size(chunk->m_file);
+    size_t file_size = chunk_utils::get_size(*chunk);
 
 		MINFO << "start indexing chunk " + chunk->m_id << std::endl
 		<< "filesize: " << gen_utils::format_number(file_size) << std::endl
 		<< "min: " << chunk->min.to_string() << std::endl
 		<< "max: " << chunk->max.to_string() << std::endl;
 
-    m_bytes_in_memory += file_size;
-    auto pt_buffer = file_utils::read_binary(chunk->m_file);
+    auto pt_buffer = prefetcher != nullptr ? prefetcher->take(*chunk) : chunk_utils::read_chunk(*chunk);
+    double t_compute = gen_utils::now();
 
-    if (!m_options.m_keep_chunks) {
-      std::filesystem::remove(chunk->m_file);
+    if (remove_chunks) {
+      chunk_utils::remove_chunk(*chunk);
     }
 
-    int64_t num_points = pt_buffer->size / bpp;
-    build_hierarchy(chunk_root, pt_buffer, num_points);
-
-    sampler->sample(chunk_root, attrs, m_spacing, on_complete, on_discard);
+    int64_t num_points = index_chunk(chunk, pt_buffer, sampler);
 
-		// detach anything below the chunk root. Will be reloaded from
-		// temporarily flushed hierarchy during creation of the hierarchy file
-		chunk_root->children.clear();
-    flush(chunk_root);
-
-    if (chunk_root->name.size() > 1) {
-      // add chunk root, provided it isn't the root.
-      m_root->addDescendant(chunk_root);
-    }
+    if (prefetcher != nullptr) prefetcher->report_compute(gen_utils::now() - t_compute);
 
     std::lock_guard<std::mutex> lock(nodes_mtx);
 
@@ -1181,43 +1311,84 @@ void hierarchy_indexer::do_indexing(const std::shared_ptr<potree::status>& state
       last_report = gen_utils::now();
     }
 
-    nodes.push_back(chunk_root);
     MINFO << "Finished indexing chunk " << chunk->m_id << std::endl;
 
     active_threads--;
+    tail.on_finish();
   });
 
-  for(const auto& chunk : m_chunks->m_list) {
+  // numa mode: chunks go to the node with the fewest points so far. the pinned workers of that node read them,
+  // so their point buffers are allocated on the node that builds their hierarchy.
+  std::vector<int64_t> node_points(numa_utils::get_num_nodes(), 0);
+
+  for(const auto& chunk : ordered_chunks) {
     auto task = std::make_shared<chunk_task>(chunk);
+
+    if (numa) {
+      auto node = std::min_element(node_points.begin(), node_points.end());
+      *node += chunk_utils::get_num_points(*chunk, m_attributes.bytes);
+      task->m_numa_node = int(node - node_points.begin());
+    }
+
     pool.add(task);
   }
 
   pool.wait();
   pool.close();
 
-  m_fs_chunk_roots.close();
+  if (prefetcher != nullptr) prefetcher->close();
+
+  state->values["tail(indexing)"] = tail.report("index_chunks");
+}
+
+// samples the nodes above the chunk roots and writes hierarchy.bin and metadata.json
+void hierarchy_indexer::finish_indexing(const std::shared_ptr<potree::status>& state, const std::shared_ptr<potree::sampler>& sampler, double t_start) {
+  const auto on_complete = [this](auto const & n){
+    on_completed(n);
+  };
+  const auto on_discard = [this](auto const& n){
+    on_discarded(n);
+  };
 
-  // process chunk roots in batches
+  // process chunk roots in batches.
+  // the batches are disjoint subtrees, they are sampled in parallel, largest first
 	{ 
-		std::string tmpChunkRootsPath = m_target_dir + "/tmpChunkRoots.bin";
+		m_chunk_root_spill->seal();
 		auto tasks = process_chunk_roots();
 
-		for (auto& task : tasks) {
-			
+    std::stable_sort(tasks.begin(), tasks.end(), [](const chunk_node& a, const chunk_node& b) {
+      return a.numPoints > b.numPoints;
+    });
+
+    size_t num_threads = executor::instance().get_compute_threads();
+    tail_tracker tail(tasks.size(), num_threads);
+
+    task_pool pool(num_threads, [this, &sampler, &on_complete, &on_discard, &tail](std::shared_ptr<potree::task> t) {
+      auto& task = std::static_pointer_cast<chunk_root_task>(t)->m_node;
+      tail.on_start();
+
       for (auto& fcr : task.m_flushed_roots) {
-				auto buffer = std::make_shared<potree::buffer>(fcr.size);
-				file_utils::read_binary(tmpChunkRootsPath, fcr.offset, fcr.size, buffer->data);
-				fcr.m_node->points = buffer;
+				fcr.m_node->points = m_chunk_root_spill->view(fcr.offset, fcr.size);
 			}
 
 			sampler->sample(task.m_node, m_attributes, m_spacing, on_complete, on_discard);
 			task.m_node->children.clear();
+      tail.on_finish();
+    });
+
+		for (auto& task : tasks) {
+      pool.add(std::make_shared<chunk_root_task>(task));
 		}
+
+    pool.wait();
+    pool.close();
+
+    state->values["tail(chunk roots)"] = tail.report("finish_indexing");
 	}
 
 	// sample up to root node
 	if (m_chunks->m_list.size() == 1) {
-		auto& node = nodes[0];
+		auto& node = m_chunk_roots[0];
 		m_root = node;
 	} 
   else if (!m_root->sampled){
@@ -1228,9 +1399,17 @@ void hierarchy_indexer::do_indexing(const std::shared_ptr<potree::status>& state
   on_complete(m_root);
   m_writer->close_and_wait();
   m_flusher->flush(hierarchy::DEFAULT_STEP_SIZE);
-  std::string h_dir = m_target_dir + "./hierarchyChunks";
+  std::string h_dir = m_output_dir + "/.hierarchyChunks";
   hierarchy_builder builder(h_dir, hierarchy::DEFAULT_STEP_SIZE);
   builder.build();
+
+  if (m_options.m_optimize_layout) {
+    MINFO << "Optimizing octree layout" << std::endl;
+    double t_layout = gen_utils::now();
+    octree_layout::optimize(m_output_dir);
+    state->values["duration(layout)"] = gen_utils::format_number(gen_utils::now() - t_layout, 3);
+  }
+
   hierarchy h;
   h.m_step_size = hierarchy::DEFAULT_STEP_SIZE;
   h.m_first_chunk_size = builder.m_root_batch->byteSize;
@@ -1246,15 +1425,279 @@ void hierarchy_indexer::do_indexing(const std::shared_ptr<potree::status>& state
 			std::string cmpath = m_target_dir + "/chunks/metadata.json";
 
 			std::filesystem::remove(cmpath);
+			chunk_store::remove_files(m_target_dir + "/chunks");
 			std::filesystem::remove(m_target_dir + "/chunks");
 		}
 
 		// delete chunk roots data
-		std::string octree_path = m_target_dir + "/tmpChunkRoots.bin";
+		m_chunk_root_spill->close();
+		std::string octree_path = m_output_dir + "/tmpChunkRoots.bin";
 		std::filesystem::remove(octree_path);
+
+		// descriptors of removed temporary files would keep their space allocated
+		io_utils::close_all();
 	}
 
 	double duration = gen_utils::now() - t_start;
 	state->values["duration(indexing)"] = gen_utils::format_number(duration, 3);
+}
+
+void hierarchy_indexer::do_indexing(const std::shared_ptr<potree::status>& state, const std::shared_ptr<potree::sampler>& sampler) {
+  gen_utils::profiler pr("hierarchy_indexer::do_indexing()");
+  double t_start = gen_utils::now();
+
+  open_output(m_target_dir, false);
+  index_chunks(state, sampler, m_chunks->m_list, !m_options.m_keep_chunks);
+  finish_indexing(state, sampler, t_start);
+}
+
+void hierarchy_indexer::start_pipeline(const std::shared_ptr<potree::sampler>& sampler) {
+  m_pipeline_t_start = gen_utils::now();
+  open_output(m_target_dir, false);
+
+  bool remove_chunks = !m_options.m_keep_chunks;
+
+  // the distributor runs on the compute threads as well, the os shares the cpus until chunking is done
+  m_pipeline = std::make_unique<task_pool>(executor::instance().get_compute_threads(), [this, remove_chunks, sampler](std::shared_ptr<potree::task> t) {
+    auto& chunk = std::static_pointer_cast<chunk_task>(t)->m_chunk;
+
+    wait_for_backlog_below(1'000);
+    MINFO << "start indexing chunk " << chunk->m_id << " (pipelined)" << std::endl;
+
+    // the chunk was just written, its pages are usually still cached
+    auto points = chunk_utils::read_chunk(*chunk);
+
+    if (remove_chunks) {
+      chunk_utils::remove_chunk(*chunk);
+    }
+
+    index_chunk(chunk, points, sampler);
+    MINFO << "Finished indexing chunk " << chunk->m_id << std::endl;
+  });
+}
+
+void hierarchy_indexer::add_chunk(const std::shared_ptr<chunk>& chunk) {
+  if (m_pipeline == nullptr) throw std::runtime_error("hierarchy_indexer::add_chunk(): the pipeline wasn't started");
+
+  {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_pipelined_chunks.push_back(chunk);
+  }
+
+  m_pipeline->add(std::make_shared<chunk_task>(chunk));
+}
+
+void hierarchy_indexer::finish_pipeline(const std::shared_ptr<potree::status>& state, const std::shared_ptr<potree::sampler>& sampler) {
+  gen_utils::profiler pr("hierarchy_indexer::finish_pipeline()");
+
+  m_pipeline->close();
+  m_pipeline = nullptr;
+
+  // attribute ranges are complete once all points are distributed
+  auto chunks = chunk_utils::load_chunks(m_target_dir);
+  m_chunks->m_attributes = chunks->m_attributes;
+  m_attributes = chunks->m_attributes;
+
+  // refined chunks replace chunks that were too large for the pipeline
+  std::unordered_set<std::string> pipelined_ids;
+  for (const auto& chunk : m_pipelined_chunks) {
+    pipelined_ids.insert(chunk->m_id);
+  }
+
+  std::vector<std::shared_ptr<chunk>> remaining;
+  for (const auto& chunk : chunks->m_list) {
+    if (pipelined_ids.count(chunk->m_id) == 0) remaining.push_back(chunk);
+  }
+
+  MINFO << "pipelined indexing: " << m_pipelined_chunks.size() << " chunks were indexed during chunking, "
+    << remaining.size() << " are indexed now" << std::endl;
+  state->values["pipelined chunks"] = gen_utils::format_number(m_pipelined_chunks.size());
+
+  m_chunks->m_list = m_pipelined_chunks;
+  m_chunks->m_list.insert(m_chunks->m_list.end(), remaining.begin(), remaining.end());
+
+  if (!remaining.empty()) {
+    index_chunks(state, sampler, remaining, !m_options.m_keep_chunks);
+  }
+
+  finish_indexing(state, sampler, m_pipeline_t_start);
+}
+
+// indexes the chunks of one shard into its own octree.bin, hierarchy chunks and chunk roots.
+// chunk files are kept until the merge, the other shards derive their assignment from them.
+void hierarchy_indexer::index_shard(const std::shared_ptr<potree::status>& state, const std::shared_ptr<potree::sampler>& sampler, int shard_index, int shard_count) {
+  gen_utils::profiler pr("hierarchy_indexer::index_shard()");
+
+  if (shard_count < 1 || shard_index < 0 || shard_index >= shard_count) {
+    throw std::runtime_error("invalid shard " + std::to_string(shard_index) + " of " + std::to_string(shard_count));
+  }
+
+  auto chunk_list = select_shard(shard_index, shard_count);
+  std::string shard_dir = get_shard_dir(m_target_dir, shard_index);
+
+  MINFO << "indexing shard " << shard_index << " of " << shard_count << ": " << gen_utils::format_number(chunk_list.size()) << " chunks" << std::endl;
+
+  // results of an earlier, possibly interrupted attempt
+  std::filesystem::remove_all(shard_dir);
+  open_output(shard_dir, false);
+  index_chunks(state, sampler, chunk_list, false);
+
+  m_writer->close_and_wait();
+  m_flusher->flush(hierarchy::DEFAULT_STEP_SIZE);
+
+  json js;
+  js["shard"] = shard_index;
+  js["shards"] = shard_count;
+  js["octreeSize"] = int64_t(m_byte_offset);
+  js["octreeDepth"] = m_octree_depth;
+  js["chunkRootsSize"] = m_chunk_root_spill->size();
+  js["chunks"] = json::array();
+  js["chunkRoots"] = json::array();
+
+  for (const auto& chunk : chunk_list) {
+    js["chunks"].push_back(chunk->m_id);
+  }
+
+  for (const auto& fcr : m_flushed_chunk_roots) {
+    json js_root;
+    js_root["name"] = fcr.m_node->name;
+    js_root["numPoints"] = fcr.m_node->numPoints;
+    js_root["min"] = { fcr.m_node->min.x, fcr.m_node->min.y, fcr.m_node->min.z };
+    js_root["max"] = { fcr.m_node->max.x, fcr.m_node->max.y, fcr.m_node->max.z };
+    js_root["offset"] = fcr.offset;
+    js_root["size"] = fcr.size;
+    js["chunkRoots"].push_back(js_root);
+  }
+
+  // the manifest is written last, a shard without one is unfinished
+  std::string manifest_path = shard_dir + "/manifest.json";
+  file_utils::write_text(manifest_path + ".tmp", js.dump(2));
+  std::filesystem::rename(manifest_path + ".tmp", manifest_path);
+
+  MINFO << "finished shard " << shard_index << ": " << gen_utils::format_number(int64_t(m_byte_offset)) << " bytes" << std::endl;
+}
+
+// appends src to the stream and returns the number of bytes copied
+static int64_t append_file(const std::string& src, std::fstream& target) {
+  // streaming an empty buffer would set the failbit of the target
+  if (!std::filesystem::exists(src) || std::filesystem::file_size(src) == 0) return 0;
+
+  std::ifstream in(src, std::ios::binary);
+  int64_t start = target.tellp();
+  target << in.rdbuf();
+
+  return int64_t(target.tellp()) - start;
+}
+
+// merges the shards in shard order, so the same shards always produce the same octree.bin and hierarchy.bin
+void hierarchy_indexer::merge_shards(const std::shared_ptr<potree::status>& state, const std::shared_ptr<potree::sampler>& sampler, int shard_count) {
+  gen_utils::profiler pr("hierarchy_indexer::merge_shards()");
+  double t_start = gen_utils::now();
+
+  std::vector<json> manifests;
+
+  for (int i = 0; i < shard_count; i++) {
+    std::string manifest_path = get_shard_dir(m_target_dir, i) + "/manifest.json";
+
+    if (!std::filesystem::exists(manifest_path)) {
+      throw std::runtime_error("shard " + std::to_string(i) + " has not finished indexing, missing " + manifest_path);
+    }
+
+    json js = file_utils::read_json(manifest_path);
+    if (js["shards"].get<int>() != shard_count) {
+      throw std::runtime_error("shard " + std::to_string(i) + " was indexed as one of " + std::to_string(js["shards"].get<int>()) + " shards, expected " + std::to_string(shard_count));
+    }
+
+    manifests.push_back(js);
+  }
+
+  // partial octrees and chunk roots are concatenated, every shard's offsets move by the size of the shards before it
+  std::vector<int64_t> octree_offsets(shard_count, 0);
+  std::vector<int64_t> chunk_roots_offsets(shard_count, 0);
+  {
+    std::fstream octree(m_target_dir + "/octree.bin", std::ios::out | std::ios::binary | std::ios::trunc);
+    std::fstream chunk_roots(m_target_dir + "/tmpChunkRoots.bin", std::ios::out | std::ios::binary | std::ios::trunc);
+    int64_t octree_size = 0;
+    int64_t chunk_roots_size = 0;
+
+    for (int i = 0; i < shard_count; i++) {
+      std::string shard_dir = get_shard_dir(m_target_dir, i);
+      octree_offsets[i] = octree_size;
+      chunk_roots_offsets[i] = chunk_roots_size;
+
+      octree_size += append_file(shard_dir + "/octree.bin", octree);
+      chunk_roots_size += append_file(shard_dir + "/tmpChunkRoots.bin", chunk_roots);
+
+      if (octree_size != octree_offsets[i] + manifests[i]["octreeSize"].get<int64_t>()) {
+        throw std::runtime_error("octree.bin of shard " + std::to_string(i) + " doesn't match its manifest");
+      }
+    }
+
+    m_byte_offset = octree_size;
+  }
+
+  open_output(m_target_dir, true);
+
+  // hierarchy fragments keep their batch files, records only need their byte offsets rebased
+  for (int i = 0; i < shard_count; i++) {
+    std::string fragment_dir = get_shard_dir(m_target_dir, i) + "/.hierarchyChunks";
+    if (!std::filesystem::exists(fragment_dir)) continue;
+
+    for (const auto& entry : std::filesystem::directory_iterator(fragment_dir)) {
+      if (!string_utils::iends_with(entry.path().string(), ".bin")) continue;
+
+      auto fragment = file_utils::read_binary(entry.path().string());
+      int64_t num_records = fragment->size / 48;
+
+      for (int64_t j = 0; j < num_records; j++) {
+        int64_t byte_offset = fragment->get<int64_t>(48 * j + 35);
+        fragment->set<int64_t>(byte_offset + octree_offsets[i], 48 * j + 35);
+      }
+
+      std::fstream fout(m_output_dir + "/.hierarchyChunks/" + entry.path().filename().string(), std::ios::app | std::ios::out | std::ios::binary);
+      fout.write(fragment->data_char, fragment->size);
+    }
+  }
+
+  // chunk roots in name order, independent of the order in which shards indexed them
+  std::vector<node_flush_info> flushed_roots;
+
+  for (int i = 0; i < shard_count; i++) {
+    for (const auto& js_root : manifests[i]["chunkRoots"]) {
+      vector3 min = { js_root["min"][0].get<double>(), js_root["min"][1].get<double>(), js_root["min"][2].get<double>() };
+      vector3 max = { js_root["max"][0].get<double>(), js_root["max"][1].get<double>(), js_root["max"][2].get<double>() };
+
+      node_flush_info fcr;
+      fcr.m_node = std::make_shared<potree::node>(js_root["name"].get<std::string>(), min, max);
+      fcr.m_node->numPoints = js_root["numPoints"];
+      fcr.offset = js_root["offset"].get<int64_t>() + chunk_roots_offsets[i];
+      fcr.size = js_root["size"];
+      flushed_roots.push_back(fcr);
+    }
+
+    m_octree_depth = std::max(m_octree_depth, manifests[i]["octreeDepth"].get<int64_t>());
+  }
+
+  std::sort(flushed_roots.begin(), flushed_roots.end(), [](const node_flush_info& a, const node_flush_info& b) {
+    return node::compare_breadth(a.m_node, b.m_node);
+  });
+
+  for (const auto& fcr : flushed_roots) {
+    if (fcr.m_node->name.size() > 1) {
+      m_root->addDescendant(fcr.m_node);
+    }
+
+    m_chunk_roots.push_back(fcr.m_node);
+    m_flushed_chunk_roots.push_back(fcr);
+  }
+
+  if (!m_options.m_keep_chunks) {
+    for (const auto& chunk : m_chunks->m_list) {
+      chunk_utils::remove_chunk(*chunk);
+    }
+  }
+
+  finish_indexing(state, sampler, t_start);
 
+  std::filesystem::remove_all(m_target_dir + "/shards");
 }
@@ -5,9 +5,11 @@
 #include <deque>
 #include <fstream>
 #include "common/options.h"
+#include "common/task.h"
 #include "sampler/sampler.h"
 #include "node.h"
 #include "chunk.h"
+#include "utils/spill_store.h"
 
 namespace potree {
 
@@ -57,7 +59,7 @@ namespace potree {
 
   struct hierarchy_writer {
   public:
-    hierarchy_writer(const std::shared_ptr<hierarchy_indexer>& indexer);
+    hierarchy_writer(hierarchy_indexer* indexer, const std::string& path, bool append = false);
     void write_and_unload(const std::shared_ptr<potree::node>& node);
     void close_and_wait();
     int64_t get_backlog_size_mb();
@@ -69,7 +71,7 @@ namespace potree {
 
     std::shared_ptr<potree::buffer> m_active_buffer;
     std::deque<std::shared_ptr<potree::buffer>> m_backlog;
-    std::shared_ptr<hierarchy_indexer> m_indexer;
+    hierarchy_indexer* m_indexer;
     std::fstream m_fs_octree;  
 
     bool m_close_requested = false;
@@ -78,7 +80,13 @@ namespace potree {
     void launch();
   };
 
-  struct hierarchy_indexer : public std::enable_shared_from_this<hierarchy_indexer> {
+  // indexes the chunks of <target_dir>/chunks into octree.bin, hierarchy.bin and metadata.json.
+  // sharded indexing splits the chunks among several processes: every shard indexes its chunks into
+  // <target_dir>/shards/shard_<i>, then merge_shards() concatenates the partial octrees,
+  // rebases the hierarchy fragments and samples the nodes above the chunk roots.
+  // pipelined indexing starts on chunks while the distributor still writes the others: start_pipeline(),
+  // add_chunk() for every complete chunk, then finish_pipeline() once chunking is done.
+  struct hierarchy_indexer {
   public:
     static const int MAX_POINTS_PER_CHUNK = 10'000;
 
@@ -90,6 +98,8 @@ namespace potree {
     options m_options;
 
     hierarchy_indexer(const std::string& target_dir, const potree::options& opts);
+    // for pipelined indexing, the chunks don't exist yet. min and max are the cube of the chunker
+    hierarchy_indexer(const std::string& target_dir, const potree::options& opts, const vector3& min, const vector3& max, const attributes& attrs);
     ~hierarchy_indexer();
 
     std::string get_target_dir() const { return m_target_dir; }
@@ -104,6 +114,15 @@ namespace potree {
     std::vector<chunk_node> process_chunk_roots();
     void build_hierarchy(const std::shared_ptr<potree::node>& node, const std::shared_ptr<potree::buffer>& points, int64_t num_points, int64_t depth = 0);
     void do_indexing(const std::shared_ptr<potree::status>& state, const std::shared_ptr<potree::sampler>& sampler);
+    void index_shard(const std::shared_ptr<potree::status>& state, const std::shared_ptr<potree::sampler>& sampler, int shard_index, int shard_count);
+    void merge_shards(const std::shared_ptr<potree::status>& state, const std::shared_ptr<potree::sampler>& sampler, int shard_count);
+    void start_pipeline(const std::shared_ptr<potree::sampler>& sampler);
+    // queues a complete chunk, called from the distributor's writer threads
+    void add_chunk(const std::shared_ptr<chunk>& chunk);
+    // indexes the chunks that weren't added, e.g. refined ones, then finishes the octree like do_indexing()
+    void finish_pipeline(const std::shared_ptr<potree::status>& state, const std::shared_ptr<potree::sampler>& sampler);
+
+    static std::string get_shard_dir(const std::string& target_dir, int shard_index);
   private:
     std::mutex m_mtx;
     std::mutex m_root_mtx;
@@ -117,12 +136,24 @@ namespace potree {
     std::shared_ptr<hierarchy_flusher> m_flusher;
 
     std::string m_target_dir;
+    std::string m_output_dir; // receives octree.bin, hierarchy chunks and chunk roots. a shard directory when sharded
     std::shared_ptr<node> m_root;
+    std::vector<std::shared_ptr<node>> m_chunk_roots;
     std::vector<std::shared_ptr<node>> m_detached_parts;
     std::vector<node_flush_info> m_flushed_chunk_roots;
-    std::fstream m_fs_chunk_roots;
+    // points of the flushed chunk roots, read back as views once indexing of the chunks is done
+    std::unique_ptr<spill_store> m_chunk_root_spill;
     std::shared_ptr<potree::chunks> m_chunks;
-
+    // pipelined indexing: workers that index the added chunks, and those chunks
+    std::unique_ptr<task_pool> m_pipeline;
+    std::vector<std::shared_ptr<chunk>> m_pipelined_chunks;
+    double m_pipeline_t_start = 0.0;
+
+    void open_output(const std::string& output_dir, bool append);
+    std::vector<std::shared_ptr<chunk>> select_shard(int shard_index, int shard_count) const;
+    int64_t index_chunk(const std::shared_ptr<chunk>& chunk, const std::shared_ptr<potree::buffer>& points, const std::shared_ptr<potree::sampler>& sampler);
+    void index_chunks(const std::shared_ptr<potree::status>& state, const std::shared_ptr<potree::sampler>& sampler, const std::vector<std::shared_ptr<chunk>>& chunk_list, bool remove_chunks);
+    void finish_indexing(const std::shared_ptr<potree::status>& state, const std::shared_ptr<potree::sampler>& sampler, double t_start);
     void on_completed(const std::shared_ptr<potree::node>& node);
     void on_discarded(const std::shared_ptr<potree::node>& node);
   };
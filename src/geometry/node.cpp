@@ -2,6 +2,7 @@
 #include "node.h"
 #include "utils/attribute_utils.h"
 #include "utils/file_utils.h"
+#include "reader/hierarchy_reader.h"
 
 using namespace potree;
 
@@ -116,34 +117,35 @@ attributes node::parse_attributes(const json& metadata) {
   return attrs;
 }
 
-std::shared_ptr<potree::node> node::load_hierarchy(const std::string& path, const json& metadata) {
-  auto buffer = file_utils::read_binary(path + "/hierarchy.bin");
-  auto hierarchy_md = metadata["hierarchy"];
-  int64_t first_chunk_size = metadata["firstChunkSize"];
-  int step_size = metadata["stepSize"];
-
-  // load only first hierarchy chunk
-  int64_t h_byte_offset = 0;
-  int64_t h_byte_size = first_chunk_size;
+// parses one hierarchy chunk. its first record describes the chunk root itself,
+// proxy records point to further chunks and are collected in "proxies".
+void node::load_hierarchy_chunk(const uint8_t* data, int64_t size, const std::shared_ptr<potree::node>& chunk_root, std::vector<std::shared_ptr<potree::node>>& proxies) {
   int64_t bytes_per_node = 22;
-  int64_t num_nodes = buffer->size / bytes_per_node;
-
-  auto root = std::make_shared<node>();
-  root->name = "r";
-  std::vector<std::shared_ptr<node>> nodes = { root };
-
-  for(int64_t i = 0; i < num_nodes; i++) {
-    auto &current = nodes[i];
-    node_type type = static_cast<node_type>(buffer->data_u8[i * bytes_per_node + 0]);
-    uint8_t child_mask = buffer->data_u8[i * bytes_per_node + 1];
-    uint32_t num_points = reinterpret_cast<uint32_t*>(buffer->data_u8 + i * bytes_per_node + 2)[0];
-    int64_t byte_offset = reinterpret_cast<uint64_t*>(buffer->data_u8 + i * bytes_per_node + 6)[0];
-    int64_t byte_size = reinterpret_cast<uint64_t*>(buffer->data_u8 + i * bytes_per_node + 14)[0];
+  int64_t num_nodes = size / bytes_per_node;
+  std::vector<std::shared_ptr<potree::node>> nodes = { chunk_root };
+  nodes.reserve(num_nodes);
+
+  for(int64_t i = 0; i < num_nodes && i < int64_t(nodes.size()); i++) {
+    auto current = nodes[i];
+    const uint8_t* record = data + i * bytes_per_node;
+
+    node_type type = static_cast<node_type>(record[0]);
+    uint8_t child_mask = record[1];
+    uint32_t num_points;
+    uint64_t byte_offset, byte_size;
+    memcpy(&num_points, record + 2, 4);
+    memcpy(&byte_offset, record + 6, 8);
+    memcpy(&byte_size, record + 14, 8);
 
     if (current->type == node_type::PROXY) {
       // replace proxy with real node
+      current->byteOffset = byte_offset;
+      current->byteSize = byte_size;
+      current->numPoints = num_points;
     } else if (type == node_type::PROXY) {
-      // load proxy node
+      // load proxy node, its subtree is stored in the hierarchy chunk at [byte_offset, byte_offset + byte_size)
+      current->proxyByteOffset = byte_offset;
+      current->proxyByteSize = byte_size;
       current->numPoints = num_points;
     } else {
       // load real node
@@ -153,20 +155,34 @@ std::shared_ptr<potree::node> node::load_hierarchy(const std::string& path, cons
     }
 
     current->type = type;
+    current->childMask = child_mask;
+
+    if (type == node_type::PROXY) {
+      proxies.push_back(current);
+      continue;
+    }
 
     for(int child_idx = 0; child_idx < 8; child_idx++) {
       bool exists = ((1 << child_idx) & child_mask) != 0;
       if (!exists) continue;
 
-      auto child = std::make_shared<node>();
+      auto box = bounding_box::child_of(current->min, current->max, child_idx);
+      auto child = std::make_shared<node>(current->name + std::to_string(child_idx), box.min, box.max);
       child->parent = current;
-      child->name = current->name + std::to_string(child_idx);
+      child->level = current->level + 1;
+      child->type = node_type::NORMAL;
       current->children[child_idx] = child;
       nodes.push_back(child);
     }
   }
+}
+
+std::shared_ptr<potree::node> node::load_hierarchy(const std::string& path, const json& metadata) {
+  // the whole hierarchy is resolved eagerly, use hierarchy_reader directly to resolve only what's needed
+  hierarchy_reader reader(path, metadata);
+  reader.resolve_all();
 
-  return root;
+  return reader.get_root();
 }
 
 std::vector<int64_t_point> node::get_points(const attributes& attrs) const {
@@ -307,7 +323,7 @@ std::vector<potree::node> node::from_pyramid_sum(const std::vector<std::vector<i
   std::vector<potree::node> stack = { root };
 
   while(!stack.empty()) {
-    auto& candidate = stack.back();
+    auto candidate = stack.back();
     stack.pop_back();
     auto& grid = pyramid[candidate.level];
     auto idx = gen_utils::morton_encode(candidate.z, candidate.y, candidate.x);
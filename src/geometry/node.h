@@ -71,6 +71,7 @@ namespace potree {
     static void sort_by_breadth(std::vector<std::shared_ptr<potree::node>>& nodes);
     static attributes parse_attributes(const json& metadata);
     static std::shared_ptr<potree::node> load_hierarchy(const std::string& path, const json& metadata);
+    static void load_hierarchy_chunk(const uint8_t* data, int64_t size, const std::shared_ptr<potree::node>& chunk_root, std::vector<std::shared_ptr<potree::node>>& proxies);
     static std::vector<potree::node> from_pyramid_sum(const std::vector<std::vector<int64_t>>& pyramid, int max_points_per_chunk);
   };
 
@@ -0,0 +1,47 @@
+#include <algorithm>
+#include <execution>
+#include "sparse_grid.h"
+
+using namespace potree;
+
+sparse_grid sparse_histogram::merge(const std::vector<const sparse_histogram*>& histograms) {
+  struct block_ref {
+    uint64_t m_block;
+    const int64_t* m_counts;
+  };
+
+  std::vector<block_ref> blocks;
+  for (auto histogram : histograms) {
+    for (const auto& [block, offset] : histogram->m_block_index) {
+      blocks.push_back({ block, histogram->m_counts.data() + offset });
+    }
+  }
+
+  std::sort(std::execution::par, blocks.begin(), blocks.end(), [](const block_ref& a, const block_ref& b) {
+    return a.m_block < b.m_block;
+  });
+
+  // sum up the same block of all threads, then emit its non-empty cells in morton order
+  sparse_grid grid;
+  int64_t sums[BLOCK_SIZE];
+
+  for (size_t i = 0; i < blocks.size();) {
+    uint64_t block = blocks[i].m_block;
+    std::fill_n(sums, BLOCK_SIZE, 0);
+
+    for (; i < blocks.size() && blocks[i].m_block == block; i++) {
+      const int64_t* counts = blocks[i].m_counts;
+      for (int64_t j = 0; j < BLOCK_SIZE; j++) {
+        sums[j] += counts[j];
+      }
+    }
+
+    for (int64_t j = 0; j < BLOCK_SIZE; j++) {
+      if (sums[j] == 0) continue;
+
+      grid.push_back({ (block << BLOCK_BITS) | uint64_t(j), sums[j] });
+    }
+  }
+
+  return grid;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+
+namespace potree {
+
+  // a non-empty cell of a sparse counting grid, addressed by the morton code of its cell coordinates
+  struct sparse_cell {
+    uint64_t m_code = 0;
+    int64_t m_count = 0;
+  };
+
+  // sparse counting grid: non-empty cells sorted by morton code
+  typedef std::vector<sparse_cell> sparse_grid;
+
+  // per-thread histogram of point counts over blocks of morton-ordered cells.
+  // only blocks that received points are allocated, so memory scales with occupied space
+  // instead of grid_size³. counts are 64 bit, a single cell may hold more than 2^31 points.
+  class sparse_histogram {
+  public:
+    // 4x4x4 cells per block
+    static const int64_t BLOCK_BITS = 6;
+    static const int64_t BLOCK_SIZE = int64_t(1) << BLOCK_BITS;
+
+    inline void add(uint64_t code) {
+      uint64_t block = code >> BLOCK_BITS;
+
+      // consecutive points are mostly spatially coherent, skip the hash lookup for repeated blocks
+      if (block != m_last_block) {
+        auto it = m_block_index.find(block);
+
+        if (it == m_block_index.end()) {
+          it = m_block_index.emplace(block, int64_t(m_counts.size())).first;
+          m_counts.resize(m_counts.size() + BLOCK_SIZE, 0);
+        }
+
+        m_last_block = block;
+        m_last_offset = it->second;
+      }
+
+      m_counts[m_last_offset + (code & (BLOCK_SIZE - 1))]++;
+    }
+
+    // merges the histograms of all threads into one sparse grid, sorted by morton code
+    static sparse_grid merge(const std::vector<const sparse_histogram*>& histograms);
+
+  private:
+    std::unordered_map<uint64_t, int64_t> m_block_index;
+    std::vector<int64_t> m_counts;
+    uint64_t m_last_block = UINT64_MAX;
+    int64_t m_last_offset = 0;
+  };
+
+}
@@ -0,0 +1,448 @@
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <numeric>
+#include <execution>
+#include <filesystem>
+#include "copc_writer.h"
+#include "geometry/hierarchy.h"
+
+using namespace potree;
+
+static const int64_t HEADER_SIZE = 375;
+static const int64_t VLR_HEADER_SIZE = 54;
+static const int64_t EVLR_HEADER_SIZE = 60;
+static const int64_t COPC_INFO_SIZE = 160;
+static const int64_t PAGE_ENTRY_SIZE = 32;
+static const uint16_t LASZIP_RECORD_ID = 22204;
+// laszip's chunk size for variable sized chunks, every node is one chunk
+static const uint32_t VARIABLE_CHUNK_SIZE = 0xFFFFFFFFu;
+
+static void check(laszip_POINTER laszip, laszip_I32 result, const std::string& action) {
+  if (result == 0) return;
+
+  laszip_CHAR* error = nullptr;
+  laszip_get_error(laszip, &error);
+  throw std::runtime_error("copc_writer: failed to " + action + ": " + (error ? std::string(error) : "unknown error"));
+}
+
+static void set_string(buffer& target, int64_t position, const std::string& value, size_t max_size) {
+  memcpy(target.data_u8 + position, value.data(), std::min(value.size(), max_size));
+}
+
+// writes a vlr header and returns the position of its payload
+static int64_t set_vlr_header(buffer& target, int64_t position, const std::string& user_id, uint16_t record_id, uint16_t size, const std::string& description) {
+  set_string(target, position + 2, user_id, 16);
+  target.set<uint16_t>(record_id, position + 18);
+  target.set<uint16_t>(size, position + 20);
+  set_string(target, position + 22, description, 32);
+
+  return position + VLR_HEADER_SIZE;
+}
+
+// copc voxel key of a potree node name. child index bits are x, y, z from high to low, see bounding_box::child_of
+static std::array<int32_t, 4> get_voxel_key(const std::string& name) {
+  std::array<int32_t, 4> key = { int32_t(name.size() - 1), 0, 0, 0 };
+
+  for (size_t i = 1; i < name.size(); i++) {
+    int index = name[i] - '0';
+    key[1] = 2 * key[1] + ((index >> 2) & 1);
+    key[2] = 2 * key[2] + ((index >> 1) & 1);
+    key[3] = 2 * key[3] + ((index >> 0) & 1);
+  }
+
+  return key;
+}
+
+void copc_writer::point_stats::merge(const point_stats& other) {
+  for (int i = 0; i < 3; i++) {
+    m_min[i] = std::min(m_min[i], other.m_min[i]);
+    m_max[i] = std::max(m_max[i], other.m_max[i]);
+  }
+
+  for (size_t i = 0; i < m_by_return.size(); i++) {
+    m_by_return[i] += other.m_by_return[i];
+  }
+
+  m_gps_time_min = std::min(m_gps_time_min, other.m_gps_time_min);
+  m_gps_time_max = std::max(m_gps_time_max, other.m_gps_time_max);
+  m_num_points += other.m_num_points;
+}
+
+copc_writer::copc_writer(const std::string& potree_path, const copc_options& opts) {
+  m_path = potree_path;
+  m_options = opts;
+
+  if (m_options.m_target_path.empty()) m_options.m_target_path = potree_path + "/octree.copc.laz";
+  if (m_options.m_batch_size <= 0) throw std::runtime_error("copc_writer: batch size must be positive");
+}
+
+void copc_writer::run() {
+  gen_utils::profiler pr("copc_writer::run()");
+
+  octree_reader reader(m_path, 0);
+  auto& hry = reader.get_hierarchy();
+  const auto& metadata = hry.get_metadata();
+
+  m_bbox = bounding_box::parse(metadata["boundingBox"]);
+  m_spacing = metadata["spacing"];
+  m_step_size = metadata["hierarchy"].value("stepSize", int(hierarchy::DEFAULT_STEP_SIZE));
+  m_attributes = reader.get_attributes();
+  // copc requires one of the las 1.4 point formats
+  m_mapping = las_point_mapping(m_attributes, true);
+  create_laszip_vlr();
+
+  hry.resolve_all();
+
+  std::vector<std::shared_ptr<node>> nodes;
+  hry.get_root()->traverse([&nodes](const std::shared_ptr<node>& n, int) {
+    nodes.push_back(n);
+  });
+  node::sort_by_breadth(nodes);
+
+  std::unordered_map<std::string, page_entry> entries;
+  std::vector<std::shared_ptr<node>> nodes_with_points;
+
+  for (const auto& n : nodes) {
+    page_entry entry;
+    auto key = get_voxel_key(n->name);
+    std::copy(key.begin(), key.end(), entry.m_key);
+    entries[n->name] = entry;
+
+    if (n->numPoints > 0 && n->byteSize > 0) nodes_with_points.push_back(n);
+  }
+
+  MINFO << "writing " << gen_utils::format_number(nodes_with_points.size()) << " nodes to " << m_options.m_target_path << std::endl;
+
+  // header and vlrs are written last, once the point statistics and the hierarchy offset are known
+  int64_t num_extra_bytes = m_mapping.get_extra_attributes().size();
+  int64_t vlrs_size = VLR_HEADER_SIZE + COPC_INFO_SIZE + int64_t(m_laszip_vlr.size());
+  if (num_extra_bytes > 0) vlrs_size += VLR_HEADER_SIZE + int64_t(m_mapping.create_extra_bytes_vlr().size());
+  int64_t offset_to_point_data = HEADER_SIZE + vlrs_size;
+
+  std::ofstream fout(m_options.m_target_path, std::ios::binary | std::ios::trunc);
+  if (!fout.good()) throw std::runtime_error("copc_writer: failed to open " + m_options.m_target_path);
+
+  // the point data starts with the offset of the chunk table
+  std::vector<char> placeholder(offset_to_point_data + 8, 0);
+  fout.write(placeholder.data(), placeholder.size());
+  int64_t position = offset_to_point_data + 8;
+
+  laz_chunk_table chunk_table;
+  point_stats stats;
+
+  // nodes are compressed in parallel in bounded batches, and appended in breadth-first order
+  for (size_t first = 0; first < nodes_with_points.size(); first += m_options.m_batch_size) {
+    size_t last = std::min(nodes_with_points.size(), first + size_t(m_options.m_batch_size));
+    std::vector<std::string> names;
+
+    for (size_t i = first; i < last; i++) {
+      names.push_back(nodes_with_points[i]->name);
+    }
+
+    auto batch = reader.read(names);
+    std::vector<std::string> chunks(batch.size());
+    std::vector<point_stats> batch_stats(batch.size());
+    std::vector<size_t> indices(batch.size());
+    std::iota(indices.begin(), indices.end(), 0);
+
+    std::for_each(std::execution::par, indices.begin(), indices.end(), [this, &batch, &chunks, &batch_stats](size_t i) {
+      if (batch[i] != nullptr) chunks[i] = compress(*batch[i], batch_stats[i]);
+    });
+
+    for (size_t i = 0; i < batch.size(); i++) {
+      if (batch[i] == nullptr) continue;
+
+      auto& entry = entries[batch[i]->m_name];
+      entry.m_offset = position;
+      entry.m_byte_size = int32_t(chunks[i].size());
+      entry.m_point_count = int32_t(batch[i]->m_num_points);
+
+      fout.write(chunks[i].data(), chunks[i].size());
+      chunk_table.add(uint32_t(batch[i]->m_num_points), uint32_t(chunks[i].size()));
+      stats.merge(batch_stats[i]);
+      position += chunks[i].size();
+    }
+  }
+
+  int64_t chunk_table_offset = position;
+  auto encoded_table = chunk_table.encode();
+  fout.write(reinterpret_cast<const char*>(encoded_table.data()), encoded_table.size());
+  position += encoded_table.size();
+
+  // hierarchy evlr
+  int64_t evlr_offset = position;
+  auto pages = create_pages(nodes, entries, evlr_offset + EVLR_HEADER_SIZE);
+  int64_t hierarchy_size = 0;
+  for (const auto& page : pages) {
+    hierarchy_size += PAGE_ENTRY_SIZE * page.size();
+  }
+
+  {
+    buffer evlr(EVLR_HEADER_SIZE + hierarchy_size);
+    memset(evlr.data, 0, evlr.size);
+    set_string(evlr, 2, "copc", 16);
+    evlr.set<uint16_t>(1000, 18);
+    evlr.set<uint64_t>(hierarchy_size, 20);
+    set_string(evlr, 28, "EPT hierarchy", 32);
+
+    int64_t offset = EVLR_HEADER_SIZE;
+    for (const auto& page : pages) {
+      for (const auto& entry : page) {
+        memcpy(evlr.data_u8 + offset, entry.m_key, 16);
+        evlr.set<int64_t>(entry.m_offset, offset + 16);
+        evlr.set<int32_t>(entry.m_byte_size, offset + 24);
+        evlr.set<int32_t>(entry.m_point_count, offset + 28);
+        offset += PAGE_ENTRY_SIZE;
+      }
+    }
+
+    fout.write(evlr.data_char, evlr.size);
+  }
+
+  page_entry root_page;
+  root_page.m_offset = evlr_offset + EVLR_HEADER_SIZE;
+  root_page.m_byte_size = int32_t(PAGE_ENTRY_SIZE * pages[0].size());
+
+  auto header = create_header(offset_to_point_data, evlr_offset, stats);
+  auto vlrs = create_vlrs(root_page, stats);
+
+  if (int64_t(header->size + vlrs->size) != offset_to_point_data) {
+    throw std::runtime_error("copc_writer: unexpected size of the las header and vlrs");
+  }
+
+  fout.seekp(0);
+  fout.write(header->data_char, header->size);
+  fout.write(vlrs->data_char, vlrs->size);
+  fout.write(reinterpret_cast<const char*>(&chunk_table_offset), 8);
+  fout.close();
+
+  if (!fout.good()) throw std::runtime_error("copc_writer: failed to write " + m_options.m_target_path);
+
+  MINFO << m_options.m_target_path << ": " << gen_utils::format_number(stats.m_num_points) << " points" << std::endl;
+}
+
+// the laszip vlr describes the compressed point items. it is the same for every chunk,
+// only the chunk size is set to variable so that each node can be a chunk of its own.
+void copc_writer::create_laszip_vlr() {
+  laszip_POINTER laszip;
+  laszip_create(&laszip);
+
+  laszip_U8* vlr = nullptr;
+  laszip_U32 vlr_size = 0;
+  int record_length = m_mapping.get_point_record_length() + m_mapping.get_extra_bytes_size();
+
+  check(laszip, laszip_set_point_type_and_size(laszip, m_mapping.get_point_format(), record_length), "set point type");
+  check(laszip, laszip_set_chunk_size(laszip, VARIABLE_CHUNK_SIZE), "set chunk size");
+  check(laszip, laszip_create_laszip_vlr(laszip, &vlr, &vlr_size), "create laszip vlr");
+
+  // header and payload of the vlr. the chunk size follows compressor, coder, version and options
+  m_laszip_vlr.assign(vlr, vlr + vlr_size);
+  free(vlr);
+  laszip_destroy(laszip);
+
+  uint16_t record_id = 0;
+  if (m_laszip_vlr.size() >= VLR_HEADER_SIZE + 16) memcpy(&record_id, m_laszip_vlr.data() + 18, 2);
+  if (record_id != LASZIP_RECORD_ID) throw std::runtime_error("copc_writer: unexpected laszip vlr");
+
+  memcpy(m_laszip_vlr.data() + VLR_HEADER_SIZE + 12, &VARIABLE_CHUNK_SIZE, 4);
+}
+
+// compresses the node into a single laz chunk. laszip writes the point data of a laz file to the stream,
+// the 8 byte chunk table offset, the chunk and a chunk table of one entry. only the chunk itself is kept.
+std::string copc_writer::compress(const node_data& data, point_stats& stats) const {
+  laszip_POINTER laszip;
+  laszip_point* point;
+  std::ostringstream stream(std::ios::binary);
+
+  laszip_create(&laszip);
+  int record_length = m_mapping.get_point_record_length() + m_mapping.get_extra_bytes_size();
+
+  check(laszip, laszip_set_point_type_and_size(laszip, m_mapping.get_point_format(), record_length), "set point type");
+  check(laszip, laszip_set_chunk_size(laszip, VARIABLE_CHUNK_SIZE), "set chunk size");
+  check(laszip, laszip_open_writer_stream(laszip, stream, 1, 1), "compress node " + data.m_name);
+  laszip_get_point_pointer(laszip, &point);
+  point->extended_point_type = 1;
+
+  for (int64_t i = 0; i < data.m_num_points; i++) {
+    m_mapping.set_point(data, i, point);
+    check(laszip, laszip_write_point(laszip), "compress node " + data.m_name);
+  }
+
+  check(laszip, laszip_close_writer(laszip), "compress node " + data.m_name);
+  laszip_destroy(laszip);
+
+  std::string bytes = stream.str();
+  int64_t chunk_table_offset = 0;
+  if (bytes.size() >= 8) memcpy(&chunk_table_offset, bytes.data(), 8);
+
+  if (chunk_table_offset < 8 || chunk_table_offset > int64_t(bytes.size())) {
+    throw std::runtime_error("copc_writer: unexpected laszip output for node " + data.m_name);
+  }
+
+  // statistics for the las header and the copc info vlr
+  const int32_t* positions = reinterpret_cast<const int32_t*>(data.m_columns[m_mapping.get_column("position")]->data_u8);
+  int column_return_number = m_mapping.get_column("return number");
+  int column_gps_time = m_mapping.get_column("gps-time");
+
+  for (int64_t i = 0; i < data.m_num_points; i++) {
+    for (int j = 0; j < 3; j++) {
+      stats.m_min[j] = std::min(stats.m_min[j], positions[3 * i + j]);
+      stats.m_max[j] = std::max(stats.m_max[j], positions[3 * i + j]);
+    }
+
+    if (column_return_number >= 0) {
+      uint8_t return_number = data.m_columns[column_return_number]->data_u8[i] & 0b1111;
+      if (return_number >= 1) stats.m_by_return[return_number - 1]++;
+    }
+
+    if (column_gps_time >= 0) {
+      double gps_time;
+      memcpy(&gps_time, data.m_columns[column_gps_time]->data_u8 + 8 * i, 8);
+      stats.m_gps_time_min = std::min(stats.m_gps_time_min, gps_time);
+      stats.m_gps_time_max = std::max(stats.m_gps_time_max, gps_time);
+    }
+  }
+
+  stats.m_num_points += data.m_num_points;
+
+  return bytes.substr(8, chunk_table_offset - 8);
+}
+
+// one page per potree hierarchy chunk, i.e. per <step size> levels. pages are laid out in breadth-first order
+// of their roots, starting with the root page. a page references its child pages, the entry of a child page's
+// root node is stored in the child page.
+std::vector<std::vector<copc_writer::page_entry>> copc_writer::create_pages(
+  const std::vector<std::shared_ptr<node>>& nodes, const std::unordered_map<std::string, page_entry>& entries, int64_t first_page_offset
+) const {
+  std::vector<std::string> page_roots;
+  std::unordered_map<std::string, size_t> page_index;
+
+  for (const auto& n : nodes) {
+    if (n->get_level() % m_step_size != 0) continue;
+
+    page_index[n->name] = page_roots.size();
+    page_roots.push_back(n->name);
+  }
+
+  std::vector<std::vector<page_entry>> pages(page_roots.size());
+  std::vector<int64_t> num_references(page_roots.size(), 0);
+
+  for (const auto& n : nodes) {
+    int64_t level = n->get_level();
+    int64_t page_level = (level / m_step_size) * m_step_size;
+    pages[page_index[n->name.substr(0, page_level + 1)]].push_back(entries.at(n->name));
+
+    if (level > 0 && level == page_level) {
+      num_references[page_index[n->name.substr(0, level - m_step_size + 1)]]++;
+    }
+  }
+
+  std::vector<int64_t> page_offsets(pages.size());
+  int64_t offset = first_page_offset;
+
+  for (size_t i = 0; i < pages.size(); i++) {
+    page_offsets[i] = offset;
+    offset += PAGE_ENTRY_SIZE * (pages[i].size() + num_references[i]);
+  }
+
+  for (size_t i = 1; i < pages.size(); i++) {
+    const auto& root = page_roots[i];
+    int64_t level = root.size() - 1;
+
+    page_entry reference = entries.at(root);
+    reference.m_offset = page_offsets[i];
+    reference.m_byte_size = int32_t(PAGE_ENTRY_SIZE * pages[i].size() + PAGE_ENTRY_SIZE * num_references[i]);
+    reference.m_point_count = -1;
+
+    pages[page_index[root.substr(0, level - m_step_size + 1)]].push_back(reference);
+  }
+
+  return pages;
+}
+
+std::shared_ptr<buffer> copc_writer::create_header(int64_t offset_to_point_data, int64_t evlr_offset, const point_stats& stats) const {
+  auto header = std::make_shared<buffer>(HEADER_SIZE);
+  memset(header->data, 0, header->size);
+
+  std::time_t now = std::time(nullptr);
+  std::tm* date = std::gmtime(&now);
+  const auto& scale = m_attributes.m_pos_scale;
+  const auto& offset = m_attributes.m_pos_offset;
+  int num_vlrs = m_mapping.get_extra_attributes().empty() ? 2 : 3;
+  bool empty = stats.m_num_points == 0;
+
+  set_string(*header, 0, "LASF", 4);
+  // the crs of point formats 6 and up is always wkt
+  header->set<uint16_t>(1 << 4, 6);
+  header->set<uint8_t>(1, 24);
+  header->set<uint8_t>(4, 25);
+  set_string(*header, 58, "potree-converter-cpp", 32);
+  header->set<uint16_t>(uint16_t(date->tm_yday + 1), 90);
+  header->set<uint16_t>(uint16_t(date->tm_year + 1900), 92);
+  header->set<uint16_t>(uint16_t(HEADER_SIZE), 94);
+  header->set<uint32_t>(uint32_t(offset_to_point_data), 96);
+  header->set<uint32_t>(uint32_t(num_vlrs), 100);
+  // bit 7 flags compressed point data
+  header->set<uint8_t>(uint8_t(m_mapping.get_point_format() | 0x80), 104);
+  header->set<uint16_t>(uint16_t(m_mapping.get_point_record_length() + m_mapping.get_extra_bytes_size()), 105);
+
+  header->set<double>(scale.x, 131);
+  header->set<double>(scale.y, 139);
+  header->set<double>(scale.z, 147);
+  header->set<double>(offset.x, 155);
+  header->set<double>(offset.y, 163);
+  header->set<double>(offset.z, 171);
+  header->set<double>(empty ? 0.0 : stats.m_max[0] * scale.x + offset.x, 179);
+  header->set<double>(empty ? 0.0 : stats.m_min[0] * scale.x + offset.x, 187);
+  header->set<double>(empty ? 0.0 : stats.m_max[1] * scale.y + offset.y, 195);
+  header->set<double>(empty ? 0.0 : stats.m_min[1] * scale.y + offset.y, 203);
+  header->set<double>(empty ? 0.0 : stats.m_max[2] * scale.z + offset.z, 211);
+  header->set<double>(empty ? 0.0 : stats.m_min[2] * scale.z + offset.z, 219);
+
+  header->set<uint64_t>(uint64_t(evlr_offset), 235);
+  header->set<uint32_t>(1, 243);
+  header->set<uint64_t>(stats.m_num_points, 247);
+
+  for (size_t i = 0; i < stats.m_by_return.size(); i++) {
+    header->set<uint64_t>(stats.m_by_return[i], 255 + 8 * i);
+  }
+
+  return header;
+}
+
+std::shared_ptr<buffer> copc_writer::create_vlrs(const page_entry& root_page, const point_stats& stats) const {
+  auto extra_bytes = m_mapping.create_extra_bytes_vlr();
+
+  int64_t size = VLR_HEADER_SIZE + COPC_INFO_SIZE + m_laszip_vlr.size();
+  if (!extra_bytes.empty()) size += VLR_HEADER_SIZE + extra_bytes.size();
+
+  auto vlrs = std::make_shared<buffer>(size);
+  memset(vlrs->data, 0, vlrs->size);
+
+  // the copc info vlr has to be the first vlr
+  int64_t info = set_vlr_header(*vlrs, 0, "copc", 1, uint16_t(COPC_INFO_SIZE), "copc info");
+  double halfsize = (m_bbox.max - m_bbox.min).max() / 2.0;
+  bool has_gps_time = stats.m_gps_time_min <= stats.m_gps_time_max;
+
+  vlrs->set<double>(m_bbox.min.x + halfsize, info + 0);
+  vlrs->set<double>(m_bbox.min.y + halfsize, info + 8);
+  vlrs->set<double>(m_bbox.min.z + halfsize, info + 16);
+  vlrs->set<double>(halfsize, info + 24);
+  vlrs->set<double>(m_spacing, info + 32);
+  vlrs->set<uint64_t>(uint64_t(root_page.m_offset), info + 40);
+  vlrs->set<uint64_t>(uint64_t(root_page.m_byte_size), info + 48);
+  vlrs->set<double>(has_gps_time ? stats.m_gps_time_min : 0.0, info + 56);
+  vlrs->set<double>(has_gps_time ? stats.m_gps_time_max : 0.0, info + 64);
+
+  int64_t position = info + COPC_INFO_SIZE;
+  memcpy(vlrs->data_u8 + position, m_laszip_vlr.data(), m_laszip_vlr.size());
+  position += m_laszip_vlr.size();
+
+  if (!extra_bytes.empty()) {
+    int64_t payload = set_vlr_header(*vlrs, position, "LASF_Spec", 4, uint16_t(extra_bytes.size()), "extra bytes");
+    memcpy(vlrs->data_u8 + payload, extra_bytes.data(), extra_bytes.size());
+  }
+
+  return vlrs;
+}
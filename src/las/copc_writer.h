@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <array>
+#include "laszip/laszip_api.h"
+#include "geometry/node.h"
+#include "geometry/bounding_box.h"
+#include "reader/octree_reader.h"
+#include "las_point_mapping.h"
+#include "laz_chunk_table.h"
+
+namespace potree {
+
+  struct copc_options {
+    std::string m_target_path = ""; // defaults to <potree directory>/octree.copc.laz
+    int64_t m_batch_size = 256; // nodes that are compressed in parallel before they are written
+  };
+
+  // writes a converted potree octree as a single cloud optimized point cloud (copc) file.
+  // every node becomes one laz chunk that is compressed on its own, so readers can fetch and decode any node
+  // with one range request. the hierarchy is written to a copc hierarchy evlr with one page per potree hierarchy chunk.
+  class copc_writer {
+  public:
+    copc_writer(const std::string& potree_path, const copc_options& opts);
+
+    void run();
+
+  private:
+    // an entry of a copc hierarchy page. point count -1 references a child page.
+    struct page_entry {
+      int32_t m_key[4] = { 0, 0, 0, 0 }; // level, x, y, z
+      int64_t m_offset = 0;
+      int32_t m_byte_size = 0;
+      int32_t m_point_count = 0;
+    };
+
+    // point statistics of the written nodes, for the las header and the copc info vlr
+    struct point_stats {
+      std::array<int32_t, 3> m_min = { INT32_MAX, INT32_MAX, INT32_MAX };
+      std::array<int32_t, 3> m_max = { INT32_MIN, INT32_MIN, INT32_MIN };
+      std::array<uint64_t, 15> m_by_return = {};
+      double m_gps_time_min = gen_utils::INF;
+      double m_gps_time_max = -gen_utils::INF;
+      uint64_t m_num_points = 0;
+
+      void merge(const point_stats& other);
+    };
+
+    std::string m_path;
+    copc_options m_options;
+    attributes m_attributes;
+    bounding_box m_bbox;
+    double m_spacing = 0.0;
+    int m_step_size = 0;
+    las_point_mapping m_mapping;
+    std::vector<uint8_t> m_laszip_vlr;
+
+    void create_laszip_vlr();
+    std::string compress(const node_data& data, point_stats& stats) const;
+    std::vector<std::vector<page_entry>> create_pages(const std::vector<std::shared_ptr<node>>& nodes, const std::unordered_map<std::string, page_entry>& entries, int64_t first_page_offset) const;
+    std::shared_ptr<buffer> create_header(int64_t offset_to_point_data, int64_t evlr_offset, const point_stats& stats) const;
+    std::shared_ptr<buffer> create_vlrs(const page_entry& root_page, const point_stats& stats) const;
+  };
+
+}
@@ -0,0 +1,250 @@
+#include <fstream>
+#include <filesystem>
+#include <execution>
+#include <mutex>
+#include <atomic>
+#include "las_catalog.h"
+#include "utils/file_utils.h"
+#include "utils/string_utils.h"
+#include "utils/gen_utils.h"
+
+using namespace potree;
+
+static const int CATALOG_VERSION = 1;
+static const uint16_t LASZIP_VLR_RECORD_ID = 22204;
+
+static int64_t get_mtime(const std::string& path) {
+  return int64_t(std::filesystem::last_write_time(path).time_since_epoch().count());
+}
+
+// reads the laszip chunk size from the raw vlrs, and the location and number of chunks from the chunk table header.
+// the chunk table itself stays compressed, laszip decodes it on open.
+static void read_laz_chunk_info(const std::string& path, uint64_t filesize, las_catalog_entry& entry) {
+  auto header = file_utils::read_binary(path, 0, 104);
+  if (header.size() < 104) return;
+
+  uint16_t header_size = gen_utils::read_value<uint16_t>(header, 94);
+  uint32_t offset_to_point_data = gen_utils::read_value<uint32_t>(header, 96);
+  uint32_t num_vlrs = gen_utils::read_value<uint32_t>(header, 100);
+
+  if (offset_to_point_data <= header_size) return;
+
+  auto vlrs = file_utils::read_binary(path, header_size, offset_to_point_data - header_size);
+  int64_t offset = 0;
+
+  for (uint32_t i = 0; i < num_vlrs && offset + 54 <= int64_t(vlrs.size()); i++) {
+    uint16_t record_id = gen_utils::read_value<uint16_t>(vlrs, offset + 18);
+    uint16_t record_length = gen_utils::read_value<uint16_t>(vlrs, offset + 20);
+
+    // compressor, coder, version major/minor, revision and options precede the chunk size
+    if (record_id == LASZIP_VLR_RECORD_ID && record_length >= 16 && offset + 54 + 16 <= int64_t(vlrs.size())) {
+      entry.m_laz_chunk_size = gen_utils::read_value<uint32_t>(vlrs, offset + 54 + 12);
+    }
+
+    offset += 54 + record_length;
+  }
+
+  auto pointer = file_utils::read_binary(path, offset_to_point_data, 8);
+  if (pointer.size() < 8) return;
+
+  int64_t table_offset = gen_utils::read_value<int64_t>(pointer, 0);
+
+  // writers that couldn't seek back store the chunk table offset at the end of the file
+  if (table_offset == -1 && filesize >= 8) {
+    auto tail = file_utils::read_binary(path, filesize - 8, 8);
+    table_offset = gen_utils::read_value<int64_t>(tail, 0);
+  }
+
+  if (table_offset <= int64_t(offset_to_point_data) || uint64_t(table_offset) + 8 > filesize) return;
+
+  auto table = file_utils::read_binary(path, table_offset, 8);
+  entry.m_laz_chunk_table_offset = table_offset;
+  entry.m_laz_num_chunks = gen_utils::read_value<uint32_t>(table, 4);
+}
+
+static json entry_to_json(const las_catalog_entry& entry) {
+  const auto& header = entry.m_header;
+  json js;
+
+  js["path"] = entry.m_path;
+  js["filesize"] = entry.m_filesize;
+  js["mtime"] = entry.m_mtime;
+  js["min"] = { header.min.x, header.min.y, header.min.z };
+  js["max"] = { header.max.x, header.max.y, header.max.z };
+  js["scale"] = { header.scale.x, header.scale.y, header.scale.z };
+  js["offset"] = { header.offset.x, header.offset.y, header.offset.z };
+  js["numPoints"] = header.numPoints;
+  js["pointDataFormat"] = header.pointDataFormat;
+  js["pointDataRecordLength"] = header.pointDataRecordLength;
+  js["offsetToPointData"] = header.offsetToPointData;
+  js["lazChunkSize"] = entry.m_laz_chunk_size;
+  js["lazChunkTableOffset"] = entry.m_laz_chunk_table_offset;
+  js["lazNumChunks"] = entry.m_laz_num_chunks;
+
+  js["vlrs"] = json::array();
+  for (const auto& vlr : header.vlrs) {
+    json js_vlr;
+    js_vlr["userId"] = std::string(vlr.user_id, strnlen(vlr.user_id, 16));
+    js_vlr["recordId"] = vlr.record_id;
+    js_vlr["description"] = std::string(vlr.descriptions, strnlen(vlr.descriptions, 32));
+    js_vlr["data"] = json::binary(vlr.data);
+    js["vlrs"].push_back(js_vlr);
+  }
+
+  return js;
+}
+
+static las_catalog_entry entry_from_json(const json& js) {
+  las_catalog_entry entry;
+  auto& header = entry.m_header;
+
+  entry.m_path = js["path"];
+  entry.m_filesize = js["filesize"];
+  entry.m_mtime = js["mtime"];
+  header.min = { js["min"][0].get<double>(), js["min"][1].get<double>(), js["min"][2].get<double>() };
+  header.max = { js["max"][0].get<double>(), js["max"][1].get<double>(), js["max"][2].get<double>() };
+  header.scale = { js["scale"][0].get<double>(), js["scale"][1].get<double>(), js["scale"][2].get<double>() };
+  header.offset = { js["offset"][0].get<double>(), js["offset"][1].get<double>(), js["offset"][2].get<double>() };
+  header.numPoints = js["numPoints"];
+  header.pointDataFormat = js["pointDataFormat"];
+  header.pointDataRecordLength = js["pointDataRecordLength"];
+  header.offsetToPointData = js["offsetToPointData"];
+  entry.m_laz_chunk_size = js["lazChunkSize"];
+  entry.m_laz_chunk_table_offset = js["lazChunkTableOffset"];
+  entry.m_laz_num_chunks = js["lazNumChunks"];
+
+  for (const auto& js_vlr : js["vlrs"]) {
+    las_vlr vlr;
+    std::string user_id = js_vlr["userId"];
+    std::string description = js_vlr["description"];
+
+    memset(vlr.user_id, 0, 16);
+    memset(vlr.descriptions, 0, 32);
+    memcpy(vlr.user_id, user_id.data(), std::min(user_id.size(), size_t(16)));
+    memcpy(vlr.descriptions, description.data(), std::min(description.size(), size_t(32)));
+
+    vlr.record_id = js_vlr["recordId"];
+    vlr.data = js_vlr["data"].get_binary();
+    vlr.record_length_after_header = uint16_t(vlr.data.size());
+
+    header.vlrs.push_back(vlr);
+  }
+
+  return entry;
+}
+
+las_catalog& las_catalog::instance() {
+  static las_catalog catalog;
+  return catalog;
+}
+
+void las_catalog::load(const std::string& path) {
+  gen_utils::profiler pr("las_catalog::load()");
+  if (!std::filesystem::exists(path)) return;
+
+  std::ifstream file(path, std::ios::binary);
+  std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+  json js = json::from_cbor(data, true, false);
+
+  if (js.is_discarded() || js.value("version", 0) != CATALOG_VERSION) {
+    MWARNING << "ignoring incompatible source catalog: " << path << std::endl;
+    return;
+  }
+
+  for (const auto& js_entry : js["entries"]) {
+    insert(entry_from_json(js_entry));
+  }
+
+  MINFO << "source catalog: " << gen_utils::format_number(size()) << " entries loaded from " << path << std::endl;
+}
+
+void las_catalog::save(const std::string& path) const {
+  gen_utils::profiler pr("las_catalog::save()");
+  json js;
+  js["version"] = CATALOG_VERSION;
+  js["entries"] = json::array();
+
+  {
+    std::shared_lock<std::shared_mutex> lock(m_mtx);
+    for (const auto& [key, entry] : m_entries) {
+      js["entries"].push_back(entry_to_json(entry));
+    }
+  }
+
+  // write to a temporary file first, an interrupted save must not destroy a valid catalog
+  std::string tmp_path = path + ".tmp";
+  auto data = json::to_cbor(js);
+  {
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(data.data()), data.size());
+  }
+
+  std::filesystem::rename(tmp_path, path);
+}
+
+void las_catalog::update(const std::vector<std::string>& paths) {
+  gen_utils::profiler pr("las_catalog::update()");
+  std::atomic_int64_t num_loaded = 0;
+
+  std::for_each(std::execution::par, paths.begin(), paths.end(), [this, &num_loaded](const std::string& path) {
+    uint64_t filesize = std::filesystem::file_size(path);
+    int64_t mtime = get_mtime(path);
+    las_catalog_entry entry;
+
+    if (find(path, filesize, mtime, entry)) return;
+
+    insert(read_entry(path, filesize, mtime));
+    num_loaded++;
+  });
+
+  MINFO << "source catalog: " << gen_utils::format_number(paths.size() - num_loaded) << " cached, "
+    << gen_utils::format_number(int64_t(num_loaded)) << " loaded" << std::endl;
+}
+
+las_catalog_entry las_catalog::get(const std::string& path) {
+  uint64_t filesize = std::filesystem::file_size(path);
+  int64_t mtime = get_mtime(path);
+  las_catalog_entry entry;
+
+  if (find(path, filesize, mtime, entry)) return entry;
+
+  entry = read_entry(path, filesize, mtime);
+  insert(entry);
+
+  return entry;
+}
+
+size_t las_catalog::size() const {
+  std::shared_lock<std::shared_mutex> lock(m_mtx);
+  return m_entries.size();
+}
+
+bool las_catalog::find(const std::string& path, uint64_t filesize, int64_t mtime, las_catalog_entry& entry) const {
+  std::shared_lock<std::shared_mutex> lock(m_mtx);
+  auto it = m_entries.find(path);
+
+  if (it == m_entries.end() || !it->second.is_current(filesize, mtime)) return false;
+
+  entry = it->second;
+  return true;
+}
+
+void las_catalog::insert(const las_catalog_entry& entry) {
+  std::unique_lock<std::shared_mutex> lock(m_mtx);
+  m_entries[entry.m_path] = entry;
+}
+
+las_catalog_entry las_catalog::read_entry(const std::string& path, uint64_t filesize, int64_t mtime) {
+  las_catalog_entry entry;
+  entry.m_path = path;
+  entry.m_filesize = filesize;
+  entry.m_mtime = mtime;
+  entry.m_header = las_header::read(path);
+
+  if (string_utils::iends_with(path, ".laz")) {
+    read_laz_chunk_info(path, filesize, entry);
+  }
+
+  return entry;
+}
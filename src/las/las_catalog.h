@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <shared_mutex>
+#include "las_header.h"
+
+namespace potree {
+
+  struct las_catalog_entry {
+    std::string m_path;
+    uint64_t m_filesize = 0;
+    int64_t m_mtime = 0;
+    las_header m_header;
+
+    // laszip chunking of .laz files, taken from the laszip vlr and the chunk table header.
+    // a chunk size of 0xFFFFFFFF means variable sized chunks.
+    uint32_t m_laz_chunk_size = 0;
+    int64_t m_laz_chunk_table_offset = -1;
+    uint32_t m_laz_num_chunks = 0;
+
+    bool is_current(uint64_t filesize, int64_t mtime) const { return m_filesize == filesize && m_mtime == mtime; }
+  };
+
+  // process-wide cache of parsed las/laz headers, keyed by path and validated by file size and modification time.
+  // entries can be persisted to a file, so that later conversions of the same inputs don't open them again.
+  class las_catalog {
+  public:
+    static las_catalog& instance();
+
+    void load(const std::string& path);
+    void save(const std::string& path) const;
+
+    // loads all new or changed files in parallel
+    void update(const std::vector<std::string>& paths);
+    las_catalog_entry get(const std::string& path);
+    size_t size() const;
+
+  private:
+    mutable std::shared_mutex m_mtx;
+    std::unordered_map<std::string, las_catalog_entry> m_entries;
+
+    bool find(const std::string& path, uint64_t filesize, int64_t mtime, las_catalog_entry& entry) const;
+    void insert(const las_catalog_entry& entry);
+
+    static las_catalog_entry read_entry(const std::string& path, uint64_t filesize, int64_t mtime);
+  };
+
+}
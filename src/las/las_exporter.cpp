@@ -0,0 +1,203 @@
+#include <filesystem>
+#include <execution>
+#include "las_exporter.h"
+#include "utils/file_utils.h"
+
+using namespace potree;
+
+las_exporter::las_exporter(const std::string& potree_path, const las_export_options& opts) {
+  m_path = potree_path;
+  m_options = opts;
+
+  if (m_options.m_target_dir.empty()) m_options.m_target_dir = potree_path;
+  if (m_options.m_batch_size <= 0) throw std::runtime_error("las_exporter: batch size must be positive");
+  if (m_options.m_mode != "LEVELS" && m_options.m_mode != "TILES") throw std::runtime_error("las_exporter: invalid mode " + m_options.m_mode);
+}
+
+las_exporter::~las_exporter() {
+  for (auto& [name, out] : m_outputs) {
+    close(*out);
+  }
+}
+
+void las_exporter::run() {
+  gen_utils::profiler pr("las_exporter::run()");
+
+  // every node is read exactly once, caching decoded nodes would only cost memory
+  octree_reader reader(m_path, 0);
+  m_bbox = bounding_box::parse(reader.get_hierarchy().get_metadata()["boundingBox"]);
+  m_attributes = reader.get_attributes();
+  m_mapping = las_point_mapping(m_attributes);
+
+  auto nodes = select_nodes(reader.get_hierarchy());
+
+  MINFO << "exporting " << gen_utils::format_number(nodes.size()) << " nodes to " << m_options.m_target_dir << std::endl;
+  std::filesystem::create_directories(m_options.m_target_dir);
+
+  // bounded batches: at most one batch of decoded nodes is in memory at any time
+  for (size_t first = 0; first < nodes.size(); first += m_options.m_batch_size) {
+    size_t last = std::min(nodes.size(), first + size_t(m_options.m_batch_size));
+    std::vector<std::string> names;
+
+    for (size_t i = first; i < last; i++) {
+      names.push_back(nodes[i]->name);
+    }
+
+    auto batch = reader.read(names);
+
+    std::for_each(std::execution::par, batch.begin(), batch.end(), [this](const std::shared_ptr<const node_data>& data) {
+      auto& out = get_output(get_output_name(data->m_name));
+      write(out, *data);
+    });
+  }
+
+  for (auto& [name, out] : m_outputs) {
+    close(*out);
+    MINFO << out->m_path << ": " << gen_utils::format_number(out->m_num_points) << " points" << std::endl;
+  }
+}
+
+std::vector<std::shared_ptr<node>> las_exporter::select_nodes(hierarchy_reader& hierarchy) const {
+  std::vector<std::shared_ptr<node>> selected;
+  std::vector<std::shared_ptr<node>> stack = { hierarchy.get_root() };
+  const auto& box_min = m_options.m_box_min;
+  const auto& box_max = m_options.m_box_max;
+
+  while (!stack.empty()) {
+    auto current = stack.back();
+    stack.pop_back();
+
+    int level = current->get_level();
+    if (m_options.m_max_level >= 0 && level > m_options.m_max_level) continue;
+    bool intersects = current->min.x <= box_max.x && current->max.x >= box_min.x
+      && current->min.y <= box_max.y && current->max.y >= box_min.y
+      && current->min.z <= box_max.z && current->max.z >= box_min.z;
+    if (!intersects) continue;
+
+    // hierarchy chunks below the selected levels and outside of the box are never loaded
+    hierarchy.resolve(current);
+
+    if (level >= m_options.m_min_level && current->numPoints > 0 && current->byteSize > 0) {
+      selected.push_back(current);
+    }
+
+    for (const auto& child : current->children) {
+      if (child != nullptr) stack.push_back(child);
+    }
+  }
+
+  node::sort_by_breadth(selected);
+
+  return selected;
+}
+
+std::string las_exporter::get_output_name(const std::string& node_name) const {
+  if (m_options.m_mode == "TILES") {
+    size_t length = std::min(node_name.size(), size_t(m_options.m_tile_level) + 1);
+    return "tile_" + node_name.substr(0, length);
+  }
+
+  // "r" is level 0
+  return "level_" + std::to_string(node_name.size() - 1);
+}
+
+las_exporter::output& las_exporter::get_output(const std::string& name) {
+  std::lock_guard<std::mutex> lock(m_outputs_mtx);
+  auto& out = m_outputs[name];
+
+  if (out == nullptr) {
+    out = std::make_unique<output>();
+    out->m_path = m_options.m_target_dir + "/" + name + ".laz";
+  }
+
+  return *out;
+}
+
+void las_exporter::open(output& out) {
+  laszip_header* header;
+
+  laszip_create(&out.m_writer);
+  laszip_get_header_pointer(out.m_writer, &header);
+
+  bool extended = m_mapping.is_extended();
+  header->version_major = 1;
+  header->version_minor = extended ? 4 : 2;
+  header->header_size = extended ? 375 : 227;
+  header->offset_to_point_data = header->header_size;
+  header->point_data_format = m_mapping.get_point_format();
+  header->point_data_record_length = m_mapping.get_point_record_length();
+  header->x_scale_factor = m_attributes.m_pos_scale.x;
+  header->y_scale_factor = m_attributes.m_pos_scale.y;
+  header->z_scale_factor = m_attributes.m_pos_scale.z;
+  header->x_offset = m_attributes.m_pos_offset.x;
+  header->y_offset = m_attributes.m_pos_offset.y;
+  header->z_offset = m_attributes.m_pos_offset.z;
+  header->min_x = m_bbox.min.x;
+  header->min_y = m_bbox.min.y;
+  header->min_z = m_bbox.min.z;
+  header->max_x = m_bbox.max.x;
+  header->max_y = m_bbox.max.y;
+  header->max_z = m_bbox.max.z;
+
+  for (const auto& attr : m_mapping.get_extra_attributes()) {
+    laszip_add_attribute(out.m_writer, las_point_mapping::get_extra_bytes_type(attr.type), attr.name.c_str(), attr.description.c_str(), attr.scale.x, attr.offset.x);
+  }
+
+  if (extended) {
+    laszip_request_native_extension(out.m_writer, 1);
+  }
+
+  // point counts and bounds are left to laszip's inventory, see laszip_update_inventory()
+  if (laszip_open_writer(out.m_writer, out.m_path.c_str(), 1)) {
+    laszip_CHAR* error;
+    laszip_get_error(out.m_writer, &error);
+    throw std::runtime_error("failed to open " + out.m_path + ": " + std::string(error));
+  }
+
+  laszip_get_point_pointer(out.m_writer, &out.m_point);
+
+  if (extended) {
+    out.m_point->extended_point_type = 1;
+  }
+}
+
+void las_exporter::close(output& out) {
+  std::lock_guard<std::mutex> lock(out.m_mtx);
+  if (out.m_writer == nullptr) return;
+
+  laszip_close_writer(out.m_writer);
+  laszip_destroy(out.m_writer);
+  out.m_writer = nullptr;
+  out.m_point = nullptr;
+}
+
+void las_exporter::write(output& out, const node_data& data) {
+  std::lock_guard<std::mutex> lock(out.m_mtx);
+  if (out.m_writer == nullptr) open(out);
+
+  bool filter = m_options.has_box();
+  const auto& scale = m_attributes.m_pos_scale;
+  const auto& offset = m_attributes.m_pos_offset;
+  const int32_t* positions = reinterpret_cast<const int32_t*>(data.m_columns[m_mapping.get_column("position")]->data_u8);
+
+  for (int64_t i = 0; i < data.m_num_points; i++) {
+    if (filter) {
+      const int32_t* XYZ = positions + 3 * i;
+
+      double x = double(XYZ[0]) * scale.x + offset.x;
+      double y = double(XYZ[1]) * scale.y + offset.y;
+      double z = double(XYZ[2]) * scale.z + offset.z;
+
+      bool inside = x >= m_options.m_box_min.x && x <= m_options.m_box_max.x
+        && y >= m_options.m_box_min.y && y <= m_options.m_box_max.y
+        && z >= m_options.m_box_min.z && z <= m_options.m_box_max.z;
+
+      if (!inside) continue;
+    }
+
+    m_mapping.set_point(data, i, out.m_point);
+    laszip_write_point(out.m_writer);
+    laszip_update_inventory(out.m_writer);
+    out.m_num_points++;
+  }
+}
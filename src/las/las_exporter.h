@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string>
+#include <mutex>
+#include <memory>
+#include <unordered_map>
+#include "laszip/laszip_api.h"
+#include "geometry/node.h"
+#include "reader/octree_reader.h"
+#include "geometry/attributes.h"
+#include "las_point_mapping.h"
+
+namespace potree {
+
+  struct las_export_options {
+    std::string m_target_dir = ""; // defaults to the potree directory
+    std::string m_mode = "LEVELS"; // "TILES"
+    int m_min_level = 0;
+    int m_max_level = -1; // all levels
+    int m_tile_level = 2; // TILES: nodes are grouped into files by their ancestor at this level
+    vector3 m_box_min = { -gen_utils::INF, -gen_utils::INF, -gen_utils::INF };
+    vector3 m_box_max = { gen_utils::INF, gen_utils::INF, gen_utils::INF };
+    int64_t m_batch_size = 256; // nodes that are decoded before the next batch starts
+
+    bool has_box() const {
+      return m_box_min.x > -gen_utils::INF || m_box_min.y > -gen_utils::INF || m_box_min.z > -gen_utils::INF
+        || m_box_max.x < gen_utils::INF || m_box_max.y < gen_utils::INF || m_box_max.z < gen_utils::INF;
+    }
+  };
+
+  // exports a potree octree to laz files, one per level or one per tile.
+  // nodes are decoded in parallel in bounded batches and written straight to their output,
+  // only the points of the nodes in flight are kept in memory.
+  class las_exporter {
+  public:
+    las_exporter(const std::string& potree_path, const las_export_options& opts);
+    ~las_exporter();
+
+    void run();
+
+  private:
+    struct output {
+      std::mutex m_mtx;
+      std::string m_path;
+      laszip_POINTER m_writer = nullptr;
+      laszip_point* m_point = nullptr;
+      int64_t m_num_points = 0;
+    };
+
+    std::string m_path;
+    las_export_options m_options;
+    attributes m_attributes;
+    bounding_box m_bbox;
+    las_point_mapping m_mapping;
+    std::mutex m_outputs_mtx;
+    std::unordered_map<std::string, std::unique_ptr<output>> m_outputs;
+
+    std::vector<std::shared_ptr<node>> select_nodes(hierarchy_reader& hierarchy) const;
+    std::string get_output_name(const std::string& node_name) const;
+    output& get_output(const std::string& name);
+    void open(output& out);
+    void close(output& out);
+    void write(output& out, const node_data& data);
+  };
+
+}
@@ -1,20 +1,18 @@
 #include "las_header.h"
+#include "las_catalog.h"
+#include "las_reader_pool.h"
 #include "utils/string_utils.h"
 #include "laszip/laszip_api.h"
 
 using namespace potree;
 
 las_header las_header::load(const std::string& path) {
-	laszip_POINTER laszip_reader;
-	laszip_header* header;
-	laszip_point* point;
-	laszip_BOOL request_reader = 1;
-	laszip_BOOL is_compressed = string_utils::iends_with(path, ".laz") ? 1 : 0;
+	return las_catalog::instance().get(path).m_header;
+}
 
-	laszip_create(&laszip_reader);
-	laszip_request_compatibility_mode(laszip_reader, request_reader);
-	laszip_open_reader(laszip_reader, path.c_str(), &is_compressed);
-	laszip_get_header_pointer(laszip_reader, &header);
+las_header las_header::read(const std::string& path) {
+	// the reader stays open for the tasks that read the points of this file next
+	laszip_header* header = las_reader_pool::acquire(path).m_header;
 
 	las_header result;
 
@@ -37,12 +35,16 @@ las_header las_header::load(const std::string& path) {
 	result.numPoints = std::max(header->extended_number_of_point_records, uint64_t(header->number_of_point_records));
 
 	result.pointDataFormat = header->point_data_format;
+	result.pointDataRecordLength = header->point_data_record_length;
+	result.offsetToPointData = header->offset_to_point_data;
 
 	int numVlrs = header->number_of_variable_length_records;
 	for (int i = 0; i < numVlrs; i++) {
 		auto laszip_vlr = header->vlrs[i];
 		las_vlr vlr;
 
+		memcpy(vlr.user_id, laszip_vlr.user_id, 16);
+		memcpy(vlr.descriptions, laszip_vlr.description, 32);
 		vlr.record_id = laszip_vlr.record_id;
 		vlr.record_length_after_header = laszip_vlr.record_length_after_header;
 		vlr.data.resize(vlr.record_length_after_header);
@@ -52,8 +54,5 @@ las_header las_header::load(const std::string& path) {
 		result.vlrs.push_back(vlr);
 	}
 
-	laszip_close_reader(laszip_reader);
-	laszip_destroy(laszip_reader);
-
 	return result;
 }
\ No newline at end of file
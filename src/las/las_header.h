@@ -13,9 +13,14 @@ namespace potree {
     int64_t numPoints = 0;
 
     int pointDataFormat = -1;
+    int64_t pointDataRecordLength = 0;
+    int64_t offsetToPointData = 0;
 
     std::vector<las_vlr> vlrs;
 
+    // cached through las_catalog, the file is only opened if it is new or has changed
     static las_header load(const std::string& path);
+    // always opens the file with laszip
+    static las_header read(const std::string& path);
   };
 }
\ No newline at end of file
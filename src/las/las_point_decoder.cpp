@@ -0,0 +1,282 @@
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include "las_point_decoder.h"
+#include "utils/gen_utils.h"
+
+using namespace potree;
+
+// index of the first extra attribute in the input attributes of each point data format.
+// +1 for all formats with returns, which is split into return number and number of returns
+static int get_first_extra_index(int point_format) {
+  switch (point_format) {
+    case 0: return 8;
+    case 1: return 9;
+    case 2: return 9;
+    case 3: return 10;
+    case 4: return 14;
+    case 5: return 15;
+    case 6: return 10;
+    case 7: return 11;
+  }
+
+  throw std::runtime_error("las format not supported: " + std::to_string(point_format));
+}
+
+static void set_element(vector3& v, int element, double value) {
+  if (element == 0) v.x = value;
+  else if (element == 1) v.y = value;
+  else v.z = value;
+}
+
+static double get_element(const vector3& v, int element) {
+  if (element == 0) return v.x;
+  else if (element == 1) return v.y;
+  return v.z;
+}
+
+// min/max of one element of an attribute, in its own type.
+// values are gathered into a contiguous block first, so that the reduction runs on vector registers,
+// and converted to double once per batch. 64 bit integers additionally keep their exact range.
+template<typename T>
+static void update_range(const uint8_t* data, int64_t num_points, int64_t stride, attribute& attr, int element) {
+  constexpr int64_t BLOCK_SIZE = 256;
+  T block[BLOCK_SIZE];
+
+  T min;
+  memcpy(&min, data, sizeof(T));
+  T max = min;
+
+  for (int64_t first = 0; first < num_points; first += BLOCK_SIZE) {
+    int64_t count = std::min(BLOCK_SIZE, num_points - first);
+    const uint8_t* source = data + first * stride;
+
+    for (int64_t i = 0; i < count; i++) {
+      memcpy(&block[i], source + i * stride, sizeof(T));
+    }
+
+    for (int64_t i = 0; i < count; i++) {
+      min = block[i] < min ? block[i] : min;
+      max = block[i] > max ? block[i] : max;
+    }
+  }
+
+  if constexpr (std::is_same_v<T, int64_t>) {
+    attr.min_int64[element] = std::min(attr.min_int64[element], min);
+    attr.max_int64[element] = std::max(attr.max_int64[element], max);
+  } else if constexpr (std::is_same_v<T, uint64_t>) {
+    attr.min_uint64[element] = std::min(attr.min_uint64[element], min);
+    attr.max_uint64[element] = std::max(attr.max_uint64[element], max);
+  }
+
+  set_element(attr.min, element, std::min(get_element(attr.min, element), double(min)));
+  set_element(attr.max, element, std::max(get_element(attr.max, element), double(max)));
+}
+
+las_point_decoder::las_point_decoder(const laszip_header* header, attributes& input_attributes, attributes& output_attributes) {
+  m_point_format = header->point_data_format;
+
+  m_position = output_attributes.get("position");
+  m_classification = output_attributes.get("classification");
+
+  // ranges of standard attributes use the types of the laszip fields
+  m_layout.m_rgb = add_standard(input_attributes, output_attributes, "rgb", attribute_type::UINT16, 3, 2);
+  m_layout.m_intensity = add_standard(input_attributes, output_attributes, "intensity", attribute_type::UINT16, 1, 2);
+  m_layout.m_return_number = add_standard(input_attributes, output_attributes, "return number", attribute_type::UINT8, 1, 1);
+  m_layout.m_number_of_returns = add_standard(input_attributes, output_attributes, "number of returns", attribute_type::UINT8, 1, 1);
+  m_layout.m_classification = add_standard(input_attributes, output_attributes, "classification", attribute_type::UINT8, 1, 1);
+  m_layout.m_scan_angle_rank = add_standard(input_attributes, output_attributes, "scan angle rank", attribute_type::INT8, 1, 1);
+  m_layout.m_scan_angle = add_standard(input_attributes, output_attributes, "scan angle", attribute_type::INT16, 1, 2);
+  m_layout.m_user_data = add_standard(input_attributes, output_attributes, "user data", attribute_type::UINT8, 1, 1);
+  m_layout.m_point_source_id = add_standard(input_attributes, output_attributes, "point source id", attribute_type::UINT16, 1, 2);
+  m_layout.m_gps_time = add_standard(input_attributes, output_attributes, "gps-time", attribute_type::DOUBLE, 1, 8);
+  m_layout.m_classification_flags = add_standard(input_attributes, output_attributes, "classification flags", attribute_type::UINT8, 1, 1);
+
+  if (m_layout.m_classification < 0) m_classification = nullptr;
+
+  add_extra_bytes(input_attributes, output_attributes);
+}
+
+int las_point_decoder::add_standard(
+  attributes& input_attributes, attributes& output_attributes, const std::string& name, attribute_type type, int num_elements, int element_size
+) {
+  attribute* output = output_attributes.get(name);
+  if (input_attributes.get(name) == nullptr || output == nullptr) return -1;
+
+  range_column column;
+  column.m_attribute = output;
+  column.m_type = type;
+  column.m_offset = output_attributes.get_offset(name);
+  column.m_num_elements = num_elements;
+  column.m_element_size = element_size;
+  m_ranges.push_back(column);
+
+  return column.m_offset;
+}
+
+void las_point_decoder::add_extra_bytes(attributes& input_attributes, attributes& output_attributes) {
+  int first_extra_index = get_first_extra_index(m_point_format);
+  int source_offset = 0;
+
+  for (int i = first_extra_index; i < int(input_attributes.m_list.size()); i++) {
+    const attribute& input = input_attributes.m_list[i];
+    attribute* output = output_attributes.get(input.name);
+
+    if (output != nullptr) {
+      int target_offset = output_attributes.get_offset(input.name);
+
+      bool adjacent = !m_extra_bytes.empty()
+        && m_extra_bytes.back().m_source + m_extra_bytes.back().m_size == source_offset
+        && m_extra_bytes.back().m_target + m_extra_bytes.back().m_size == target_offset;
+
+      if (adjacent) {
+        m_extra_bytes.back().m_size += input.size;
+      } else {
+        m_extra_bytes.push_back({ source_offset, target_offset, input.size });
+      }
+
+      range_column column;
+      column.m_attribute = output;
+      column.m_type = output->type;
+      column.m_offset = target_offset;
+      column.m_num_elements = std::min(output->numElements, 3);
+      column.m_element_size = output->elementSize;
+      m_ranges.push_back(column);
+    }
+
+    source_offset += input.size;
+  }
+}
+
+void las_point_decoder::decode(las_reader& reader, int64_t num_points, uint8_t* data, int64_t stride, const vector3& scale, const vector3& offset) {
+  switch (m_point_format) {
+    case 0: decode<false, false, false>(reader, num_points, data, stride, scale, offset); break;
+    case 1: decode<true, false, false>(reader, num_points, data, stride, scale, offset); break;
+    case 2: decode<false, true, false>(reader, num_points, data, stride, scale, offset); break;
+    case 3: decode<true, true, false>(reader, num_points, data, stride, scale, offset); break;
+    case 4: decode<true, false, false>(reader, num_points, data, stride, scale, offset); break;
+    case 5: decode<true, true, false>(reader, num_points, data, stride, scale, offset); break;
+    case 6: decode<true, false, true>(reader, num_points, data, stride, scale, offset); break;
+    case 7: decode<true, true, true>(reader, num_points, data, stride, scale, offset); break;
+    default: throw std::runtime_error("las format not supported: " + std::to_string(m_point_format));
+  }
+
+  update_ranges(data, num_points, stride);
+}
+
+template<bool HAS_GPS, bool HAS_RGB, bool EXTENDED>
+void las_point_decoder::decode(las_reader& reader, int64_t num_points, uint8_t* data, int64_t stride, const vector3& scale, const vector3& offset) {
+  const laszip_point* point = reader.m_point;
+  const layout l = m_layout;
+  const copy_run* runs = m_extra_bytes.data();
+  const size_t num_runs = m_extra_bytes.size();
+
+  double coordinates[3];
+  vector3 min = { gen_utils::INF, gen_utils::INF, gen_utils::INF };
+  vector3 max = { -gen_utils::INF, -gen_utils::INF, -gen_utils::INF };
+
+  for (int64_t i = 0; i < num_points; i++) {
+    reader.read_point();
+    reader.get_coordinates(coordinates);
+
+    uint8_t* target = data + i * stride;
+
+    { // position
+      double x = coordinates[0];
+      double y = coordinates[1];
+      double z = coordinates[2];
+
+      int32_t X = int32_t((x - offset.x) / scale.x);
+      int32_t Y = int32_t((y - offset.y) / scale.y);
+      int32_t Z = int32_t((z - offset.z) / scale.z);
+
+      memcpy(target + 0, &X, 4);
+      memcpy(target + 4, &Y, 4);
+      memcpy(target + 8, &Z, 4);
+
+      min.x = std::min(min.x, x);
+      min.y = std::min(min.y, y);
+      min.z = std::min(min.z, z);
+      max.x = std::max(max.x, x);
+      max.y = std::max(max.y, y);
+      max.z = std::max(max.z, z);
+    }
+
+    if (l.m_intensity >= 0) memcpy(target + l.m_intensity, &point->intensity, 2);
+    if (l.m_return_number >= 0) target[l.m_return_number] = point->return_number;
+    if (l.m_number_of_returns >= 0) target[l.m_number_of_returns] = point->number_of_returns;
+    if (l.m_user_data >= 0) target[l.m_user_data] = point->user_data;
+    if (l.m_point_source_id >= 0) memcpy(target + l.m_point_source_id, &point->point_source_ID, 2);
+
+    if (l.m_classification >= 0) {
+      uint8_t extended = point->extended_classification;
+      target[l.m_classification] = extended > 31 ? extended : uint8_t(point->classification);
+    }
+
+    if constexpr (EXTENDED) {
+      if (l.m_scan_angle >= 0) memcpy(target + l.m_scan_angle, &point->extended_scan_angle, 2);
+      if (l.m_classification_flags >= 0) target[l.m_classification_flags] = point->extended_classification_flags;
+    } else {
+      if (l.m_scan_angle_rank >= 0) memcpy(target + l.m_scan_angle_rank, &point->scan_angle_rank, 1);
+    }
+
+    if constexpr (HAS_GPS) {
+      if (l.m_gps_time >= 0) memcpy(target + l.m_gps_time, &point->gps_time, 8);
+    }
+
+    if constexpr (HAS_RGB) {
+      if (l.m_rgb >= 0) memcpy(target + l.m_rgb, point->rgb, 6);
+    }
+
+    for (size_t j = 0; j < num_runs; j++) {
+      memcpy(target + runs[j].m_target, point->extra_bytes + runs[j].m_source, runs[j].m_size);
+    }
+  }
+
+  if (m_position != nullptr) {
+    m_position->min.x = std::min(m_position->min.x, min.x);
+    m_position->min.y = std::min(m_position->min.y, min.y);
+    m_position->min.z = std::min(m_position->min.z, min.z);
+    m_position->max.x = std::max(m_position->max.x, max.x);
+    m_position->max.y = std::max(m_position->max.y, max.y);
+    m_position->max.z = std::max(m_position->max.z, max.z);
+  }
+}
+
+void las_point_decoder::update_ranges(const uint8_t* data, int64_t num_points, int64_t stride) {
+  if (num_points <= 0) return;
+
+  for (const auto& column : m_ranges) {
+    for (int element = 0; element < column.m_num_elements; element++) {
+      const uint8_t* source = data + column.m_offset + element * column.m_element_size;
+      attribute& attr = *column.m_attribute;
+
+      switch (column.m_type) {
+        case attribute_type::INT8: update_range<int8_t>(source, num_points, stride, attr, element); break;
+        case attribute_type::INT16: update_range<int16_t>(source, num_points, stride, attr, element); break;
+        case attribute_type::INT32: update_range<int32_t>(source, num_points, stride, attr, element); break;
+        case attribute_type::INT64: update_range<int64_t>(source, num_points, stride, attr, element); break;
+        case attribute_type::UINT8: update_range<uint8_t>(source, num_points, stride, attr, element); break;
+        case attribute_type::UINT16: update_range<uint16_t>(source, num_points, stride, attr, element); break;
+        case attribute_type::UINT32: update_range<uint32_t>(source, num_points, stride, attr, element); break;
+        case attribute_type::UINT64: update_range<uint64_t>(source, num_points, stride, attr, element); break;
+        case attribute_type::FLOAT: update_range<float>(source, num_points, stride, attr, element); break;
+        case attribute_type::DOUBLE: update_range<double>(source, num_points, stride, attr, element); break;
+        default: break;
+      }
+    }
+  }
+
+  if (m_classification != nullptr) {
+    const uint8_t* source = data + m_layout.m_classification;
+    int64_t counts[256] = {};
+
+    for (int64_t i = 0; i < num_points; i++) {
+      counts[source[i * stride]]++;
+    }
+
+    for (int i = 0; i < 256; i++) {
+      m_classification->histogram[i] += counts[i];
+    }
+  }
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include "laszip/laszip_api.h"
+#include "geometry/attributes.h"
+#include "las_reader_pool.h"
+
+namespace potree {
+
+  // decodes batches of laszip points into the interleaved layout of the output attributes.
+  // attribute offsets and extra bytes types are resolved once per batch, the per point copies are
+  // specialized for the fields of each point data format, and min/max and the classification histogram
+  // are computed afterwards in typed passes over the decoded batch.
+  class las_point_decoder {
+  public:
+    // ranges and histograms are accumulated into output_attributes, usually the statistics of the calling thread
+    las_point_decoder(const laszip_header* header, attributes& input_attributes, attributes& output_attributes);
+
+    // reads num_points points into data, one point every stride bytes.
+    // positions are quantized with scale and offset.
+    void decode(las_reader& reader, int64_t num_points, uint8_t* data, int64_t stride, const vector3& scale, const vector3& offset);
+
+  private:
+    // byte offsets in the output point, -1 if the attribute isn't read or not part of the output
+    struct layout {
+      int m_rgb = -1;
+      int m_intensity = -1;
+      int m_return_number = -1;
+      int m_number_of_returns = -1;
+      int m_classification = -1;
+      int m_scan_angle_rank = -1;
+      int m_scan_angle = -1;
+      int m_user_data = -1;
+      int m_point_source_id = -1;
+      int m_gps_time = -1;
+      int m_classification_flags = -1;
+    };
+
+    // a run of extra bytes that is copied as is, adjacent attributes are merged into one run
+    struct copy_run {
+      int m_source = 0;
+      int m_target = 0;
+      int m_size = 0;
+    };
+
+    // an attribute whose range is computed from the decoded values at m_offset
+    struct range_column {
+      attribute* m_attribute = nullptr;
+      attribute_type m_type = attribute_type::UNDEFINED;
+      int m_offset = 0;
+      int m_num_elements = 1;
+      int m_element_size = 0;
+    };
+
+    int m_point_format = 0;
+    layout m_layout;
+    std::vector<copy_run> m_extra_bytes;
+    std::vector<range_column> m_ranges;
+    attribute* m_position = nullptr;
+    attribute* m_classification = nullptr;
+
+    int add_standard(attributes& input_attributes, attributes& output_attributes, const std::string& name, attribute_type type, int num_elements, int element_size);
+    void add_extra_bytes(attributes& input_attributes, attributes& output_attributes);
+
+    template<bool HAS_GPS, bool HAS_RGB, bool EXTENDED>
+    void decode(las_reader& reader, int64_t num_points, uint8_t* data, int64_t stride, const vector3& scale, const vector3& offset);
+    void update_ranges(const uint8_t* data, int64_t num_points, int64_t stride);
+  };
+
+}
@@ -0,0 +1,200 @@
+#include <cstring>
+#include <unordered_set>
+#include "las_point_mapping.h"
+
+using namespace potree;
+
+static const std::unordered_set<std::string> LAS_FIELDS = {
+  "position", "intensity", "return number", "number of returns", "classification", "classification flags",
+  "scan angle rank", "scan angle", "user data", "point source id", "gps-time", "rgb"
+};
+
+// size of one field description in the extra bytes vlr
+static const int64_t EXTRA_BYTES_RECORD_SIZE = 192;
+
+static int get_point_record_length(int point_format) {
+  switch (point_format) {
+    case 0: return 20;
+    case 1: return 28;
+    case 2: return 26;
+    case 3: return 34;
+    case 6: return 30;
+    case 7: return 36;
+    default: throw std::runtime_error("unsupported point format: " + std::to_string(point_format));
+  }
+}
+
+int las_point_mapping::get_extra_bytes_type(attribute_type type) {
+  switch (type) {
+    case attribute_type::UINT8: return 0;
+    case attribute_type::INT8: return 1;
+    case attribute_type::UINT16: return 2;
+    case attribute_type::INT16: return 3;
+    case attribute_type::UINT32: return 4;
+    case attribute_type::INT32: return 5;
+    case attribute_type::UINT64: return 6;
+    case attribute_type::INT64: return 7;
+    case attribute_type::FLOAT: return 8;
+    case attribute_type::DOUBLE: return 9;
+    default: return -1;
+  }
+}
+
+las_point_mapping::las_point_mapping(const attributes& attrs, bool extended) {
+  m_attributes = attrs;
+
+  m_column_position = get_column("position");
+  m_column_intensity = get_column("intensity");
+  m_column_return_number = get_column("return number");
+  m_column_number_of_returns = get_column("number of returns");
+  m_column_classification = get_column("classification");
+  m_column_classification_flags = get_column("classification flags");
+  m_column_scan_angle_rank = get_column("scan angle rank");
+  m_column_scan_angle = get_column("scan angle");
+  m_column_user_data = get_column("user data");
+  m_column_point_source_id = get_column("point source id");
+  m_column_gps_time = get_column("gps-time");
+  m_column_rgb = get_column("rgb");
+
+  if (m_column_position < 0) throw std::runtime_error("las_point_mapping: point cloud has no position attribute");
+
+  // attributes that only exist in las 1.4 formats require point format 6 or 7
+  extended = extended || m_column_classification_flags >= 0 || m_column_scan_angle >= 0;
+  bool has_gps_time = m_column_gps_time >= 0;
+  bool has_rgb = m_column_rgb >= 0;
+
+  if (extended) {
+    m_point_format = has_rgb ? 7 : 6;
+  }
+  else if (has_gps_time) {
+    m_point_format = has_rgb ? 3 : 1;
+  }
+  else {
+    m_point_format = has_rgb ? 2 : 0;
+  }
+
+  m_point_record_length = ::get_point_record_length(m_point_format);
+
+  // everything else goes to extra bytes, one extra bytes field per element
+  for (const auto& attr : m_attributes.m_list) {
+    if (LAS_FIELDS.find(attr.name) != LAS_FIELDS.end()) continue;
+
+    if (get_extra_bytes_type(attr.type) < 0) {
+      MWARNING << "las_point_mapping: attribute " << attr.name << " has no las extra bytes type and is skipped" << std::endl;
+      continue;
+    }
+
+    int column = get_column(attr.name);
+    for (int i = 0; i < attr.numElements; i++) {
+      attribute element = attr;
+      element.name = attr.numElements == 1 ? attr.name : attr.name + "[" + std::to_string(i) + "]";
+      element.size = attr.elementSize;
+      element.numElements = 1;
+      m_extra_attributes.push_back(element);
+
+      extra_bytes_field field;
+      field.m_column = column;
+      field.m_source_offset = i * attr.elementSize;
+      field.m_stride = attr.size;
+      field.m_target_offset = m_extra_bytes_size;
+      field.m_size = attr.elementSize;
+      m_extra_bytes.push_back(field);
+
+      m_extra_bytes_size += attr.elementSize;
+    }
+  }
+}
+
+int las_point_mapping::get_column(const std::string& name) const {
+  for (size_t i = 0; i < m_attributes.m_list.size(); i++) {
+    if (m_attributes.m_list[i].name == name) return int(i);
+  }
+
+  return -1;
+}
+
+void las_point_mapping::set_point(const node_data& data, int64_t index, laszip_point* point) const {
+  bool extended = is_extended();
+
+  // pointer to the value of point "index" in the column of an attribute
+  auto source = [&data, index](int column, int64_t size) {
+    return data.m_columns[column]->data_u8 + index * size;
+  };
+
+  memcpy(&point->X, source(m_column_position, 12) + 0, 4);
+  memcpy(&point->Y, source(m_column_position, 12) + 4, 4);
+  memcpy(&point->Z, source(m_column_position, 12) + 8, 4);
+
+  if (m_column_intensity >= 0) memcpy(&point->intensity, source(m_column_intensity, 2), 2);
+  if (m_column_user_data >= 0) point->user_data = *source(m_column_user_data, 1);
+  if (m_column_point_source_id >= 0) memcpy(&point->point_source_ID, source(m_column_point_source_id, 2), 2);
+  if (m_column_gps_time >= 0) memcpy(&point->gps_time, source(m_column_gps_time, 8), 8);
+  if (m_column_rgb >= 0) memcpy(point->rgb, source(m_column_rgb, 6), 6);
+
+  if (m_column_return_number >= 0) {
+    uint8_t value = *source(m_column_return_number, 1);
+    point->return_number = std::min(value, uint8_t(7));
+    if (extended) point->extended_return_number = value & 0b1111;
+  }
+
+  if (m_column_number_of_returns >= 0) {
+    uint8_t value = *source(m_column_number_of_returns, 1);
+    point->number_of_returns = std::min(value, uint8_t(7));
+    if (extended) point->extended_number_of_returns = value & 0b1111;
+  }
+
+  if (m_column_classification >= 0) {
+    uint8_t value = *source(m_column_classification, 1);
+    point->classification = value & 0b11111;
+    if (extended) point->extended_classification = value;
+  }
+
+  if (m_column_classification_flags >= 0) {
+    uint8_t value = *source(m_column_classification_flags, 1);
+    point->synthetic_flag = (value >> 0) & 1;
+    point->keypoint_flag = (value >> 1) & 1;
+    point->withheld_flag = (value >> 2) & 1;
+    if (extended) point->extended_classification_flags = value & 0b1111;
+  }
+
+  if (m_column_scan_angle_rank >= 0) {
+    int8_t value;
+    memcpy(&value, source(m_column_scan_angle_rank, 1), 1);
+    point->scan_angle_rank = value;
+    if (extended && m_column_scan_angle < 0) point->extended_scan_angle = int16_t(std::round(double(value) / 0.006));
+  }
+
+  if (m_column_scan_angle >= 0) {
+    int16_t value;
+    memcpy(&value, source(m_column_scan_angle, 2), 2);
+    point->extended_scan_angle = value;
+    point->scan_angle_rank = int8_t(std::clamp(double(value) * 0.006, -90.0, 90.0));
+  }
+
+  for (const auto& field : m_extra_bytes) {
+    memcpy(point->extra_bytes + field.m_target_offset, source(field.m_column, field.m_stride) + field.m_source_offset, field.m_size);
+  }
+}
+
+// field descriptions as specified by las 1.4 r15, one 192 byte record per extra bytes field
+std::vector<uint8_t> las_point_mapping::create_extra_bytes_vlr() const {
+  std::vector<uint8_t> vlr(EXTRA_BYTES_RECORD_SIZE * m_extra_attributes.size(), 0);
+
+  for (size_t i = 0; i < m_extra_attributes.size(); i++) {
+    const auto& attr = m_extra_attributes[i];
+    uint8_t* record = vlr.data() + EXTRA_BYTES_RECORD_SIZE * i;
+
+    uint8_t options = 0;
+    if (attr.scale.x != 1.0) options |= 1 << 3;
+    if (attr.offset.x != 0.0) options |= 1 << 4;
+
+    record[2] = uint8_t(get_extra_bytes_type(attr.type) + 1);
+    record[3] = options;
+    memcpy(record + 4, attr.name.data(), std::min(attr.name.size(), size_t(32)));
+    if (options & (1 << 3)) memcpy(record + 112, &attr.scale.x, 8);
+    if (options & (1 << 4)) memcpy(record + 136, &attr.offset.x, 8);
+    memcpy(record + 160, attr.description.data(), std::min(attr.description.size(), size_t(32)));
+  }
+
+  return vlr;
+}
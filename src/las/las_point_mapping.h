@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "laszip/laszip_api.h"
+#include "geometry/attributes.h"
+#include "reader/octree_reader.h"
+
+namespace potree {
+
+  // maps the attributes of a potree octree to the fields of a las point format.
+  // attributes without a matching las field are stored in extra bytes, one extra bytes field per element.
+  class las_point_mapping {
+  public:
+    las_point_mapping() { }
+    // extended selects one of the las 1.4 point formats 6 or 7, even if no attribute requires them
+    las_point_mapping(const attributes& attrs, bool extended = false);
+
+    int get_point_format() const { return m_point_format; }
+    bool is_extended() const { return m_point_format >= 6; }
+    // size of the point format without extra bytes
+    int get_point_record_length() const { return m_point_record_length; }
+    int get_extra_bytes_size() const { return m_extra_bytes_size; }
+    // one attribute per extra bytes field, in the order of the extra bytes
+    const std::vector<attribute>& get_extra_attributes() const { return m_extra_attributes; }
+    int get_column(const std::string& name) const;
+
+    void set_point(const node_data& data, int64_t index, laszip_point* point) const;
+
+    // payload of the extra bytes vlr (user id "LASF_Spec", record id 4)
+    std::vector<uint8_t> create_extra_bytes_vlr() const;
+
+    // las extra bytes data type minus one, as expected by laszip_add_attribute(). -1 if there is none.
+    static int get_extra_bytes_type(attribute_type type);
+
+  private:
+    // an attribute element stored in extra bytes
+    struct extra_bytes_field {
+      int m_column = -1;
+      int64_t m_source_offset = 0; // of the element within the attribute
+      int64_t m_stride = 0; // size of the attribute
+      int64_t m_target_offset = 0;
+      int64_t m_size = 0;
+    };
+
+    attributes m_attributes;
+    int m_point_format = 0;
+    int m_point_record_length = 0;
+    int m_extra_bytes_size = 0;
+    std::vector<extra_bytes_field> m_extra_bytes;
+    std::vector<attribute> m_extra_attributes;
+
+    int m_column_position = -1;
+    int m_column_intensity = -1;
+    int m_column_return_number = -1;
+    int m_column_number_of_returns = -1;
+    int m_column_classification = -1;
+    int m_column_classification_flags = -1;
+    int m_column_scan_angle_rank = -1;
+    int m_column_scan_angle = -1;
+    int m_column_user_data = -1;
+    int m_column_point_source_id = -1;
+    int m_column_gps_time = -1;
+    int m_column_rgb = -1;
+  };
+
+}
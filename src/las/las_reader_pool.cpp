@@ -0,0 +1,109 @@
+#include <stdexcept>
+#include "las_reader_pool.h"
+#include "utils/string_utils.h"
+
+using namespace potree;
+
+std::atomic_int las_reader_pool::s_max_open_readers = las_reader_pool::DEFAULT_MAX_OPEN_READERS;
+std::atomic_int las_reader_pool::s_num_open_readers = 0;
+std::atomic_int64_t las_reader_pool::s_num_opened = 0;
+std::atomic_int64_t las_reader_pool::s_num_reused = 0;
+
+las_reader::las_reader(const std::string& path) {
+  m_path = path;
+
+  laszip_BOOL request_reader = 1;
+  laszip_BOOL is_compressed = string_utils::iends_with(path, ".laz") ? 1 : 0;
+
+  laszip_create(&m_reader);
+  laszip_request_compatibility_mode(m_reader, request_reader);
+
+  if (laszip_open_reader(m_reader, path.c_str(), &is_compressed)) {
+    laszip_CHAR* error;
+    laszip_get_error(m_reader, &error);
+    std::string message = "failed to open " + path + ": " + std::string(error);
+    laszip_destroy(m_reader);
+
+    throw std::runtime_error(message);
+  }
+
+  laszip_get_header_pointer(m_reader, &m_header);
+  laszip_get_point_pointer(m_reader, &m_point);
+}
+
+las_reader::~las_reader() {
+  laszip_close_reader(m_reader);
+  laszip_destroy(m_reader);
+}
+
+void las_reader::seek(int64_t first_point) {
+  if (m_position == first_point) return;
+
+  // the position is unknown until the seek succeeded
+  m_position = -1;
+
+  if (laszip_seek_point(m_reader, first_point)) {
+    throw std::runtime_error("failed to seek to point " + std::to_string(first_point) + " in " + m_path);
+  }
+
+  m_position = first_point;
+}
+
+void las_reader::read_point() {
+  laszip_read_point(m_reader);
+  m_position++;
+}
+
+void las_reader::get_coordinates(double* coordinates) {
+  laszip_get_coordinates(m_reader, coordinates);
+}
+
+las_reader_pool::~las_reader_pool() {
+  s_num_open_readers -= int(m_readers.size());
+}
+
+las_reader_pool& las_reader_pool::local() {
+  thread_local las_reader_pool pool;
+  return pool;
+}
+
+las_reader& las_reader_pool::acquire(const std::string& path, int64_t first_point) {
+  auto& reader = local().get(path);
+  reader.seek(first_point);
+
+  return reader;
+}
+
+void las_reader_pool::close() {
+  auto& pool = local();
+
+  s_num_open_readers -= int(pool.m_readers.size());
+  pool.m_readers.clear();
+}
+
+las_reader& las_reader_pool::get(const std::string& path) {
+  for (auto it = m_readers.begin(); it != m_readers.end(); it++) {
+    if ((*it)->m_path == path) {
+      m_readers.splice(m_readers.begin(), m_readers, it);
+      s_num_reused++;
+
+      return *m_readers.front();
+    }
+  }
+
+  // readers of other threads can't be closed from here, a thread without readers always gets one
+  while (!m_readers.empty() && (m_readers.size() >= MAX_READERS_PER_THREAD || s_num_open_readers >= s_max_open_readers)) {
+    evict();
+  }
+
+  m_readers.push_front(std::make_unique<las_reader>(path));
+  s_num_open_readers++;
+  s_num_opened++;
+
+  return *m_readers.front();
+}
+
+void las_reader_pool::evict() {
+  m_readers.pop_back();
+  s_num_open_readers--;
+}
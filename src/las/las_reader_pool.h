@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <list>
+#include <memory>
+#include <atomic>
+#include "laszip/laszip_api.h"
+
+namespace potree {
+
+  // an open laszip reader and the index of the point that the next read returns
+  struct las_reader {
+    std::string m_path;
+    laszip_POINTER m_reader = nullptr;
+    laszip_header* m_header = nullptr;
+    laszip_point* m_point = nullptr;
+    int64_t m_position = 0;
+
+    las_reader(const std::string& path);
+    ~las_reader();
+
+    las_reader(const las_reader&) = delete;
+    las_reader& operator=(const las_reader&) = delete;
+
+    // seeks only if the reader isn't already positioned at first_point
+    void seek(int64_t first_point);
+    void read_point();
+    void get_coordinates(double* coordinates);
+  };
+
+  // keeps the laszip readers of each thread open between tasks, so that consecutive batches of a file
+  // don't parse the header, the vlrs and the laz chunk table again.
+  // readers are owned by the thread that opened them. once the number of open readers of all threads
+  // reaches the budget, a thread closes its least recently used reader before it opens another one.
+  class las_reader_pool {
+  public:
+    static const int DEFAULT_MAX_OPEN_READERS = 256;
+    static const int MAX_READERS_PER_THREAD = 8;
+
+    // returns a reader of the calling thread, positioned at first_point.
+    // the reader stays valid until the next call to acquire() or close() on the same thread.
+    static las_reader& acquire(const std::string& path, int64_t first_point = 0);
+    // closes all readers of the calling thread
+    static void close();
+
+    static void set_max_open_readers(int max_open_readers) { s_max_open_readers = max_open_readers; }
+    static int get_num_open_readers() { return s_num_open_readers; }
+    static int64_t get_num_opened() { return s_num_opened; }
+    static int64_t get_num_reused() { return s_num_reused; }
+
+    ~las_reader_pool();
+
+  private:
+    // most recently used first
+    std::list<std::unique_ptr<las_reader>> m_readers;
+
+    static std::atomic_int s_max_open_readers;
+    static std::atomic_int s_num_open_readers;
+    static std::atomic_int64_t s_num_opened;
+    static std::atomic_int64_t s_num_reused;
+
+    static las_reader_pool& local();
+    las_reader& get(const std::string& path);
+    void evict();
+  };
+
+}
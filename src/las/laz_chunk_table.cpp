@@ -0,0 +1,285 @@
+#include <cstring>
+#include <algorithm>
+#include "laz_chunk_table.h"
+
+using namespace potree;
+
+// the encoder and models below follow laszip's arithmeticencoder and integercompressor,
+// restricted to what the chunk table needs. the output has to match laszip bit for bit.
+
+static const uint32_t AC_MIN_LENGTH = 0x01000000u;
+static const uint32_t AC_MAX_LENGTH = 0xFFFFFFFFu;
+static const uint32_t BM_LENGTH_SHIFT = 13;
+static const uint32_t BM_MAX_COUNT = 1u << BM_LENGTH_SHIFT;
+static const uint32_t DM_LENGTH_SHIFT = 15;
+static const uint32_t DM_MAX_COUNT = 1u << DM_LENGTH_SHIFT;
+
+struct bit_model {
+  uint32_t m_bit_0_count = 1;
+  uint32_t m_bit_count = 2;
+  uint32_t m_bit_0_prob = 1u << (BM_LENGTH_SHIFT - 1);
+  uint32_t m_update_cycle = 4;
+  uint32_t m_bits_until_update = 4;
+
+  void update() {
+    // halve counts when a threshold is reached
+    if ((m_bit_count += m_update_cycle) > BM_MAX_COUNT) {
+      m_bit_count = (m_bit_count + 1) >> 1;
+      m_bit_0_count = (m_bit_0_count + 1) >> 1;
+      if (m_bit_0_count == m_bit_count) ++m_bit_count;
+    }
+
+    uint32_t scale = 0x80000000u / m_bit_count;
+    m_bit_0_prob = (m_bit_0_count * scale) >> (31 - BM_LENGTH_SHIFT);
+
+    m_update_cycle = std::min((5 * m_update_cycle) >> 2, 64u);
+    m_bits_until_update = m_update_cycle;
+  }
+};
+
+struct symbol_model {
+  uint32_t m_symbols = 0;
+  uint32_t m_last_symbol = 0;
+  uint32_t m_total_count = 0;
+  uint32_t m_update_cycle = 0;
+  uint32_t m_symbols_until_update = 0;
+  std::vector<uint32_t> m_distribution;
+  std::vector<uint32_t> m_symbol_count;
+
+  symbol_model(uint32_t symbols) {
+    m_symbols = symbols;
+    m_last_symbol = symbols - 1;
+    m_distribution.resize(symbols, 0);
+    m_symbol_count.resize(symbols, 1);
+
+    m_update_cycle = symbols;
+    update();
+    m_symbols_until_update = m_update_cycle = (symbols + 6) >> 1;
+  }
+
+  void update() {
+    // halve counts when a threshold is reached
+    if ((m_total_count += m_update_cycle) > DM_MAX_COUNT) {
+      m_total_count = 0;
+      for (uint32_t n = 0; n < m_symbols; n++) {
+        m_total_count += (m_symbol_count[n] = (m_symbol_count[n] + 1) >> 1);
+      }
+    }
+
+    // cumulative distribution
+    uint32_t sum = 0;
+    uint32_t scale = 0x80000000u / m_total_count;
+    for (uint32_t k = 0; k < m_symbols; k++) {
+      m_distribution[k] = (scale * sum) >> (31 - DM_LENGTH_SHIFT);
+      sum += m_symbol_count[k];
+    }
+
+    m_update_cycle = std::min((5 * m_update_cycle) >> 2, (m_symbols + 6) << 3);
+    m_symbols_until_update = m_update_cycle;
+  }
+};
+
+// range encoder writing to memory. laszip's encoder keeps a ring buffer so that carries can still reach
+// bytes that weren't flushed, with all bytes in memory that is the same as propagating into the vector.
+class range_encoder {
+public:
+  range_encoder(std::vector<uint8_t>& out) : m_out(out) { }
+
+  void encode_bit(bit_model& m, uint32_t bit) {
+    uint32_t x = m.m_bit_0_prob * (m_length >> BM_LENGTH_SHIFT);
+
+    if (bit == 0) {
+      m_length = x;
+      ++m.m_bit_0_count;
+    }
+    else {
+      uint32_t init_base = m_base;
+      m_base += x;
+      m_length -= x;
+      if (init_base > m_base) propagate_carry();
+    }
+
+    if (m_length < AC_MIN_LENGTH) renorm();
+    if (--m.m_bits_until_update == 0) m.update();
+  }
+
+  void encode_symbol(symbol_model& m, uint32_t sym) {
+    uint32_t init_base = m_base;
+
+    if (sym == m.m_last_symbol) {
+      uint32_t x = m.m_distribution[sym] * (m_length >> DM_LENGTH_SHIFT);
+      m_base += x;
+      m_length -= x;
+    }
+    else {
+      m_length >>= DM_LENGTH_SHIFT;
+      uint32_t x = m.m_distribution[sym] * m_length;
+      m_base += x;
+      m_length = m.m_distribution[sym + 1] * m_length - x;
+    }
+
+    if (init_base > m_base) propagate_carry();
+    if (m_length < AC_MIN_LENGTH) renorm();
+
+    ++m.m_symbol_count[sym];
+    if (--m.m_symbols_until_update == 0) m.update();
+  }
+
+  void write_bits(uint32_t bits, uint32_t sym) {
+    if (bits > 19) {
+      write_short(uint16_t(sym & 0xFFFF));
+      sym = sym >> 16;
+      bits = bits - 16;
+    }
+
+    uint32_t init_base = m_base;
+    m_base += sym * (m_length >>= bits);
+    if (init_base > m_base) propagate_carry();
+    if (m_length < AC_MIN_LENGTH) renorm();
+  }
+
+  void done() {
+    uint32_t init_base = m_base;
+    bool another_byte = true;
+
+    if (m_length > 2 * AC_MIN_LENGTH) {
+      m_base += AC_MIN_LENGTH;
+      m_length = AC_MIN_LENGTH >> 1;
+    }
+    else {
+      m_base += AC_MIN_LENGTH >> 1;
+      m_length = AC_MIN_LENGTH >> 9;
+      another_byte = false;
+    }
+
+    if (init_base > m_base) propagate_carry();
+    renorm();
+
+    // two or three zero bytes keep the decoder's reads in sync
+    m_out.push_back(0);
+    m_out.push_back(0);
+    if (another_byte) m_out.push_back(0);
+  }
+
+private:
+  std::vector<uint8_t>& m_out;
+  uint32_t m_base = 0;
+  uint32_t m_length = AC_MAX_LENGTH;
+
+  void write_short(uint16_t sym) {
+    uint32_t init_base = m_base;
+    m_base += sym * (m_length >>= 16);
+    if (init_base > m_base) propagate_carry();
+    renorm();
+  }
+
+  void propagate_carry() {
+    size_t i = m_out.size() - 1;
+
+    while (m_out[i] == 0xFF) {
+      m_out[i] = 0;
+      i--;
+    }
+
+    ++m_out[i];
+  }
+
+  void renorm() {
+    do {
+      m_out.push_back(uint8_t(m_base >> 24));
+      m_base <<= 8;
+    } while ((m_length <<= 8) < AC_MIN_LENGTH);
+  }
+};
+
+// laszip's IntegerCompressor(enc, 32, contexts), i.e. full 32 bit correctors with 8 high bits per symbol
+class integer_compressor {
+public:
+  integer_compressor(range_encoder& enc, uint32_t contexts) : m_enc(enc) {
+    for (uint32_t i = 0; i < contexts; i++) {
+      m_bits.emplace_back(CORR_BITS + 1);
+    }
+
+    for (uint32_t i = 1; i <= CORR_BITS; i++) {
+      m_corrector.emplace_back(i <= BITS_HIGH ? (1u << i) : (1u << BITS_HIGH));
+    }
+  }
+
+  void compress(uint32_t pred, uint32_t real, uint32_t context) {
+    // the difference wraps around like laszip's 32 bit corrector range
+    int32_t corr = int32_t(real - pred);
+    write_corrector(corr, m_bits[context]);
+  }
+
+private:
+  static const uint32_t CORR_BITS = 32;
+  static const uint32_t BITS_HIGH = 8;
+
+  range_encoder& m_enc;
+  std::vector<symbol_model> m_bits;
+  bit_model m_corrector_0;
+  // m_corrector[k - 1] codes correctors of k bits
+  std::vector<symbol_model> m_corrector;
+
+  void write_corrector(int32_t c, symbol_model& bits) {
+    // number of bits of the corrector's magnitude
+    uint32_t c1 = c <= 0 ? uint32_t(-int64_t(c)) : uint32_t(c - 1);
+    uint32_t k = 0;
+    while (c1) {
+      c1 = c1 >> 1;
+      k = k + 1;
+    }
+
+    m_enc.encode_symbol(bits, k);
+
+    if (k == 0) {
+      // c is 0 or 1
+      m_enc.encode_bit(m_corrector_0, uint32_t(c));
+      return;
+    }
+
+    if (k >= 32) return;
+
+    // translate c into the k bit interval [0, 2^k - 1]
+    uint32_t value = c < 0 ? uint32_t(c + int32_t((1u << k) - 1)) : uint32_t(c - 1);
+
+    if (k <= BITS_HIGH) {
+      m_enc.encode_symbol(m_corrector[k - 1], value);
+    }
+    else {
+      // the highest BITS_HIGH bits are modelled, the rest is stored raw
+      uint32_t k1 = k - BITS_HIGH;
+      uint32_t low = value & ((1u << k1) - 1);
+      m_enc.encode_symbol(m_corrector[k - 1], value >> k1);
+      m_enc.write_bits(k1, low);
+    }
+  }
+};
+
+void laz_chunk_table::add(uint32_t num_points, uint32_t byte_size) {
+  m_chunks.push_back({ num_points, byte_size });
+}
+
+std::vector<uint8_t> laz_chunk_table::encode() const {
+  std::vector<uint8_t> out(8, 0);
+  uint32_t version = 0;
+  uint32_t num_chunks = uint32_t(m_chunks.size());
+  memcpy(out.data() + 0, &version, 4);
+  memcpy(out.data() + 4, &num_chunks, 4);
+
+  if (m_chunks.empty()) return out;
+
+  // variable sized chunks store the point count of each chunk in context 0, byte sizes in context 1,
+  // both relative to the previous chunk
+  range_encoder enc(out);
+  integer_compressor ic(enc, 2);
+
+  for (size_t i = 0; i < m_chunks.size(); i++) {
+    ic.compress(i ? m_chunks[i - 1].m_num_points : 0, m_chunks[i].m_num_points, 0);
+    ic.compress(i ? m_chunks[i - 1].m_byte_size : 0, m_chunks[i].m_byte_size, 1);
+  }
+
+  enc.done();
+
+  return out;
+}
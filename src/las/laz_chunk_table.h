@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace potree {
+
+  // chunk table of a laz file with variable sized chunks, it follows the last chunk of the point data.
+  // laszip only writes the table for chunks that went through its own writer, files that are assembled
+  // from independently compressed chunks encode it here, with the same range coder and integer compressor.
+  class laz_chunk_table {
+  public:
+    void add(uint32_t num_points, uint32_t byte_size);
+    size_t size() const { return m_chunks.size(); }
+
+    // version, number of chunks and the compressed point counts and byte sizes of all chunks
+    std::vector<uint8_t> encode() const;
+
+  private:
+    struct entry {
+      uint32_t m_num_points = 0;
+      uint32_t m_byte_size = 0;
+    };
+
+    std::vector<entry> m_chunks;
+  };
+
+}
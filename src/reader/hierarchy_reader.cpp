@@ -0,0 +1,100 @@
+#include "hierarchy_reader.h"
+#include "utils/file_utils.h"
+
+using namespace potree;
+
+hierarchy_reader::hierarchy_reader(const std::string& path) : hierarchy_reader(path, file_utils::read_json(path + "/metadata.json")) {
+}
+
+hierarchy_reader::hierarchy_reader(const std::string& path, const json& metadata) : m_file(path + "/hierarchy.bin") {
+  m_path = path;
+  m_metadata = metadata;
+  m_spacing = metadata["spacing"];
+
+  auto bbox = bounding_box::parse(metadata["boundingBox"]);
+  int64_t first_chunk_size = metadata["hierarchy"]["firstChunkSize"];
+
+  // the root starts as a proxy of the first hierarchy chunk
+  m_root = std::make_shared<node>("r", bbox.min, bbox.max);
+  m_root->type = node_type::PROXY;
+  m_root->proxyByteOffset = 0;
+  m_root->proxyByteSize = first_chunk_size;
+
+  resolve(m_root);
+}
+
+bool hierarchy_reader::resolve(const std::shared_ptr<node>& n) {
+  std::lock_guard<std::mutex> lock(m_mtx);
+  if (n->type != node_type::PROXY) return false;
+
+  if (int64_t(n->proxyByteOffset + n->proxyByteSize) > m_file.size()) {
+    throw std::runtime_error("hierarchy chunk of node " + n->name + " exceeds " + m_file.path());
+  }
+
+  // proxies of the new chunk stay unresolved until they are reached
+  std::vector<std::shared_ptr<node>> proxies;
+  node::load_hierarchy_chunk(m_file.data() + n->proxyByteOffset, n->proxyByteSize, n, proxies);
+  m_num_loaded_chunks++;
+
+  return true;
+}
+
+void hierarchy_reader::resolve_all() {
+  std::vector<std::shared_ptr<node>> stack = { m_root };
+
+  while (!stack.empty()) {
+    auto current = stack.back();
+    stack.pop_back();
+
+    resolve(current);
+
+    for (const auto& child : current->children) {
+      if (child != nullptr) stack.push_back(child);
+    }
+  }
+}
+
+std::shared_ptr<node> hierarchy_reader::find(const std::string& name) {
+  if (name.empty() || name[0] != 'r') return nullptr;
+
+  auto current = m_root;
+  for (size_t i = 1; i < name.size(); i++) {
+    resolve(current);
+
+    int index = name[i] - '0';
+    if (index < 0 || index > 7) return nullptr;
+
+    current = current->children[index];
+    if (current == nullptr) return nullptr;
+  }
+
+  resolve(current);
+
+  return current;
+}
+
+std::vector<std::shared_ptr<node>> hierarchy_reader::query(const bounding_box& box, double spacing) {
+  std::vector<std::shared_ptr<node>> result;
+  std::vector<std::shared_ptr<node>> stack = { m_root };
+
+  while (!stack.empty()) {
+    auto current = stack.back();
+    stack.pop_back();
+
+    if (!box.intersects(current->min, current->max)) continue;
+
+    resolve(current);
+    result.push_back(current);
+
+    // the next level would be finer than requested
+    if (get_spacing(current->get_level()) <= spacing) continue;
+
+    for (const auto& child : current->children) {
+      if (child != nullptr) stack.push_back(child);
+    }
+  }
+
+  node::sort_by_breadth(result);
+
+  return result;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <mutex>
+#include "nlohmann/json.hpp"
+#include "geometry/node.h"
+#include "geometry/bounding_box.h"
+#include "utils/mapped_file.h"
+
+using namespace nlohmann;
+
+namespace potree {
+
+  // lazy reader for the hierarchy of a converted point cloud.
+  // hierarchy.bin is memory mapped, and hierarchy chunks are only parsed once a query reaches their proxy node.
+  class hierarchy_reader {
+  public:
+    hierarchy_reader(const std::string& path);
+    hierarchy_reader(const std::string& path, const json& metadata);
+
+    std::shared_ptr<node> get_root() const { return m_root; }
+    const json& get_metadata() const { return m_metadata; }
+    double get_spacing() const { return m_spacing; }
+    double get_spacing(int64_t level) const { return m_spacing / double(int64_t(1) << level); }
+    int64_t get_num_loaded_chunks() const { return m_num_loaded_chunks; }
+
+    // loads the hierarchy chunk of a proxy node. returns false if the node was already resolved.
+    bool resolve(const std::shared_ptr<node>& n);
+    void resolve_all();
+
+    // node with the given name, e.g. "r0417", or nullptr
+    std::shared_ptr<node> find(const std::string& name);
+    // nodes intersecting the box, from the root down to the first level with a spacing of at most "spacing"
+    std::vector<std::shared_ptr<node>> query(const bounding_box& box, double spacing);
+
+  private:
+    std::string m_path;
+    json m_metadata;
+    mapped_file m_file;
+    std::shared_ptr<node> m_root;
+    double m_spacing = 0.0;
+    int64_t m_num_loaded_chunks = 0;
+    std::mutex m_mtx;
+  };
+
+}
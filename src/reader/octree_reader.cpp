@@ -0,0 +1,163 @@
+#include <execution>
+#include "octree_reader.h"
+#include "utils/file_utils.h"
+#include "utils/brotli_utils.h"
+
+using namespace potree;
+
+// copies one attribute out of interleaved points into its column.
+// the fixed size lets the compiler turn the copy into plain loads and stores.
+template<int SIZE>
+static void deinterleave(const uint8_t* source, int64_t stride, int64_t num_points, uint8_t* target) {
+  for (int64_t i = 0; i < num_points; i++) {
+    memcpy(target + i * SIZE, source + i * stride, SIZE);
+  }
+}
+
+static void deinterleave(const uint8_t* source, int64_t stride, int64_t num_points, int64_t size, uint8_t* target) {
+  switch (size) {
+    case 1: deinterleave<1>(source, stride, num_points, target); break;
+    case 2: deinterleave<2>(source, stride, num_points, target); break;
+    case 4: deinterleave<4>(source, stride, num_points, target); break;
+    case 6: deinterleave<6>(source, stride, num_points, target); break;
+    case 8: deinterleave<8>(source, stride, num_points, target); break;
+    case 12: deinterleave<12>(source, stride, num_points, target); break;
+    default:
+      for (int64_t i = 0; i < num_points; i++) {
+        memcpy(target + i * size, source + i * stride, size);
+      }
+  }
+}
+
+octree_reader::octree_reader(const std::string& path, int64_t cache_bytes) : m_hierarchy(path) {
+  m_path = path;
+  m_octree_path = path + "/octree.bin";
+  m_cache_budget = cache_bytes;
+
+  const auto& metadata = m_hierarchy.get_metadata();
+  m_attributes = node::parse_attributes(metadata);
+  m_encoding = metadata["encoding"];
+}
+
+int octree_reader::get_column(const std::string& name) const {
+  for (size_t i = 0; i < m_attributes.m_list.size(); i++) {
+    if (m_attributes.m_list[i].name == name) return int(i);
+  }
+
+  return -1;
+}
+
+std::shared_ptr<const node_data> octree_reader::read(const std::string& name) {
+  auto data = lookup(name);
+  if (data != nullptr) return data;
+
+  auto n = m_hierarchy.find(name);
+  if (n == nullptr) return nullptr;
+
+  data = decode(*n);
+  insert(data);
+
+  return data;
+}
+
+std::shared_ptr<const node_data> octree_reader::read(const std::shared_ptr<node>& n) {
+  auto data = lookup(n->name);
+  if (data != nullptr) return data;
+
+  m_hierarchy.resolve(n);
+  data = decode(*n);
+  insert(data);
+
+  return data;
+}
+
+std::vector<std::shared_ptr<const node_data>> octree_reader::read(const std::vector<std::string>& names) {
+  std::vector<std::shared_ptr<const node_data>> result(names.size());
+  std::vector<size_t> missing;
+
+  for (size_t i = 0; i < names.size(); i++) {
+    result[i] = lookup(names[i]);
+    if (result[i] == nullptr) missing.push_back(i);
+  }
+
+  std::for_each(std::execution::par, missing.begin(), missing.end(), [this, &names, &result](size_t i) {
+    auto n = m_hierarchy.find(names[i]);
+    if (n == nullptr) return;
+
+    result[i] = decode(*n);
+    insert(result[i]);
+  });
+
+  return result;
+}
+
+std::shared_ptr<const node_data> octree_reader::lookup(const std::string& name) {
+  std::lock_guard<std::mutex> lock(m_cache_mtx);
+  auto it = m_cache.find(name);
+
+  if (it == m_cache.end()) {
+    m_cache_misses++;
+    return nullptr;
+  }
+
+  m_cache_hits++;
+  m_lru.splice(m_lru.begin(), m_lru, it->second.m_position);
+
+  return it->second.m_data;
+}
+
+void octree_reader::insert(const std::shared_ptr<const node_data>& data) {
+  int64_t bytes = data->get_byte_size();
+  if (bytes > m_cache_budget) return;
+
+  std::lock_guard<std::mutex> lock(m_cache_mtx);
+
+  // another thread may have decoded the same node in the meantime
+  if (m_cache.find(data->m_name) != m_cache.end()) return;
+
+  while (m_cached_bytes + bytes > m_cache_budget && !m_lru.empty()) {
+    auto it = m_cache.find(m_lru.back());
+    m_cached_bytes -= it->second.m_data->get_byte_size();
+    m_cache.erase(it);
+    m_lru.pop_back();
+  }
+
+  m_lru.push_front(data->m_name);
+  m_cache[data->m_name] = { data, m_lru.begin() };
+  m_cached_bytes += bytes;
+}
+
+std::shared_ptr<const node_data> octree_reader::decode(const node& n) const {
+  auto data = std::make_shared<node_data>();
+  data->m_name = n.name;
+  data->m_num_points = n.numPoints;
+
+  if (n.numPoints == 0 || n.byteSize == 0) return data;
+
+  if (m_encoding == "BROTLI") {
+    auto encoded = file_utils::read_binary(m_octree_path, n.byteOffset, n.byteSize);
+    data->m_columns = brotli_utils::decompress(encoded.data(), encoded.size(), m_attributes, n.numPoints);
+
+    return data;
+  }
+
+  // DEFAULT and UNCOMPRESSED store interleaved points
+  thread_local std::vector<uint8_t> points;
+  points.resize(n.byteSize);
+  file_utils::read_binary(m_octree_path, n.byteOffset, n.byteSize, points.data());
+
+  int64_t bpp = m_attributes.bytes;
+  if (n.byteSize < bpp * n.numPoints) {
+    throw std::runtime_error("node " + n.name + " holds less bytes than its points require");
+  }
+
+  int64_t offset = 0;
+  for (const auto& attr : m_attributes.m_list) {
+    auto column = std::make_shared<potree::buffer>(attr.size * n.numPoints);
+    deinterleave(points.data() + offset, bpp, n.numPoints, attr.size, column->data_u8);
+    data->m_columns.push_back(column);
+    offset += attr.size;
+  }
+
+  return data;
+}
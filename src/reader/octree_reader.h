@@ -0,0 +1,74 @@
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <memory>
+#include <unordered_map>
+#include "common/buffer.h"
+#include "geometry/attributes.h"
+#include "hierarchy_reader.h"
+
+namespace potree {
+
+  // decoded points of a node, one column per attribute in the order of the octree's attributes.
+  // e.g. the position column holds num_points int32 XYZ triples.
+  struct node_data {
+    std::string m_name;
+    int64_t m_num_points = 0;
+    std::vector<std::shared_ptr<potree::buffer>> m_columns;
+
+    int64_t get_byte_size() const {
+      int64_t bytes = 0;
+      for (const auto& column : m_columns) bytes += column->size;
+      return bytes;
+    }
+  };
+
+  // reads and decodes nodes of a converted point cloud (DEFAULT, UNCOMPRESSED and BROTLI encoding).
+  // recently used nodes are kept in an LRU cache limited to cache_bytes of decoded data.
+  class octree_reader {
+  public:
+    octree_reader(const std::string& path, int64_t cache_bytes = 256 * 1024 * 1024);
+
+    const attributes& get_attributes() const { return m_attributes; }
+    const std::string& get_encoding() const { return m_encoding; }
+    hierarchy_reader& get_hierarchy() { return m_hierarchy; }
+    // index of the attribute's column in node_data::m_columns, or -1
+    int get_column(const std::string& name) const;
+
+    // nullptr if there is no node with that name
+    std::shared_ptr<const node_data> read(const std::string& name);
+    std::shared_ptr<const node_data> read(const std::shared_ptr<node>& n);
+    // decodes the nodes that aren't cached in parallel. same order as names, nullptr for missing nodes.
+    std::vector<std::shared_ptr<const node_data>> read(const std::vector<std::string>& names);
+
+    int64_t get_cache_hits() const { return m_cache_hits; }
+    int64_t get_cache_misses() const { return m_cache_misses; }
+    int64_t get_cached_bytes() const { return m_cached_bytes; }
+
+  private:
+    struct cache_entry {
+      std::shared_ptr<const node_data> m_data;
+      std::list<std::string>::iterator m_position;
+    };
+
+    std::string m_path;
+    std::string m_octree_path;
+    hierarchy_reader m_hierarchy;
+    attributes m_attributes;
+    std::string m_encoding;
+
+    std::mutex m_cache_mtx;
+    std::list<std::string> m_lru; // most recently used first
+    std::unordered_map<std::string, cache_entry> m_cache;
+    int64_t m_cache_budget = 0;
+    int64_t m_cached_bytes = 0;
+    int64_t m_cache_hits = 0;
+    int64_t m_cache_misses = 0;
+
+    std::shared_ptr<const node_data> lookup(const std::string& name);
+    void insert(const std::shared_ptr<const node_data>& data);
+    std::shared_ptr<const node_data> decode(const node& n) const;
+  };
+
+}
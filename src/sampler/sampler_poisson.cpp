@@ -1,4 +1,6 @@
 #include "sampler_poisson.h"
+#include <algorithm>
+#include <execution>
 
 using namespace potree;
 
@@ -73,18 +75,16 @@ void sampler_poisson::sample(const std::shared_ptr<potree::node>& n, attributes&
       numPointsInChildren += child->numPoints;
     } // specific
     
-    std::vector<point> points; // specific
+    std::vector<sample_point> points; // specific
     points.reserve(numPointsInChildren); // specific
 
     std::vector<std::vector<int8_t>> acceptedChildPointFlags;
     std::vector<int64_t> numRejectedPerChild(8, 0); // specific
-    int64_t numAccepted = 0;
     for (int childIndex = 0; childIndex < 8; childIndex++) {
       auto child = node->children[childIndex];
 
       if (child == nullptr) {
         acceptedChildPointFlags.push_back({});
-        numRejectedPerChild.push_back({});
 
         continue;
       }
@@ -107,15 +107,20 @@ void sampler_poisson::sample(const std::shared_ptr<potree::node>& n, attributes&
     }
 
     double spacing = base_spacing / pow(2.0, node->get_level());
-    node->sort_by_distance_to_center(points);
+    // sample points keep their child and point index, sorting a vector<point> would slice them off
+    std::sort(std::execution::par_unseq, points.begin(), points.end(), [&node](const sample_point& a, const sample_point& b) {
+      return node->compare_distance_to_center(a, b);
+    });
     const auto center = node->get_center();
     thread_local std::vector<sample_point> accepted_v(1'000'000);
     int64_t num_accepted = 0;
 
-    for(const point& p : points) {
-      auto point = static_cast<sample_point>(p);
-
+    for(const sample_point& point : points) {
       if (accept(point, center, spacing, num_accepted, accepted_v)) {
+        if (num_accepted == int64_t(accepted_v.size())) {
+          accepted_v.resize(2 * accepted_v.size());
+        }
+
         accepted_v[num_accepted] = point;
         num_accepted++;
         acceptedChildPointFlags[point.childIndex][point.pointIndex] = 1;
@@ -174,7 +179,7 @@ void sampler_poisson::sample(const std::shared_ptr<potree::node>& n, attributes&
     }
 
     node->points = accepted;
-    node->numPoints = numAccepted;
+    node->numPoints = num_accepted;
 
     return true;
   });
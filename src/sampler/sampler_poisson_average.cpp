@@ -0,0 +1,249 @@
+#include "sampler_poisson_average.h"
+#include <algorithm>
+#include <execution>
+
+using namespace potree;
+
+// per accepted point sums of the averaged attributes, as separate arrays so that the final division vectorizes
+struct average_accumulator {
+  std::vector<uint64_t> m_r;
+  std::vector<uint64_t> m_g;
+  std::vector<uint64_t> m_b;
+  std::vector<uint64_t> m_intensity;
+  std::vector<uint32_t> m_count;
+
+  void reset(int64_t size) {
+    m_r.assign(size, 0);
+    m_g.assign(size, 0);
+    m_b.assign(size, 0);
+    m_intensity.assign(size, 0);
+    m_count.assign(size, 0);
+  }
+
+  void add(int64_t index, const uint8_t* point, int rgb_offset, int intensity_offset) {
+    if (rgb_offset >= 0) {
+      uint16_t rgb[3];
+      memcpy(rgb, point + rgb_offset, 6);
+      m_r[index] += rgb[0];
+      m_g[index] += rgb[1];
+      m_b[index] += rgb[2];
+    }
+
+    if (intensity_offset >= 0) {
+      uint16_t intensity;
+      memcpy(&intensity, point + intensity_offset, 2);
+      m_intensity[index] += intensity;
+    }
+
+    m_count[index]++;
+  }
+
+  // replaces the sums with the averages
+  void average() {
+    int64_t size = m_count.size();
+
+    for (int64_t i = 0; i < size; i++) {
+      uint64_t count = std::max(m_count[i], uint32_t(1));
+      m_r[i] = (m_r[i] + count / 2) / count;
+      m_g[i] = (m_g[i] + count / 2) / count;
+      m_b[i] = (m_b[i] + count / 2) / count;
+      m_intensity[i] = (m_intensity[i] + count / 2) / count;
+    }
+  }
+};
+
+int64_t sampler_poisson_average::find_conflict(
+  const point& candidate, const vector3& center, double spacing,
+  int64_t num_accepted, const std::vector<sample_point>& accepted
+) {
+  auto cx = candidate.x - center.x;
+  auto cy = candidate.y - center.y;
+  auto cz = candidate.z - center.z;
+  auto cdd = cx * cx + cy * cy + cz * cz;
+  auto cd = sqrt(cdd);
+  auto limit = (cd - spacing);
+  auto limitSquared = limit * limit;
+
+  int64_t j = 0;
+  for(int64_t i = num_accepted - 1; i >= 0; i--) {
+    auto& p = accepted[i];
+    auto px = p.x - center.x;
+    auto py = p.y - center.y;
+    auto pz = p.z - center.z;
+    auto pdd = px * px + py * py + pz * pz;
+
+    // same early outs as sampler_poisson::accept()
+    if (pdd < limitSquared) {
+      return -1;
+    }
+
+    double dd = point::square_distance(p, candidate);
+    if (dd < spacing * spacing) return i;
+
+    j++;
+    if (j > 10'000) return -1;
+  }
+
+  return -1;
+}
+
+void sampler_poisson_average::sample(const std::shared_ptr<potree::node>& n, attributes& attrs, double base_spacing, node_function on_complete, node_function on_discard) {
+  int64_t bpp = attrs.bytes;
+  vector3 scale = attrs.m_pos_scale;
+  vector3 offset = attrs.m_pos_offset;
+
+  // rgb and intensity are averaged if they are stored as uint16
+  attribute* rgb = attrs.get("rgb");
+  attribute* intensity = attrs.get("intensity");
+  int rgb_offset = rgb != nullptr && rgb->size == 6 ? attrs.get_offset("rgb") : -1;
+  int intensity_offset = intensity != nullptr && intensity->size == 2 ? attrs.get_offset("intensity") : -1;
+
+  n->traversePost([this, bpp, base_spacing, scale, offset, rgb_offset, intensity_offset, &on_complete, &on_discard](const std::shared_ptr<potree::node>& node) {
+    node->sampled = true;
+
+    if (node->isLeaf()) {
+      return false;
+    }
+
+    int64_t num_points_in_children = 0;
+    for (const auto& child : node->children) {
+      if (child != nullptr) num_points_in_children += child->numPoints;
+    }
+
+    std::vector<sample_point> points;
+    points.reserve(num_points_in_children);
+
+    // for each point of a child, the index of the accepted point it became or that rejected it.
+    // rejected points are stored as -(index + 2)
+    std::vector<std::vector<int32_t>> assignments(8);
+
+    for (int child_index = 0; child_index < 8; child_index++) {
+      auto child = node->children[child_index];
+      if (child == nullptr) continue;
+
+      assignments[child_index].resize(child->numPoints);
+
+      for (int64_t i = 0; i < child->numPoints; i++) {
+        int32_t xyz[3];
+        memcpy(xyz, child->points->data_u8 + i * bpp, 12);
+
+        double x = (xyz[0] * scale.x) + offset.x;
+        double y = (xyz[1] * scale.y) + offset.y;
+        double z = (xyz[2] * scale.z) + offset.z;
+
+        sample_point p = { x, y, z, int32_t(i), child_index };
+        points.push_back(p);
+      }
+    }
+
+    double spacing = base_spacing / pow(2.0, node->get_level());
+    std::sort(std::execution::par_unseq, points.begin(), points.end(), [&node](const sample_point& a, const sample_point& b) {
+      return node->compare_distance_to_center(a, b);
+    });
+
+    const auto center = node->get_center();
+    thread_local std::vector<sample_point> accepted_v(1'000'000);
+    int64_t num_accepted = 0;
+    int64_t num_rejected_per_child[8] = {};
+
+    for (const sample_point& point : points) {
+      int64_t conflict = find_conflict(point, center, spacing, num_accepted, accepted_v);
+
+      if (conflict < 0) {
+        if (num_accepted == int64_t(accepted_v.size())) {
+          accepted_v.resize(2 * accepted_v.size());
+        }
+
+        accepted_v[num_accepted] = point;
+        assignments[point.childIndex][point.pointIndex] = int32_t(num_accepted);
+        num_accepted++;
+      }
+      else {
+        assignments[point.childIndex][point.pointIndex] = -int32_t(conflict + 2);
+        num_rejected_per_child[point.childIndex]++;
+      }
+    }
+
+    // accumulate accepted and rejected points in storage order
+    thread_local average_accumulator accumulator;
+    bool averaged = rgb_offset >= 0 || intensity_offset >= 0;
+
+    if (averaged) {
+      accumulator.reset(num_accepted);
+
+      for (int child_index = 0; child_index < 8; child_index++) {
+        auto child = node->children[child_index];
+        if (child == nullptr) continue;
+
+        const auto& assignment = assignments[child_index];
+
+        for (int64_t i = 0; i < child->numPoints; i++) {
+          int64_t target = assignment[i] >= 0 ? assignment[i] : -(int64_t(assignment[i]) + 2);
+          accumulator.add(target, child->points->data_u8 + i * bpp, rgb_offset, intensity_offset);
+        }
+      }
+
+      accumulator.average();
+    }
+
+    auto accepted = std::make_shared<potree::buffer>(num_accepted * bpp);
+
+    for (int child_index = 0; child_index < 8; child_index++) {
+      auto child = node->children[child_index];
+      if (child == nullptr) continue;
+
+      int64_t num_rejected = num_rejected_per_child[child_index];
+      const auto& assignment = assignments[child_index];
+      auto rejected = std::make_shared<potree::buffer>(num_rejected * bpp);
+
+      for (int64_t i = 0; i < child->numPoints; i++) {
+        uint8_t* point = child->points->data_u8 + i * bpp;
+
+        if (assignment[i] < 0) {
+          rejected->write(point, bpp);
+          continue;
+        }
+
+        // rejected points keep their own values, the accepted point takes the average
+        uint8_t* target = accepted->data_u8 + accepted->pos;
+        accepted->write(point, bpp);
+
+        if (averaged) {
+          int64_t index = assignment[i];
+
+          if (rgb_offset >= 0) {
+            uint16_t rgb[3] = { uint16_t(accumulator.m_r[index]), uint16_t(accumulator.m_g[index]), uint16_t(accumulator.m_b[index]) };
+            memcpy(target + rgb_offset, rgb, 6);
+          }
+
+          if (intensity_offset >= 0) {
+            uint16_t value = uint16_t(accumulator.m_intensity[index]);
+            memcpy(target + intensity_offset, &value, 2);
+          }
+        }
+      }
+
+      if (num_rejected == 0 && child->isLeaf()) {
+        on_discard(child);
+        node->children[child_index] = nullptr;
+      }
+      if (num_rejected > 0) {
+        child->points = rejected;
+        child->numPoints = num_rejected;
+
+        on_complete(child);
+      }
+      else if (num_rejected == 0) {
+        // the parent has taken all points from this child, see sampler_poisson
+        child->points = nullptr;
+        child->numPoints = 0;
+        on_complete(child);
+      }
+    }
+
+    node->points = accepted;
+    node->numPoints = num_accepted;
+
+    return true;
+  });
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "geometry/point.h"
+#include "sampler.h"
+
+namespace potree {
+  // accepts points like sampler_poisson, then gives every accepted point the average rgb and intensity
+  // of itself and the points it rejected, which reduces aliasing in the coarse levels.
+  // the rejecting point is recorded during the acceptance test, so averaging is a linear pass over
+  // the children with integer accumulators, not a second neighbour search.
+  struct sampler_poisson_average : public sampler {
+  public:
+    void sample(const std::shared_ptr<potree::node>& n, attributes& attrs, double base_spacing, node_function on_complete, node_function on_discard) override;
+  private:
+    // index of the accepted point that rejects the candidate, -1 if the candidate is accepted
+    int64_t find_conflict(const point& candidate, const vector3& center, double spacing, int64_t num_accepted, const std::vector<sample_point>& accepted);
+  };
+}
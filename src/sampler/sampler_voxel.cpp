@@ -0,0 +1,195 @@
+#include <cmath>
+#include <algorithm>
+#include "sampler_voxel.h"
+
+using namespace potree;
+
+// voxel coordinates are packed into 21 bits per axis
+static const int64_t MAX_GRID_SIZE = 1 << 21;
+
+// set of occupied voxels with linear probing, grows once it's half full.
+// slots from previous nodes are invalidated by bumping the stamp, the table is only cleared when it wraps around.
+struct voxel_table {
+  static const int MIN_BITS = 12;
+
+  std::vector<uint64_t> m_keys;
+  std::vector<uint32_t> m_stamps;
+  uint64_t m_mask = 0;
+  int m_bits = 0;
+  int64_t m_size = 0;
+  uint32_t m_stamp = 0;
+
+  void reset() {
+    if (m_keys.empty()) resize(MIN_BITS);
+
+    m_size = 0;
+    m_stamp++;
+
+    if (m_stamp == 0) {
+      std::fill(m_stamps.begin(), m_stamps.end(), 0);
+      m_stamp = 1;
+    }
+  }
+
+  // returns true if the voxel wasn't occupied yet
+  bool insert(uint64_t key) {
+    uint64_t slot = get_slot(key);
+
+    while (m_stamps[slot] == m_stamp) {
+      if (m_keys[slot] == key) return false;
+      slot = (slot + 1) & m_mask;
+    }
+
+    m_stamps[slot] = m_stamp;
+    m_keys[slot] = key;
+    m_size++;
+
+    if (2 * m_size > int64_t(m_keys.size())) {
+      resize(m_bits + 1);
+    }
+
+    return true;
+  }
+
+private:
+  uint64_t get_slot(uint64_t key) const {
+    return (key * 0x9E3779B97F4A7C15ull) >> (64 - m_bits);
+  }
+
+  void resize(int bits) {
+    std::vector<uint64_t> keys(uint64_t(1) << bits, 0);
+    std::vector<uint32_t> stamps(uint64_t(1) << bits, 0);
+    uint32_t stamp = std::max(m_stamp, uint32_t(1));
+
+    std::swap(keys, m_keys);
+    std::swap(stamps, m_stamps);
+    m_bits = bits;
+    m_mask = (uint64_t(1) << bits) - 1;
+
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (stamps[i] != m_stamp || m_stamp == 0) continue;
+
+      uint64_t slot = get_slot(keys[i]);
+      while (m_stamps[slot] == stamp) slot = (slot + 1) & m_mask;
+
+      m_stamps[slot] = stamp;
+      m_keys[slot] = keys[i];
+    }
+
+    m_stamp = stamp;
+  }
+};
+
+void sampler_voxel::sample(const std::shared_ptr<potree::node>& n, attributes& attrs, double base_spacing, node_function on_complete, node_function on_discard) {
+  int64_t bpp = attrs.bytes;
+  vector3 scale = attrs.m_pos_scale;
+  vector3 offset = attrs.m_pos_offset;
+
+  n->traversePost([bpp, base_spacing, scale, offset, &on_complete, &on_discard](const std::shared_ptr<potree::node>& node) {
+    node->sampled = true;
+
+    if (node->isLeaf()) {
+      return false;
+    }
+
+    int64_t num_points_in_children = 0;
+    for (const auto& child : node->children) {
+      if (child != nullptr) num_points_in_children += child->numPoints;
+    }
+
+    // voxels per axis, 128 with the default base spacing
+    double spacing = base_spacing / pow(2.0, node->get_level());
+    vector3 size = node->max - node->min;
+    int64_t grid_size = std::clamp(int64_t(std::ceil(size.x / spacing)), int64_t(1), MAX_GRID_SIZE);
+
+    // voxel coordinates are computed from the integer coordinates, relative to the node's min in integer units
+    double min_x = (node->min.x - offset.x) / scale.x;
+    double min_y = (node->min.y - offset.y) / scale.y;
+    double min_z = (node->min.z - offset.z) / scale.z;
+    double factor_x = double(grid_size) * scale.x / size.x;
+    double factor_y = double(grid_size) * scale.y / size.y;
+    double factor_z = double(grid_size) * scale.z / size.z;
+
+    thread_local voxel_table table;
+    thread_local std::vector<uint8_t> accepted_flags;
+    table.reset();
+    accepted_flags.resize(num_points_in_children);
+
+    int64_t num_accepted = 0;
+    int64_t num_rejected_per_child[8] = {};
+    int64_t first_point_of_child[8] = {};
+    int64_t first_point = 0;
+
+    for (int child_index = 0; child_index < 8; child_index++) {
+      auto child = node->children[child_index];
+      if (child == nullptr) continue;
+
+      const uint8_t* data = child->points != nullptr ? child->points->data_u8 : nullptr;
+      uint8_t* flags = accepted_flags.data() + first_point;
+      int64_t num_rejected = 0;
+
+      for (int64_t i = 0; i < child->numPoints; i++) {
+        int32_t xyz[3];
+        memcpy(xyz, data + i * bpp, 12);
+
+        int64_t ix = std::clamp(int64_t((double(xyz[0]) - min_x) * factor_x), int64_t(0), grid_size - 1);
+        int64_t iy = std::clamp(int64_t((double(xyz[1]) - min_y) * factor_y), int64_t(0), grid_size - 1);
+        int64_t iz = std::clamp(int64_t((double(xyz[2]) - min_z) * factor_z), int64_t(0), grid_size - 1);
+
+        uint64_t key = uint64_t(ix) | (uint64_t(iy) << 21) | (uint64_t(iz) << 42);
+        bool is_accepted = table.insert(key);
+
+        flags[i] = is_accepted ? 1 : 0;
+        num_rejected += is_accepted ? 0 : 1;
+      }
+
+      num_accepted += child->numPoints - num_rejected;
+      num_rejected_per_child[child_index] = num_rejected;
+      first_point_of_child[child_index] = first_point;
+      first_point += child->numPoints;
+    }
+
+    auto accepted = std::make_shared<potree::buffer>(num_accepted * bpp);
+
+    for (int child_index = 0; child_index < 8; child_index++) {
+      auto child = node->children[child_index];
+      if (child == nullptr) continue;
+
+      int64_t num_rejected = num_rejected_per_child[child_index];
+      const uint8_t* flags = accepted_flags.data() + first_point_of_child[child_index];
+      auto rejected = std::make_shared<potree::buffer>(num_rejected * bpp);
+
+      for (int64_t i = 0; i < child->numPoints; i++) {
+        uint8_t* point = child->points->data_u8 + i * bpp;
+
+        if (flags[i]) {
+          accepted->write(point, bpp);
+        } else {
+          rejected->write(point, bpp);
+        }
+      }
+
+      if (num_rejected == 0 && child->isLeaf()) {
+        on_discard(child);
+        node->children[child_index] = nullptr;
+      }
+      if (num_rejected > 0) {
+        child->points = rejected;
+        child->numPoints = num_rejected;
+
+        on_complete(child);
+      }
+      else if (num_rejected == 0) {
+        // the parent has taken all points from this child, see sampler_poisson
+        child->points = nullptr;
+        child->numPoints = 0;
+        on_complete(child);
+      }
+    }
+
+    node->points = accepted;
+    node->numPoints = num_accepted;
+
+    return true;
+  });
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "sampler.h"
+
+namespace potree {
+  // fastest sampler, meant for quick-look conversions.
+  // an inner node takes the first point of each voxel of its spacing from its children,
+  // voxels are looked up in an open-addressing hash table that each thread reuses.
+  // no shuffling, no distance checks, the result only depends on the order of the points.
+  struct sampler_voxel : public sampler {
+    void sample(const std::shared_ptr<potree::node>& n, attributes& attrs, double base_spacing, node_function on_complete, node_function on_discard) override;
+  };
+}
@@ -0,0 +1,50 @@
+#include <iostream>
+#include "server/octree_server.h"
+#include "utils/gen_utils.h"
+
+using namespace potree;
+
+static void print_usage() {
+  std::cout << "usage: potree-server <potree directory> [--host <address>] [--port <port>] [--pinned-levels <levels>] [--max-pinned-mb <megabytes>]" << std::endl;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    print_usage();
+    return 1;
+  }
+
+  server_options opts;
+  opts.m_path = argv[1];
+
+  for (int i = 2; i < argc; i++) {
+    std::string arg = argv[i];
+
+    if (i + 1 >= argc) {
+      print_usage();
+      return 1;
+    }
+
+    std::string value = argv[++i];
+
+    if (arg == "--host") opts.m_host = value;
+    else if (arg == "--port") opts.m_port = std::stoi(value);
+    else if (arg == "--pinned-levels") opts.m_pinned_levels = std::stoi(value);
+    else if (arg == "--max-pinned-mb") opts.m_max_pinned_bytes = std::stoll(value) * 1024 * 1024;
+    else {
+      print_usage();
+      return 1;
+    }
+  }
+
+  try {
+    octree_server server(opts);
+    server.run();
+  }
+  catch (const std::exception& e) {
+    MERROR << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,551 @@
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#endif
+#include "octree_server.h"
+#include "reader/hierarchy_reader.h"
+#include "utils/file_utils.h"
+#include "utils/gen_utils.h"
+
+using namespace potree;
+
+static const int64_t MAX_HEADER_SIZE = 16 * 1024;
+static const int IDLE_TIMEOUT_SECONDS = 30;
+
+#if defined(MSG_MORE)
+static const int SEND_MORE = MSG_MORE;
+#else
+static const int SEND_MORE = 0;
+#endif
+
+#if defined(MSG_NOSIGNAL)
+static const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+static const int SEND_FLAGS = 0;
+#endif
+
+static std::string get_status_text(int status) {
+  switch (status) {
+    case 200: return "OK";
+    case 206: return "Partial Content";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 416: return "Range Not Satisfiable";
+    case 431: return "Request Header Fields Too Large";
+    case 503: return "Service Unavailable";
+    default: return "Internal Server Error";
+  }
+}
+
+static bool send_all(int fd, const void* data, int64_t size, int flags = 0) {
+  const char* current = reinterpret_cast<const char*>(data);
+
+  while (size > 0) {
+    ssize_t sent = send(fd, current, size, flags | SEND_FLAGS);
+
+    if (sent < 0 && errno == EINTR) continue;
+    if (sent <= 0) return false;
+
+    current += sent;
+    size -= sent;
+  }
+
+  return true;
+}
+
+// sends a range of a file without copying it to user space
+static bool send_file_range(int fd, int file_fd, int64_t offset, int64_t size) {
+#if defined(__linux__)
+  off_t position = offset;
+
+  while (size > 0) {
+    ssize_t sent = sendfile(fd, file_fd, &position, size);
+
+    if (sent < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+    if (sent <= 0) return false;
+
+    size -= sent;
+  }
+
+  return true;
+#else
+  std::vector<uint8_t> chunk(1024 * 1024);
+
+  while (size > 0) {
+    ssize_t read = pread(file_fd, chunk.data(), std::min(size, int64_t(chunk.size())), offset);
+
+    if (read < 0 && errno == EINTR) continue;
+    if (read <= 0 || !send_all(fd, chunk.data(), read)) return false;
+
+    offset += read;
+    size -= read;
+  }
+
+  return true;
+#endif
+}
+
+// parses "bytes=start-end", "bytes=start-" and "bytes=-suffix".
+// returns false if the range can't be satisfied. multiple ranges aren't supported,
+// "ranged" stays false for them and the whole file is sent, which http allows.
+static bool parse_range(const std::string& value, int64_t file_size, int64_t& start, int64_t& end, bool& ranged) {
+  ranged = false;
+
+  if (value.rfind("bytes=", 0) != 0 || value.find(',') != std::string::npos) return true;
+
+  std::string spec = value.substr(6);
+  size_t dash = spec.find('-');
+  if (dash == std::string::npos) return true;
+
+  std::string first = spec.substr(0, dash);
+  std::string last = spec.substr(dash + 1);
+
+  try {
+    if (first.empty()) {
+      if (last.empty()) return true;
+
+      int64_t suffix = std::stoll(last);
+      if (suffix <= 0 || file_size == 0) return false;
+
+      start = std::max(int64_t(0), file_size - suffix);
+      end = file_size - 1;
+    }
+    else {
+      start = std::stoll(first);
+      end = last.empty() ? file_size - 1 : std::min(int64_t(std::stoll(last)), file_size - 1);
+
+      if (start >= file_size || end < start) return false;
+    }
+  }
+  catch (const std::exception&) {
+    return true;
+  }
+
+  ranged = true;
+
+  return true;
+}
+
+octree_server::octree_server(const server_options& opts) {
+  m_options = opts;
+
+  if (!std::filesystem::is_directory(m_options.m_path)) {
+    throw std::runtime_error("octree_server: " + m_options.m_path + " is not a directory");
+  }
+
+  auto& metadata_file = add_file("metadata.json", "application/json");
+  auto& hierarchy_file = add_file("hierarchy.bin", "application/octet-stream");
+  add_file("octree.bin", "application/octet-stream");
+
+  json metadata = file_utils::read_json(metadata_file.m_path);
+  int64_t first_chunk_size = metadata["hierarchy"]["firstChunkSize"];
+
+  pin(metadata_file, "metadata", 0, metadata_file.m_size);
+  pin(hierarchy_file, "firstChunk", 0, std::min(first_chunk_size, hierarchy_file.m_size));
+  pin_levels();
+
+  for (auto& file : m_files) {
+    std::sort(file->m_pinned.begin(), file->m_pinned.end(), [](const auto& a, const auto& b) {
+      return a->m_offset < b->m_offset;
+    });
+  }
+
+  m_socket = socket(AF_INET, SOCK_STREAM, 0);
+  if (m_socket < 0) throw std::runtime_error("octree_server: failed to create socket: " + std::string(strerror(errno)));
+
+  int enable = 1;
+  setsockopt(m_socket, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(uint16_t(m_options.m_port));
+
+  if (inet_pton(AF_INET, m_options.m_host.c_str(), &address.sin_addr) != 1) {
+    throw std::runtime_error("octree_server: invalid host " + m_options.m_host);
+  }
+
+  if (bind(m_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(m_socket, 128) < 0) {
+    throw std::runtime_error("octree_server: failed to listen on " + m_options.m_host + ":" + std::to_string(m_options.m_port) + ": " + std::string(strerror(errno)));
+  }
+
+  socklen_t length = sizeof(address);
+  getsockname(m_socket, reinterpret_cast<sockaddr*>(&address), &length);
+  m_port = ntohs(address.sin_port);
+  m_running = true;
+}
+
+octree_server::~octree_server() {
+  stop();
+
+  // connection threads are detached, they only end once their socket is shut down
+  while (m_num_connections > 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  if (m_socket >= 0) close(m_socket);
+
+  for (auto& file : m_files) {
+    if (file->m_fd >= 0) close(file->m_fd);
+  }
+}
+
+octree_server::served_file& octree_server::add_file(const std::string& name, const std::string& content_type) {
+  auto file = std::make_unique<served_file>();
+  file->m_name = name;
+  file->m_path = m_options.m_path + "/" + name;
+  file->m_content_type = content_type;
+  file->m_fd = open(file->m_path.c_str(), O_RDONLY | O_CLOEXEC);
+
+  struct stat info;
+  if (file->m_fd < 0 || fstat(file->m_fd, &info) < 0) {
+    throw std::runtime_error("octree_server: failed to open " + file->m_path + ": " + std::string(strerror(errno)));
+  }
+
+  file->m_size = info.st_size;
+  m_files.push_back(std::move(file));
+
+  return *m_files.back();
+}
+
+void octree_server::pin(served_file& file, const std::string& name, int64_t offset, int64_t size) {
+  if (size <= 0 || offset + size > file.m_size) return;
+
+  auto range = std::make_unique<pinned_range>();
+  range->m_name = name;
+  range->m_offset = offset;
+  range->m_size = size;
+  range->m_data = file_utils::read_binary(file.m_path, offset, size);
+
+  file.m_pinned.push_back(std::move(range));
+}
+
+// pins the nodes of the top levels, level by level, as long as they fit into the budget
+void octree_server::pin_levels() {
+  if (m_options.m_pinned_levels <= 0) return;
+
+  gen_utils::profiler pr("octree_server::pin_levels()");
+  hierarchy_reader hierarchy(m_options.m_path);
+  auto& octree_file = *m_files.back();
+  int64_t pinned_bytes = 0;
+  int64_t pinned_nodes = 0;
+
+  std::vector<std::shared_ptr<node>> level = { hierarchy.get_root() };
+
+  for (int i = 0; i < m_options.m_pinned_levels && !level.empty(); i++) {
+    std::vector<std::shared_ptr<node>> next_level;
+
+    for (const auto& n : level) {
+      hierarchy.resolve(n);
+
+      if (n->byteSize > 0) {
+        if (pinned_bytes + int64_t(n->byteSize) > m_options.m_max_pinned_bytes) {
+          MWARNING << "octree_server: pinned node budget exhausted at level " << i << std::endl;
+          MINFO << "octree_server: pinned " << gen_utils::format_number(pinned_nodes) << " nodes, " << gen_utils::format_number(pinned_bytes) << " bytes" << std::endl;
+          return;
+        }
+
+        pin(octree_file, n->name, n->byteOffset, n->byteSize);
+        pinned_bytes += n->byteSize;
+        pinned_nodes++;
+      }
+
+      for (const auto& child : n->children) {
+        if (child != nullptr) next_level.push_back(child);
+      }
+    }
+
+    level = std::move(next_level);
+  }
+
+  MINFO << "octree_server: pinned " << gen_utils::format_number(pinned_nodes) << " nodes, " << gen_utils::format_number(pinned_bytes) << " bytes" << std::endl;
+}
+
+const octree_server::pinned_range* octree_server::find_pinned(const served_file& file, int64_t start, int64_t end) const {
+  const auto& pinned = file.m_pinned;
+  auto it = std::upper_bound(pinned.begin(), pinned.end(), start, [](int64_t offset, const auto& range) {
+    return offset < range->m_offset;
+  });
+
+  if (it == pinned.begin()) return nullptr;
+
+  const auto& range = *std::prev(it);
+  if (end >= range->m_offset + range->m_size) return nullptr;
+
+  return range.get();
+}
+
+octree_server::served_file* octree_server::find_file(const std::string& target) const {
+  std::string name = target.substr(target.find_last_of('/') + 1);
+
+  for (const auto& file : m_files) {
+    if (file->m_name == name) return file.get();
+  }
+
+  return nullptr;
+}
+
+void octree_server::run() {
+  // a client closing its connection early must not terminate the process
+  signal(SIGPIPE, SIG_IGN);
+
+  MINFO << "octree_server: serving " << m_options.m_path << " on http://" << m_options.m_host << ":" << m_port << std::endl;
+
+  while (m_running) {
+    int fd = accept(m_socket, nullptr, nullptr);
+
+    if (fd < 0) {
+      if (!m_running) break;
+      if (errno != EINTR) MWARNING << "octree_server: accept failed: " << strerror(errno) << std::endl;
+      continue;
+    }
+
+    if (m_num_connections >= m_options.m_max_connections) {
+      send_response(fd, 503, "text/plain", "too many connections\n", false, false);
+      close(fd);
+      continue;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_connections_mtx);
+      m_connections.insert(fd);
+      m_num_connections++;
+    }
+
+    std::thread([this, fd]() {
+      handle_connection(fd);
+
+      {
+        std::lock_guard<std::mutex> lock(m_connections_mtx);
+        m_connections.erase(fd);
+        close(fd);
+      }
+
+      m_num_connections--;
+    }).detach();
+  }
+}
+
+void octree_server::stop() {
+  if (!m_running.exchange(false)) return;
+
+  // wakes up accept() and connections waiting for their next request
+  shutdown(m_socket, SHUT_RDWR);
+
+  std::lock_guard<std::mutex> lock(m_connections_mtx);
+  for (int fd : m_connections) {
+    shutdown(fd, SHUT_RDWR);
+  }
+}
+
+json octree_server::get_stats() const {
+  json js;
+  js["requests"] = int64_t(m_num_requests);
+  js["connections"] = int(m_num_connections);
+  js["files"] = json::object();
+  js["ranges"] = json::array();
+
+  for (const auto& file : m_files) {
+    int64_t pinned_size = 0;
+
+    for (const auto& range : file->m_pinned) {
+      pinned_size += range->m_size;
+
+      json js_range;
+      js_range["file"] = file->m_name;
+      js_range["name"] = range->m_name;
+      js_range["offset"] = range->m_offset;
+      js_range["size"] = range->m_size;
+      js_range["hits"] = int64_t(range->m_hits);
+      js["ranges"].push_back(js_range);
+    }
+
+    json js_file;
+    js_file["size"] = file->m_size;
+    js_file["pinnedSize"] = pinned_size;
+    js_file["requests"] = int64_t(file->m_requests);
+    js_file["pinnedHits"] = int64_t(file->m_pinned_hits);
+    js_file["pinnedBytesSent"] = int64_t(file->m_pinned_bytes);
+    js_file["coldHits"] = int64_t(file->m_cold_hits);
+    js_file["coldBytesSent"] = int64_t(file->m_cold_bytes);
+    js["files"][file->m_name] = js_file;
+  }
+
+  return js;
+}
+
+void octree_server::handle_connection(int fd) {
+  timeval timeout = { IDLE_TIMEOUT_SECONDS, 0 };
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  int enable = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+  std::string pending;
+  char chunk[4096];
+
+  while (m_running) {
+    size_t header_end = pending.find("\r\n\r\n");
+
+    if (header_end == std::string::npos) {
+      if (int64_t(pending.size()) > MAX_HEADER_SIZE) {
+        send_response(fd, 431, "text/plain", "request header too large\n", false, false);
+        return;
+      }
+
+      ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+      if (received < 0 && errno == EINTR) continue;
+      if (received <= 0) return;
+
+      pending.append(chunk, received);
+      continue;
+    }
+
+    std::string header = pending.substr(0, header_end);
+    pending.erase(0, header_end + 4);
+
+    request req;
+    size_t line_end = header.find("\r\n");
+    std::string request_line = header.substr(0, line_end);
+    size_t first_space = request_line.find(' ');
+    size_t last_space = request_line.rfind(' ');
+
+    if (first_space == std::string::npos || first_space == last_space) {
+      send_response(fd, 400, "text/plain", "malformed request\n", false, false);
+      return;
+    }
+
+    req.m_method = request_line.substr(0, first_space);
+    req.m_target = request_line.substr(first_space + 1, last_space - first_space - 1);
+    req.m_version = request_line.substr(last_space + 1);
+
+    while (line_end != std::string::npos) {
+      size_t start = line_end + 2;
+      line_end = header.find("\r\n", start);
+      std::string line = header.substr(start, line_end == std::string::npos ? std::string::npos : line_end - start);
+
+      size_t colon = line.find(':');
+      if (colon == std::string::npos) continue;
+
+      std::string name = line.substr(0, colon);
+      std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+
+      size_t value_start = line.find_first_not_of(' ', colon + 1);
+      req.m_headers[name] = value_start == std::string::npos ? "" : line.substr(value_start);
+    }
+
+    if (!handle_request(fd, req)) return;
+  }
+}
+
+bool octree_server::handle_request(int fd, const request& req) {
+  m_num_requests++;
+
+  auto connection = req.m_headers.find("connection");
+  std::string connection_value = connection == req.m_headers.end() ? "" : connection->second;
+  std::transform(connection_value.begin(), connection_value.end(), connection_value.begin(), [](unsigned char c) { return std::tolower(c); });
+
+  bool keep_alive = req.m_version == "HTTP/1.1" ? connection_value != "close" : connection_value == "keep-alive";
+
+  // GET and HEAD have no body, anything else would have to be drained first
+  auto content_length = req.m_headers.find("content-length");
+  if (content_length != req.m_headers.end() && content_length->second != "0") keep_alive = false;
+
+  bool head = req.m_method == "HEAD";
+  if (req.m_method != "GET" && !head) {
+    send_response(fd, 405, "text/plain", "method not allowed\n", false, false);
+    return false;
+  }
+
+  std::string path = req.m_target.substr(0, req.m_target.find('?'));
+
+  if (path == "/stats") {
+    return send_response(fd, 200, "application/json", get_stats().dump(2) + "\n", head, keep_alive) && keep_alive;
+  }
+
+  served_file* file = find_file(path);
+  if (file == nullptr) {
+    return send_response(fd, 404, "text/plain", "not found\n", head, keep_alive) && keep_alive;
+  }
+
+  std::string response;
+  int64_t start = 0;
+  int64_t end = file->m_size - 1;
+  bool ranged = false;
+
+  file->m_requests++;
+
+  auto range_header = req.m_headers.find("range");
+  if (range_header != req.m_headers.end() && !parse_range(range_header->second, file->m_size, start, end, ranged)) {
+    response = "HTTP/1.1 416 " + get_status_text(416) + "\r\n"
+      + "Content-Range: bytes */" + std::to_string(file->m_size) + "\r\n"
+      + "Content-Length: 0\r\n"
+      + "Access-Control-Allow-Origin: *\r\n"
+      + "Connection: " + (keep_alive ? "keep-alive" : "close") + "\r\n\r\n";
+
+    return send_all(fd, response.data(), response.size()) && keep_alive;
+  }
+
+  int64_t size = file->m_size == 0 ? 0 : end - start + 1;
+  int status = ranged ? 206 : 200;
+
+  response = "HTTP/1.1 " + std::to_string(status) + " " + get_status_text(status) + "\r\n"
+    + "Content-Type: " + file->m_content_type + "\r\n"
+    + "Content-Length: " + std::to_string(size) + "\r\n"
+    + "Accept-Ranges: bytes\r\n"
+    + "Access-Control-Allow-Origin: *\r\n";
+
+  if (ranged) {
+    response += "Content-Range: bytes " + std::to_string(start) + "-" + std::to_string(end) + "/" + std::to_string(file->m_size) + "\r\n";
+  }
+
+  response += std::string("Connection: ") + (keep_alive ? "keep-alive" : "close") + "\r\n\r\n";
+
+  if (head || size == 0) {
+    return send_all(fd, response.data(), response.size()) && keep_alive;
+  }
+
+  if (!send_all(fd, response.data(), response.size(), SEND_MORE)) return false;
+
+  const pinned_range* pinned = find_pinned(*file, start, end);
+
+  if (pinned != nullptr) {
+    pinned->m_hits++;
+    file->m_pinned_hits++;
+    file->m_pinned_bytes += size;
+
+    if (!send_all(fd, pinned->m_data.data() + (start - pinned->m_offset), size)) return false;
+  }
+  else {
+    file->m_cold_hits++;
+    file->m_cold_bytes += size;
+
+    if (!send_file_range(fd, file->m_fd, start, size)) return false;
+  }
+
+  return keep_alive;
+}
+
+bool octree_server::send_response(int fd, int status, const std::string& content_type, const std::string& body, bool head, bool keep_alive) {
+  std::string response = "HTTP/1.1 " + std::to_string(status) + " " + get_status_text(status) + "\r\n"
+    + "Content-Type: " + content_type + "\r\n"
+    + "Content-Length: " + std::to_string(body.size()) + "\r\n"
+    + "Access-Control-Allow-Origin: *\r\n"
+    + "Connection: " + (keep_alive ? "keep-alive" : "close") + "\r\n\r\n";
+
+  if (!head) response += body;
+
+  return send_all(fd, response.data(), response.size());
+}
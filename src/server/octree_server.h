@@ -0,0 +1,100 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <unordered_set>
+#include <unordered_map>
+#include "nlohmann/json.hpp"
+
+using namespace nlohmann;
+
+namespace potree {
+
+  struct server_options {
+    std::string m_path = ""; // directory of a converted point cloud
+    std::string m_host = "127.0.0.1";
+    int m_port = 8080; // 0 picks a free port, see octree_server::get_port()
+    int m_pinned_levels = 3; // octree levels that are kept in memory
+    int64_t m_max_pinned_bytes = 256 * 1024 * 1024;
+    int m_max_connections = 64;
+  };
+
+  // minimal HTTP/1.1 server for the files of a converted point cloud.
+  // serves metadata.json, hierarchy.bin and octree.bin with single byte range requests, and /stats.
+  // the first hierarchy chunk and the nodes of the top levels are pinned in memory,
+  // all other ranges are sent straight from the page cache with sendfile().
+  // files are matched by name, e.g. "/clouds/a/octree.bin" serves octree.bin.
+  class octree_server {
+  public:
+    octree_server(const server_options& opts);
+    ~octree_server();
+
+    octree_server(const octree_server&) = delete;
+    octree_server& operator=(const octree_server&) = delete;
+
+    // accepts connections until stop() is called
+    void run();
+    void stop();
+
+    int get_port() const { return m_port; }
+    json get_stats() const;
+
+  private:
+    struct pinned_range {
+      std::string m_name;
+      int64_t m_offset = 0;
+      int64_t m_size = 0;
+      std::vector<uint8_t> m_data;
+      mutable std::atomic_int64_t m_hits = 0;
+    };
+
+    struct served_file {
+      std::string m_name;
+      std::string m_path;
+      std::string m_content_type;
+      int m_fd = -1;
+      int64_t m_size = 0;
+      // sorted by offset, ranges don't overlap
+      std::vector<std::unique_ptr<pinned_range>> m_pinned;
+
+      std::atomic_int64_t m_requests = 0;
+      std::atomic_int64_t m_pinned_hits = 0;
+      std::atomic_int64_t m_pinned_bytes = 0;
+      std::atomic_int64_t m_cold_hits = 0;
+      std::atomic_int64_t m_cold_bytes = 0;
+    };
+
+    struct request {
+      std::string m_method;
+      std::string m_target;
+      std::string m_version;
+      std::unordered_map<std::string, std::string> m_headers; // lower case names
+    };
+
+    server_options m_options;
+    int m_port = 0;
+    int m_socket = -1;
+    std::atomic_bool m_running = false;
+    std::atomic_int m_num_connections = 0;
+    std::mutex m_connections_mtx;
+    std::unordered_set<int> m_connections;
+    std::atomic_int64_t m_num_requests = 0;
+    std::vector<std::unique_ptr<served_file>> m_files;
+
+    served_file& add_file(const std::string& name, const std::string& content_type);
+    void pin(served_file& file, const std::string& name, int64_t offset, int64_t size);
+    void pin_levels();
+    const pinned_range* find_pinned(const served_file& file, int64_t start, int64_t end) const;
+    served_file* find_file(const std::string& target) const;
+
+    void handle_connection(int fd);
+    // returns false if the connection has to be closed
+    bool handle_request(int fd, const request& req);
+    bool send_file(int fd, const request& req, served_file& file);
+    bool send_response(int fd, int status, const std::string& content_type, const std::string& body, bool head, bool keep_alive);
+  };
+
+}
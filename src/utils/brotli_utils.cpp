@@ -1,5 +1,6 @@
 #include "brotli_utils.h"
 #include "brotli/encode.h"
+#include "brotli/decode.h"
 #include <string>
 #include <unordered_map>
 
@@ -79,7 +80,7 @@ public:
         for(int64_t i = 0; i < num_points; i++) {
           int64_t point_offset = i * attrs.bytes;
           
-          int16_t r, g, b;
+          uint16_t r, g, b;
           memcpy(&r, source + point_offset + attr_offset + 0, 2);
           memcpy(&g, source + point_offset + attr_offset + 2, 2);
           memcpy(&b, source + point_offset + attr_offset + 4, 2);
@@ -92,8 +93,6 @@ public:
       }
       else if (attr.is_position()) {
         std::vector<int32_t_point> pts;
-        int32_t_point min;
-        min.x = min.y = min.z = std::numeric_limits<int64_t>::max();
 
         for(int64_t i = 0; i < num_points; i++) {
           // MORTON
@@ -107,19 +106,17 @@ public:
           pt.y = XYZ[1];
           pt.z = XYZ[2];
 
-          min.x = std::min(min.x, pt.x);
-          min.y = std::min(min.y, pt.y);
-          min.z = std::min(min.z, pt.z);
-
           pts.push_back(pt);
         }
 
         int64_t i = 0;
 
+        // integer coordinates are encoded as they are, relative to the global offset (the bounding box minimum).
+        // a per-node origin would have to be stored for decoding.
         for(auto& p : pts) {
-          uint32_t mx = p.x - min.x;
-          uint32_t my = p.y - min.y;
-          uint32_t mz = p.z - min.z;
+          uint32_t mx = uint32_t(p.x);
+          uint32_t my = uint32_t(p.y);
+          uint32_t mz = uint32_t(p.z);
 
           uint32_t mx_l = (mx & 0x0000'ffff);
           uint32_t my_l = (my & 0x0000'ffff);
@@ -153,17 +150,16 @@ public:
           
           compr.m_buffers["position_morton"] = mcbuffer;
         }
+      }
+      else {
+        auto buffer = std::make_shared<potree::buffer>(bytes);
 
-        {
-          auto buffer = std::make_shared<potree::buffer>(bytes);
-
-          for (int64_t i = 0; i < num_points; i++) {
-            int64_t pointOffset = i * attrs.bytes;
-            buffer->write(source + pointOffset + attr_offset, attr.size);
-          }
-
-          compr.m_buffers[attr.name] = buffer;
+        for (int64_t i = 0; i < num_points; i++) {
+          int64_t pointOffset = i * attrs.bytes;
+          buffer->write(source + pointOffset + attr_offset, attr.size);
         }
+
+        compr.m_buffers[attr.name] = buffer;
       }
     }
   
@@ -216,8 +212,77 @@ private:
 
 };
 
+// bytes per point of an attribute after morton encoding
+static int64_t get_encoded_size(const attribute& attr) {
+  if (attr.is_position()) return 16;
+  else if (attr.is_rgb()) return 8;
+  return attr.size;
+}
+
 std::shared_ptr<potree::buffer> brotli_utils::compress(const std::shared_ptr<potree::node>& node, const attributes& attrs) {
   auto num_points = node->numPoints;
   auto compr = morton_compressor::create(node, attrs);
   return compr.compress();
 }
+
+
+std::vector<std::shared_ptr<potree::buffer>> brotli_utils::decompress(const uint8_t* data, int64_t size, const attributes& attrs, int64_t num_points) {
+  int64_t encoded_bytes = 0;
+  for (const auto& attr : attrs.m_list) {
+    encoded_bytes += get_encoded_size(attr) * num_points;
+  }
+
+  auto decoded = std::make_shared<potree::buffer>(encoded_bytes);
+  size_t decoded_size = encoded_bytes;
+  auto result = BrotliDecoderDecompress(size, data, &decoded_size, decoded->data_u8);
+
+  if (result != BROTLI_DECODER_RESULT_SUCCESS || int64_t(decoded_size) != encoded_bytes) {
+    throw std::runtime_error("failed to decompress brotli encoded node");
+  }
+
+  // attributes are stored one after another, all in the same (morton) point order,
+  // so every attribute maps to one column
+  std::vector<std::shared_ptr<potree::buffer>> columns;
+  uint8_t* source = decoded->data_u8;
+
+  for (const auto& attr : attrs.m_list) {
+    auto column = std::make_shared<potree::buffer>(attr.size * num_points);
+
+    if (attr.is_position()) {
+      for (int64_t i = 0; i < num_points; i++) {
+        uint64_t mc_h, mc_l;
+        memcpy(&mc_h, source + 16 * i + 0, 8);
+        memcpy(&mc_l, source + 16 * i + 8, 8);
+
+        unsigned int x_h, y_h, z_h, x_l, y_l, z_l;
+        gen_utils::morton_decode(mc_h, x_h, y_h, z_h);
+        gen_utils::morton_decode(mc_l, x_l, y_l, z_l);
+
+        column->data_i32[3 * i + 0] = int32_t((x_h << 16) | x_l);
+        column->data_i32[3 * i + 1] = int32_t((y_h << 16) | y_l);
+        column->data_i32[3 * i + 2] = int32_t((z_h << 16) | z_l);
+      }
+    }
+    else if (attr.is_rgb()) {
+      for (int64_t i = 0; i < num_points; i++) {
+        uint64_t mc;
+        memcpy(&mc, source + 8 * i, 8);
+
+        unsigned int r, g, b;
+        gen_utils::morton_decode(mc, r, g, b);
+
+        column->data_u16[3 * i + 0] = uint16_t(r);
+        column->data_u16[3 * i + 1] = uint16_t(g);
+        column->data_u16[3 * i + 2] = uint16_t(b);
+      }
+    }
+    else {
+      memcpy(column->data, source, attr.size * num_points);
+    }
+
+    columns.push_back(column);
+    source += get_encoded_size(attr) * num_points;
+  }
+
+  return columns;
+}
@@ -6,6 +6,8 @@ namespace potree {
 namespace brotli_utils {
 
   std::shared_ptr<potree::buffer> compress(const std::shared_ptr<potree::node>& node, const attributes& attrs);
+  // inverse of compress(), returns one column per attribute of attrs
+  std::vector<std::shared_ptr<potree::buffer>> decompress(const uint8_t* data, int64_t size, const attributes& attrs, int64_t num_points);
 
 }
 }
\ No newline at end of file
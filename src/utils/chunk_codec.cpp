@@ -0,0 +1,311 @@
+#include <bit>
+#include <stdexcept>
+#include <algorithm>
+#include "chunk_codec.h"
+
+using namespace potree;
+
+// "PCB1"
+static const uint32_t BLOCK_MAGIC = 0x31424350;
+
+static_assert(sizeof(chunk_codec::block_header) == chunk_codec::HEADER_SIZE, "unexpected block header size");
+
+// writes the lowest width bits of each value, returns the number of bytes written
+static int64_t pack(const uint32_t* values, int64_t count, int width, uint8_t* target) {
+  if (width == 0) return 0;
+
+  uint8_t* out = target;
+  uint64_t bits = 0;
+  int num_bits = 0;
+
+  for (int64_t i = 0; i < count; i++) {
+    bits |= uint64_t(values[i]) << num_bits;
+    num_bits += width;
+
+    while (num_bits >= 8) {
+      *out++ = uint8_t(bits);
+      bits >>= 8;
+      num_bits -= 8;
+    }
+  }
+
+  if (num_bits > 0) *out++ = uint8_t(bits);
+
+  return out - target;
+}
+
+static int64_t packed_size(int64_t count, int width) {
+  return (count * width + 7) / 8;
+}
+
+// reads count values of width bits, starting with value first.
+// every value is extracted from one unaligned 64 bit load, only the last few values of a stream take the bounds checked path.
+static void unpack(const uint8_t* source, int64_t size, int width, int64_t first, int64_t count, uint32_t* values) {
+  if (width == 0) {
+    std::fill_n(values, count, 0);
+    return;
+  }
+
+  uint64_t mask = (uint64_t(1) << width) - 1;
+  uint64_t bit = uint64_t(first) * width;
+
+  for (int64_t i = 0; i < count; i++, bit += width) {
+    int64_t byte = int64_t(bit >> 3);
+    uint64_t word = 0;
+
+    if (byte + 8 <= size) {
+      memcpy(&word, source + byte, 8);
+    }
+    else {
+      memcpy(&word, source + byte, size - byte);
+    }
+
+    values[i] = uint32_t((word >> (bit & 7)) & mask);
+  }
+}
+
+chunk_codec::chunk_codec(int64_t bpp, int64_t block_size) {
+  if (bpp < 12) throw std::runtime_error("chunk_codec: points need at least 12 bytes for the position");
+
+  m_bpp = bpp;
+  m_block_size = std::clamp(block_size, int64_t(1), int64_t(1) << 24);
+}
+
+std::shared_ptr<buffer> chunk_codec::encode(const std::vector<std::shared_ptr<buffer>>& data) const {
+  // blocks can't span buffers, so several buffers are concatenated first
+  std::shared_ptr<buffer> points;
+  int64_t num_bytes = 0;
+  int64_t num_buffers = 0;
+
+  for (const auto& b : data) {
+    if (b == nullptr || b->size == 0) continue;
+
+    points = b;
+    num_bytes += b->size;
+    num_buffers++;
+  }
+
+  if (num_buffers > 1) {
+    points = std::make_shared<buffer>(num_bytes);
+
+    for (const auto& b : data) {
+      if (b != nullptr && b->size > 0) points->write(b->data, b->size);
+    }
+  }
+
+  int64_t num_points = num_bytes / m_bpp;
+  int64_t num_blocks = (num_points + m_block_size - 1) / m_block_size;
+  int64_t num_columns = m_bpp - 12;
+  int64_t max_size = num_blocks * (HEADER_SIZE + 3 + num_columns * 2) + num_points * (12 + num_columns);
+
+  auto encoded = std::make_shared<buffer>(std::max(max_size, int64_t(1)));
+  int64_t size = 0;
+
+  for (int64_t first = 0; first < num_points; first += m_block_size) {
+    int64_t count = std::min(m_block_size, num_points - first);
+    size += encode_block(points->data_u8 + first * m_bpp, count, encoded->data_u8 + size);
+  }
+
+  encoded->size = size;
+
+  return encoded;
+}
+
+int64_t chunk_codec::encode_block(const uint8_t* points, int64_t num_points, uint8_t* target) const {
+  thread_local std::vector<uint32_t> values;
+  values.resize(num_points);
+
+  block_header header;
+  header.m_magic = BLOCK_MAGIC;
+  header.m_num_points = uint32_t(num_points);
+  header.m_bpp = uint32_t(m_bpp);
+
+  int32_t min[3] = { INT32_MAX, INT32_MAX, INT32_MAX };
+  for (int64_t i = 0; i < num_points; i++) {
+    int32_t xyz[3];
+    memcpy(xyz, points + i * m_bpp, 12);
+
+    min[0] = std::min(min[0], xyz[0]);
+    min[1] = std::min(min[1], xyz[1]);
+    min[2] = std::min(min[2], xyz[2]);
+  }
+
+  memcpy(header.m_min, min, 12);
+  uint8_t* out = target + HEADER_SIZE;
+
+  // positions, as offsets to the block's minimum
+  for (int axis = 0; axis < 3; axis++) {
+    uint32_t max_offset = 0;
+
+    for (int64_t i = 0; i < num_points; i++) {
+      int32_t value;
+      memcpy(&value, points + i * m_bpp + 4 * axis, 4);
+
+      values[i] = uint32_t(int64_t(value) - int64_t(min[axis]));
+      max_offset = std::max(max_offset, values[i]);
+    }
+
+    int width = std::bit_width(max_offset);
+    *out++ = uint8_t(width);
+    out += pack(values.data(), num_points, width, out);
+  }
+
+  // remaining attribute bytes, one column per byte of the point
+  for (int64_t column = 12; column < m_bpp; column++) {
+    uint8_t base = 255;
+    uint8_t max = 0;
+
+    for (int64_t i = 0; i < num_points; i++) {
+      uint8_t value = points[i * m_bpp + column];
+      base = std::min(base, value);
+      max = std::max(max, value);
+    }
+
+    for (int64_t i = 0; i < num_points; i++) {
+      values[i] = points[i * m_bpp + column] - base;
+    }
+
+    int width = std::bit_width(uint32_t(max - base));
+    *out++ = base;
+    *out++ = uint8_t(width);
+    out += pack(values.data(), num_points, width, out);
+  }
+
+  header.m_payload_size = uint32_t(out - target - HEADER_SIZE);
+  memcpy(target, &header, HEADER_SIZE);
+
+  return out - target;
+}
+
+chunk_codec::block_header chunk_codec::read_header(const uint8_t* data) {
+  block_header header;
+  memcpy(&header, data, HEADER_SIZE);
+
+  if (header.m_magic != BLOCK_MAGIC) {
+    throw std::runtime_error("chunk_codec: invalid block header, the chunk is not compressed or corrupt");
+  }
+
+  return header;
+}
+
+int64_t chunk_codec::get_num_points(const uint8_t* data, int64_t size) {
+  int64_t num_points = 0;
+
+  for (int64_t offset = 0; offset + HEADER_SIZE <= size;) {
+    auto header = read_header(data + offset);
+    num_points += header.m_num_points;
+    offset += HEADER_SIZE + header.m_payload_size;
+  }
+
+  return num_points;
+}
+
+void chunk_codec::decode(const uint8_t* data, int64_t size, uint8_t* target) {
+  for (int64_t offset = 0; offset + HEADER_SIZE <= size;) {
+    auto header = read_header(data + offset);
+
+    if (offset + HEADER_SIZE + header.m_payload_size > size) {
+      throw std::runtime_error("chunk_codec: truncated block");
+    }
+
+    decode_block(header, data + offset + HEADER_SIZE, target);
+
+    offset += HEADER_SIZE + header.m_payload_size;
+    target += int64_t(header.m_num_points) * header.m_bpp;
+  }
+}
+
+std::shared_ptr<buffer> chunk_codec::decode(const uint8_t* data, int64_t size) {
+  int64_t num_bytes = 0;
+
+  for (int64_t offset = 0; offset + HEADER_SIZE <= size;) {
+    auto header = read_header(data + offset);
+    num_bytes += int64_t(header.m_num_points) * header.m_bpp;
+    offset += HEADER_SIZE + header.m_payload_size;
+  }
+
+  auto points = std::make_shared<buffer>(num_bytes);
+  decode(data, size, points->data_u8);
+
+  return points;
+}
+
+void chunk_codec::decode_block(const block_header& header, const uint8_t* payload, uint8_t* target) {
+  // a packed position or attribute byte stream
+  struct stream {
+    const uint8_t* m_data = nullptr;
+    int64_t m_size = 0;
+    int m_width = 0;
+    int64_t m_offset = 0;
+    int32_t m_base = 0;
+  };
+
+  int64_t num_points = header.m_num_points;
+  int64_t bpp = header.m_bpp;
+  const uint8_t* in = payload;
+
+  thread_local std::vector<stream> streams;
+  streams.clear();
+
+  for (int axis = 0; axis < 3; axis++) {
+    stream s;
+    s.m_width = *in++;
+    s.m_data = in;
+    s.m_size = packed_size(num_points, s.m_width);
+    s.m_offset = 4 * axis;
+    s.m_base = header.m_min[axis];
+    streams.push_back(s);
+    in += s.m_size;
+  }
+
+  for (int64_t column = 12; column < bpp; column++) {
+    stream s;
+    s.m_base = *in++;
+    s.m_width = *in++;
+    s.m_data = in;
+    s.m_size = packed_size(num_points, s.m_width);
+    s.m_offset = column;
+    streams.push_back(s);
+    in += s.m_size;
+  }
+
+  // points are decoded in tiles that stay in the L1 cache while every stream is scattered into them
+  const int64_t TILE_SIZE = 256;
+  uint32_t values[TILE_SIZE];
+
+  for (int64_t first = 0; first < num_points; first += TILE_SIZE) {
+    int64_t count = std::min(TILE_SIZE, num_points - first);
+    uint8_t* tile = target + first * bpp;
+
+    for (size_t j = 0; j < streams.size(); j++) {
+      const auto& s = streams[j];
+      uint8_t* out = tile + s.m_offset;
+
+      if (j < 3) {
+        unpack(s.m_data, s.m_size, s.m_width, first, count, values);
+
+        for (int64_t i = 0; i < count; i++) {
+          int32_t value = int32_t(int64_t(s.m_base) + values[i]);
+          memcpy(out + i * bpp, &value, 4);
+        }
+      }
+      else if (s.m_width == 8) {
+        for (int64_t i = 0; i < count; i++) {
+          out[i * bpp] = uint8_t(s.m_base + s.m_data[first + i]);
+        }
+      }
+      else if (s.m_width == 0) {
+        for (int64_t i = 0; i < count; i++) {
+          out[i * bpp] = uint8_t(s.m_base);
+        }
+      }
+      else {
+        unpack(s.m_data, s.m_size, s.m_width, first, count, values);
+
+        for (int64_t i = 0; i < count; i++) {
+          out[i * bpp] = uint8_t(s.m_base + values[i]);
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+#include "common/buffer.h"
+
+namespace potree {
+
+  // compressed encoding of intermediate chunk files.
+  // points are encoded in independent blocks of at most block size points. positions are stored as offsets
+  // to the block's minimum, every other byte of the point as a byte-shuffled column relative to the column's minimum,
+  // and each stream is bit-packed with the width of its largest value. a chunk file is a plain sequence of blocks,
+  // so appending encoded batches to a file keeps it decodable.
+  class chunk_codec {
+  public:
+    static constexpr int64_t DEFAULT_BLOCK_SIZE = 16'384;
+    static constexpr int64_t HEADER_SIZE = 32;
+
+    struct block_header {
+      uint32_t m_magic = 0;
+      uint32_t m_num_points = 0;
+      // bytes following the header
+      uint32_t m_payload_size = 0;
+      uint32_t m_bpp = 0;
+      int32_t m_min[3] = { 0, 0, 0 };
+      uint32_t m_reserved = 0;
+    };
+
+    chunk_codec(int64_t bpp, int64_t block_size = DEFAULT_BLOCK_SIZE);
+
+    int64_t get_block_size() const { return m_block_size; }
+
+    // encodes the points of all buffers, in order, into one buffer of blocks
+    std::shared_ptr<buffer> encode(const std::vector<std::shared_ptr<buffer>>& data) const;
+
+    // number of points in a sequence of blocks, only reads the headers
+    static int64_t get_num_points(const uint8_t* data, int64_t size);
+    // decodes a sequence of blocks into num_points * bpp bytes at target
+    static void decode(const uint8_t* data, int64_t size, uint8_t* target);
+    static std::shared_ptr<buffer> decode(const uint8_t* data, int64_t size);
+    static block_header read_header(const uint8_t* data);
+
+  private:
+    int64_t m_bpp = 0;
+    int64_t m_block_size = DEFAULT_BLOCK_SIZE;
+
+    int64_t encode_block(const uint8_t* points, int64_t num_points, uint8_t* target) const;
+    static void decode_block(const block_header& header, const uint8_t* payload, uint8_t* target);
+  };
+
+}
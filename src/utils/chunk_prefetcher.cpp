@@ -0,0 +1,196 @@
+#include <cmath>
+#include <algorithm>
+#include "geometry/node.h"
+#include "chunk_prefetcher.h"
+#include "chunk_utils.h"
+#include "gen_utils.h"
+
+using namespace potree;
+
+// weight of the latest measurement in the moving averages of read and compute time
+static const double AVERAGE_WEIGHT = 0.2;
+static const size_t MAX_DEPTH = 64;
+
+chunk_prefetcher::chunk_prefetcher(const std::vector<std::shared_ptr<chunk>>& chunks, size_t num_threads, size_t num_consumers, int64_t budget, int64_t bpp) {
+  m_num_consumers = std::max(size_t(1), num_consumers);
+  m_budget = budget;
+
+  for (const auto& c : chunks) {
+    slot s;
+    s.m_chunk = c;
+    s.m_size = chunk_utils::get_num_points(*c, bpp) * bpp;
+    m_index[c.get()] = m_slots.size();
+    m_slots.push_back(s);
+  }
+
+  for (size_t i = 0; i < std::max(size_t(1), num_threads); i++) {
+    m_threads.emplace_back([this]() {
+      read_thread();
+    });
+  }
+}
+
+chunk_prefetcher::~chunk_prefetcher() {
+  close();
+}
+
+void chunk_prefetcher::close() {
+  {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    if (m_closed) return;
+    m_closed = true;
+  }
+
+  m_cv.notify_all();
+
+  for (auto& t : m_threads) {
+    t.join();
+  }
+
+  m_threads.clear();
+
+  MINFO << "chunk_prefetcher: " << m_num_ready << " of " << m_slots.size() << " chunks were ready when taken, "
+    << m_num_waited << " were waited for (" << gen_utils::format_number(m_wait_time) << "s), "
+    << m_num_read_by_consumer << " were read by the workers" << std::endl;
+}
+
+// chunks that are read ahead. a worker needs a new chunk every m_compute_time / m_num_consumers seconds,
+// so a read has to start m_read_time / (m_compute_time / m_num_consumers) chunks ahead to be done in time.
+// there is no compute time until the first chunk is done, until then one chunk per worker is read.
+size_t chunk_prefetcher::get_depth() const {
+  if (m_compute_time <= 0.0) return std::min(m_num_consumers, MAX_DEPTH);
+
+  double depth = std::ceil(double(m_num_consumers) * m_read_time / m_compute_time) + 1.0;
+
+  return std::clamp(size_t(depth), size_t(1), MAX_DEPTH);
+}
+
+bool chunk_prefetcher::can_read_next() const {
+  if (m_next >= m_slots.size()) return false;
+  if (m_in_flight >= get_depth()) return false;
+
+  // a single chunk may exceed the budget, it is read ahead if nothing else is
+  return m_in_flight == 0 || m_bytes_in_flight + m_slots[m_next].m_size <= m_budget;
+}
+
+void chunk_prefetcher::record_read_time(double seconds) {
+  m_read_time = m_read_time <= 0.0 ? seconds : (1.0 - AVERAGE_WEIGHT) * m_read_time + AVERAGE_WEIGHT * seconds;
+}
+
+void chunk_prefetcher::report_compute(double seconds) {
+  std::lock_guard<std::mutex> lock(m_mtx);
+  m_compute_time = m_compute_time <= 0.0 ? seconds : (1.0 - AVERAGE_WEIGHT) * m_compute_time + AVERAGE_WEIGHT * seconds;
+
+  // the depth may have grown
+  m_cv.notify_all();
+}
+
+void chunk_prefetcher::read_thread() {
+  for (;;) {
+    size_t index = 0;
+    std::vector<std::shared_ptr<chunk>> to_advise;
+
+    {
+      std::unique_lock<std::mutex> lock(m_mtx);
+      m_cv.wait(lock, [this]() { return m_closed || m_next >= m_slots.size() || can_read_next(); });
+
+      if (m_closed || m_next >= m_slots.size()) return;
+
+      index = m_next++;
+      auto& s = m_slots[index];
+
+      // taken by a worker before the prefetcher got to it
+      if (s.m_state != slot_state::PENDING) continue;
+
+      s.m_state = slot_state::READING;
+      m_in_flight++;
+      m_bytes_in_flight += s.m_size;
+
+      // the os reads the chunks of the next window while these are read and indexed
+      size_t advise_end = std::min(m_slots.size(), m_next + 2 * get_depth());
+      for (m_advised = std::max(m_advised, m_next); m_advised < advise_end; m_advised++) {
+        to_advise.push_back(m_slots[m_advised].m_chunk);
+      }
+    }
+
+    for (const auto& c : to_advise) {
+      chunk_utils::advise_chunk(*c);
+    }
+
+    double t_start = gen_utils::now();
+    std::shared_ptr<buffer> data;
+    std::exception_ptr error;
+
+    // the worker that takes the chunk gets the error, this thread keeps reading
+    try {
+      data = chunk_utils::read_chunk(*m_slots[index].m_chunk);
+    }
+    catch (...) {
+      error = std::current_exception();
+    }
+
+    double duration = gen_utils::now() - t_start;
+
+    {
+      std::lock_guard<std::mutex> lock(m_mtx);
+      auto& s = m_slots[index];
+      s.m_data = data;
+      s.m_error = error;
+      s.m_state = slot_state::READY;
+      record_read_time(duration);
+    }
+
+    m_cv.notify_all();
+  }
+}
+
+std::shared_ptr<buffer> chunk_prefetcher::take(const chunk& c) {
+  std::unique_lock<std::mutex> lock(m_mtx);
+
+  auto it = m_index.find(&c);
+  if (it == m_index.end()) throw std::runtime_error("chunk_prefetcher::take(): unknown chunk " + c.m_id);
+
+  auto& s = m_slots[it->second];
+
+  if (s.m_state == slot_state::TAKEN) throw std::runtime_error("chunk_prefetcher::take(): chunk " + c.m_id + " was already taken");
+
+  if (s.m_state == slot_state::PENDING) {
+    s.m_state = slot_state::TAKEN;
+    m_num_read_by_consumer++;
+    lock.unlock();
+
+    double t_start = gen_utils::now();
+    auto data = chunk_utils::read_chunk(c);
+    double duration = gen_utils::now() - t_start;
+
+    lock.lock();
+    record_read_time(duration);
+
+    return data;
+  }
+
+  if (s.m_state == slot_state::READING) {
+    double t_start = gen_utils::now();
+    m_cv.wait(lock, [&s]() { return s.m_state == slot_state::READY; });
+    m_wait_time += gen_utils::now() - t_start;
+    m_num_waited++;
+  }
+  else {
+    m_num_ready++;
+  }
+
+  auto data = s.m_data;
+  auto error = s.m_error;
+  s.m_data = nullptr;
+  s.m_error = nullptr;
+  s.m_state = slot_state::TAKEN;
+  m_in_flight--;
+  m_bytes_in_flight -= s.m_size;
+
+  lock.unlock();
+  m_cv.notify_all();
+
+  if (error) std::rethrow_exception(error);
+
+  return data;
+}
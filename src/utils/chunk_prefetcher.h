@@ -0,0 +1,74 @@
+#pragma once
+
+#include <mutex>
+#include <exception>
+#include <thread>
+#include <condition_variable>
+#include <unordered_map>
+#include "common/buffer.h"
+#include "geometry/chunk.h"
+
+namespace potree {
+
+  // reads chunks ahead of the indexing workers, so that reading and indexing overlap instead of alternating.
+  // chunks are read in the order of the list, into at most budget bytes of decoded points. how many chunks are read ahead follows
+  // the measured read and compute times: enough reads to last until the workers are done with their current chunks.
+  // the chunks after those are announced to the os with posix_fadvise, so their reads start from the page cache.
+  class chunk_prefetcher {
+  public:
+    // num_threads: reading threads, num_consumers: workers that take chunks, bpp: bytes per point
+    chunk_prefetcher(const std::vector<std::shared_ptr<chunk>>& chunks, size_t num_threads, size_t num_consumers, int64_t budget, int64_t bpp);
+    ~chunk_prefetcher();
+
+    // points of a chunk of the list. waits if the chunk is being read, reads it on the calling thread
+    // if the prefetcher didn't get to it yet. every chunk can be taken once. a failed read is rethrown here.
+    std::shared_ptr<buffer> take(const chunk& c);
+    // time a worker spent on a chunk after it took it
+    void report_compute(double seconds);
+    void close();
+
+  private:
+    enum class slot_state { PENDING, READING, READY, TAKEN };
+
+    struct slot {
+      std::shared_ptr<chunk> m_chunk;
+      slot_state m_state = slot_state::PENDING;
+      std::shared_ptr<buffer> m_data;
+      std::exception_ptr m_error;
+      // bytes of the decoded points, compressed chunks take more memory than their file size
+      int64_t m_size = 0;
+    };
+
+    std::vector<slot> m_slots;
+    std::unordered_map<const chunk*, size_t> m_index;
+    std::vector<std::thread> m_threads;
+    std::mutex m_mtx;
+    std::condition_variable m_cv;
+    size_t m_num_consumers = 1;
+    int64_t m_budget = 0;
+    bool m_closed = false;
+
+    // next slot to read, number of slots read or being read but not taken, and their size
+    size_t m_next = 0;
+    size_t m_in_flight = 0;
+    int64_t m_bytes_in_flight = 0;
+    // slots up to this one were passed to advise_chunk
+    size_t m_advised = 0;
+
+    // moving averages of the seconds a chunk takes to read and to index
+    double m_read_time = 0.0;
+    double m_compute_time = 0.0;
+
+    // statistics for the summary at close
+    size_t m_num_ready = 0;
+    size_t m_num_waited = 0;
+    size_t m_num_read_by_consumer = 0;
+    double m_wait_time = 0.0;
+
+    void read_thread();
+    size_t get_depth() const;
+    bool can_read_next() const;
+    void record_read_time(double seconds);
+  };
+
+}
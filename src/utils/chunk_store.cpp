@@ -0,0 +1,324 @@
+#include <stdexcept>
+#include <filesystem>
+#include "chunk_store.h"
+#include "file_utils.h"
+
+#if defined(_WIN32)
+// keeps windows.h from defining min and max macros, which break std::min and std::max
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#endif
+
+using namespace potree;
+
+const std::string chunk_store::PACK_FILE = "chunks.pack";
+const std::string chunk_store::INDEX_FILE = "chunks.index.json";
+
+// the pack file is extended in steps of at least this size, so appends rarely change its size
+static const int64_t PREALLOCATION_STEP = 256ll * 1024 * 1024;
+
+#if defined(_WIN32)
+
+struct io_slice {
+  uint8_t* m_data = nullptr;
+  int64_t m_size = 0;
+};
+
+static void* open_file(const std::string& path, bool write, bool truncate) {
+  DWORD access = write ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ;
+  DWORD disposition = write ? (truncate ? CREATE_ALWAYS : OPEN_ALWAYS) : OPEN_EXISTING;
+  HANDLE file = CreateFileA(path.c_str(), access, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, disposition, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) throw std::runtime_error("failed to open " + path);
+
+  return file;
+}
+
+static void close_file(void* file) {
+  CloseHandle(file);
+}
+
+static void resize_file(void* file, int64_t size, const std::string& path) {
+  LARGE_INTEGER position;
+  position.QuadPart = size;
+
+  if (!SetFilePointerEx(file, position, nullptr, FILE_BEGIN) || !SetEndOfFile(file)) {
+    throw std::runtime_error("failed to resize " + path);
+  }
+}
+
+// positional reads and writes, one call per slice
+static void transfer(void* file, std::vector<io_slice>& slices, int64_t offset, bool write, const std::string& path) {
+  for (auto& slice : slices) {
+    int64_t done = 0;
+
+    while (done < slice.m_size) {
+      OVERLAPPED overlapped = {};
+      overlapped.Offset = DWORD((offset + done) & 0xFFFFFFFF);
+      overlapped.OffsetHigh = DWORD((offset + done) >> 32);
+      DWORD count = DWORD(std::min(slice.m_size - done, int64_t(1) << 30));
+      DWORD transferred = 0;
+
+      BOOL ok = write
+        ? WriteFile(file, slice.m_data + done, count, &transferred, &overlapped)
+        : ReadFile(file, slice.m_data + done, count, &transferred, &overlapped);
+
+      if (!ok || transferred == 0) throw std::runtime_error("i/o error on " + path);
+
+      done += transferred;
+    }
+
+    offset += slice.m_size;
+  }
+}
+
+#else
+
+typedef iovec io_slice;
+
+static int open_file(const std::string& path, bool write, bool truncate) {
+  int flags = write ? (O_RDWR | O_CREAT | (truncate ? O_TRUNC : 0)) : O_RDONLY;
+  int fd = open(path.c_str(), flags, 0644);
+  if (fd < 0) throw std::runtime_error("failed to open " + path);
+
+  return fd;
+}
+
+static void close_file(int fd) {
+  close(fd);
+}
+
+static void resize_file(int fd, int64_t size, const std::string& path) {
+  if (ftruncate(fd, size) != 0) throw std::runtime_error("failed to resize " + path);
+}
+
+// preadv/pwritev in groups of at most IOV_MAX slices, continuing after partial transfers
+static void transfer(int fd, std::vector<iovec>& slices, int64_t offset, bool write, const std::string& path) {
+  size_t first = 0;
+
+  while (first < slices.size()) {
+    int count = int(std::min(slices.size() - first, size_t(IOV_MAX)));
+    ssize_t transferred = write
+      ? pwritev(fd, slices.data() + first, count, offset)
+      : preadv(fd, slices.data() + first, count, offset);
+
+    if (transferred < 0 && errno == EINTR) continue;
+    if (transferred <= 0) throw std::runtime_error("i/o error on " + path);
+
+    offset += transferred;
+
+    while (transferred > 0) {
+      auto& slice = slices[first];
+
+      if (size_t(transferred) >= slice.iov_len) {
+        transferred -= slice.iov_len;
+        first++;
+      }
+      else {
+        slice.iov_base = static_cast<uint8_t*>(slice.iov_base) + transferred;
+        slice.iov_len -= transferred;
+        transferred = 0;
+      }
+    }
+  }
+}
+
+#endif
+
+static io_slice make_slice(uint8_t* data, int64_t size) {
+  io_slice slice;
+#if defined(_WIN32)
+  slice.m_data = data;
+  slice.m_size = size;
+#else
+  slice.iov_base = data;
+  slice.iov_len = size_t(size);
+#endif
+  return slice;
+}
+
+// closes a file of open_file when it goes out of scope, also if a transfer throws
+template<typename file_t>
+struct scoped_file {
+  file_t m_file;
+
+  explicit scoped_file(file_t file) : m_file(file) {}
+  ~scoped_file() { close_file(m_file); }
+
+  scoped_file(const scoped_file&) = delete;
+  scoped_file& operator=(const scoped_file&) = delete;
+};
+
+chunk_store::chunk_store(const std::string& chunk_dir, bool append) {
+  m_dir = chunk_dir;
+
+  if (append && exists(chunk_dir)) {
+    m_index = read_index(chunk_dir);
+  }
+  else {
+    append = false;
+  }
+
+  std::string path = m_dir + "/" + PACK_FILE;
+  m_file = open_file(path, true, !append);
+
+  if (append) {
+    m_end = int64_t(std::filesystem::file_size(path));
+    m_allocated = m_end;
+  }
+}
+
+chunk_store::~chunk_store() {
+  close();
+}
+
+void chunk_store::reserve(int64_t end) {
+  if (end <= m_allocated) return;
+
+  int64_t size = std::max(end, m_allocated + PREALLOCATION_STEP);
+  std::string path = m_dir + "/" + PACK_FILE;
+
+#if defined(__linux__)
+  // file systems without fallocate support fall back to a sparse extension
+  if (posix_fallocate(m_file, m_allocated, size - m_allocated) != 0) {
+    resize_file(m_file, size, path);
+  }
+#else
+  resize_file(m_file, size, path);
+#endif
+
+  m_allocated = size;
+}
+
+void chunk_store::append(const std::string& id, const std::vector<std::shared_ptr<buffer>>& data) {
+  std::vector<io_slice> slices;
+  int64_t size = 0;
+
+  for (const auto& b : data) {
+    if (b == nullptr || b->size == 0) continue;
+
+    slices.push_back(make_slice(b->data_u8, b->size));
+    size += b->size;
+  }
+
+  if (size == 0) return;
+
+  int64_t offset = 0;
+  {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    if (m_closed) throw std::runtime_error("Cannot append chunk " + id + ": chunk store is closed");
+
+    offset = m_end;
+    m_end += size;
+    reserve(m_end);
+    m_index[id].push_back({ offset, size });
+  }
+
+  transfer(m_file, slices, offset, true, m_dir + "/" + PACK_FILE);
+}
+
+std::vector<chunk_extent> chunk_store::get_extents(const std::string& id) {
+  std::lock_guard<std::mutex> lock(m_mtx);
+  auto it = m_index.find(id);
+
+  return it != m_index.end() ? it->second : std::vector<chunk_extent>();
+}
+
+void chunk_store::remove(const std::string& id) {
+  std::lock_guard<std::mutex> lock(m_mtx);
+  m_index.erase(id);
+}
+
+void chunk_store::close() {
+  std::lock_guard<std::mutex> lock(m_mtx);
+  if (m_closed) return;
+
+  m_closed = true;
+  resize_file(m_file, m_end, m_dir + "/" + PACK_FILE);
+  close_file(m_file);
+
+  json js;
+  js["pack"] = PACK_FILE;
+  js["size"] = m_end;
+  js["chunks"] = json::object();
+
+  for (const auto& [id, extents] : m_index) {
+    json js_extents = json::array();
+    for (const auto& extent : extents) {
+      js_extents.push_back({ extent.m_offset, extent.m_size });
+    }
+
+    js["chunks"][id] = js_extents;
+  }
+
+  file_utils::write_text(m_dir + "/" + INDEX_FILE, js.dump());
+}
+
+bool chunk_store::exists(const std::string& chunk_dir) {
+  return std::filesystem::exists(chunk_dir + "/" + INDEX_FILE);
+}
+
+std::unordered_map<std::string, std::vector<chunk_extent>> chunk_store::read_index(const std::string& chunk_dir) {
+  json js = file_utils::read_json(chunk_dir + "/" + INDEX_FILE);
+  std::unordered_map<std::string, std::vector<chunk_extent>> index;
+
+  for (const auto& [id, js_extents] : js["chunks"].items()) {
+    auto& extents = index[id];
+
+    for (const auto& js_extent : js_extents) {
+      extents.push_back({ js_extent[0].get<int64_t>(), js_extent[1].get<int64_t>() });
+    }
+  }
+
+  return index;
+}
+
+void chunk_store::read(const chunk& c, int64_t start, int64_t size, uint8_t* target) {
+  std::vector<io_slice> slices;
+  int64_t extent_start = 0;
+  int64_t end = start + size;
+  int64_t offset = -1;
+  int64_t expected_offset = -1;
+  int64_t size_read = 0;
+
+  scoped_file file(open_file(c.m_file, false, false));
+
+  // adjacent extents are read with one vectored call, a gap in the pack file starts a new one
+  auto flush = [&]() {
+    if (!slices.empty()) transfer(file.m_file, slices, offset, false, c.m_file);
+    slices.clear();
+  };
+
+  for (const auto& extent : c.m_extents) {
+    int64_t extent_end = extent_start + extent.m_size;
+    int64_t first = std::max(start, extent_start);
+    int64_t last = std::min(end, extent_end);
+
+    if (first < last) {
+      int64_t file_offset = extent.m_offset + (first - extent_start);
+
+      if (file_offset != expected_offset) {
+        flush();
+        offset = file_offset;
+      }
+
+      slices.push_back(make_slice(target + size_read, last - first));
+      size_read += last - first;
+      expected_offset = file_offset + (last - first);
+    }
+
+    extent_start = extent_end;
+  }
+
+  flush();
+}
+
+void chunk_store::remove_files(const std::string& chunk_dir) {
+  std::filesystem::remove(chunk_dir + "/" + PACK_FILE);
+  std::filesystem::remove(chunk_dir + "/" + INDEX_FILE);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <mutex>
+#include <unordered_map>
+#include "common/buffer.h"
+#include "geometry/chunk.h"
+
+namespace potree {
+
+  // packed alternative to one .bin file per chunk.
+  // all chunks are appended to chunks/chunks.pack, which grows in preallocated steps,
+  // every append becomes one extent of its chunk and chunks/chunks.index.json lists the extents of each chunk.
+  // extents are written and read with vectored i/o, so distributing and loading chunks doesn't touch the file system
+  // metadata once per chunk.
+  class chunk_store {
+  public:
+    static const std::string PACK_FILE;
+    static const std::string INDEX_FILE;
+
+    // opens the store in chunk_dir. an existing store is replaced unless append is set
+    chunk_store(const std::string& chunk_dir, bool append = false);
+    ~chunk_store();
+
+    chunk_store(const chunk_store&) = delete;
+    chunk_store& operator=(const chunk_store&) = delete;
+
+    // appends the buffers as one extent of the chunk.
+    // space is reserved under a lock, the write itself runs concurrently with other appends.
+    void append(const std::string& id, const std::vector<std::shared_ptr<buffer>>& data);
+    // extents of the chunk that were appended so far
+    std::vector<chunk_extent> get_extents(const std::string& id);
+    // drops the chunk from the index, its extents remain as unused space in the pack file
+    void remove(const std::string& id);
+    // trims the preallocated tail of the pack file and writes the index
+    void close();
+
+    static bool exists(const std::string& chunk_dir);
+    static std::unordered_map<std::string, std::vector<chunk_extent>> read_index(const std::string& chunk_dir);
+    // reads size bytes, starting at byte start of the concatenated extents of c, into target
+    static void read(const chunk& c, int64_t start, int64_t size, uint8_t* target);
+    static void remove_files(const std::string& chunk_dir);
+
+  private:
+    std::string m_dir;
+    std::mutex m_mtx;
+    std::unordered_map<std::string, std::vector<chunk_extent>> m_index;
+    int64_t m_end = 0;
+    int64_t m_allocated = 0;
+    bool m_closed = false;
+
+#if defined(_WIN32)
+    void* m_file = nullptr;
+#else
+    int m_file = -1;
+#endif
+
+    void reserve(int64_t end);
+  };
+
+}
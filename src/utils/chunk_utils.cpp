@@ -1,22 +1,38 @@
 #include <filesystem>
+#include <execution>
+#include <numeric>
 #include "geometry/node.h"
 #include "common/task.h"
+#include "common/executor.h"
 #include "chunk_utils.h"
+#include "chunk_store.h"
+#include "chunk_codec.h"
 #include "file_utils.h"
+#include "io_utils.h"
 #include "attribute_utils.h"
 #include "string_utils.h"
 #include "las_utils.h"
+#include "numa_utils.h"
 
 using namespace potree;
 
 static const int64_t MAX_POINTS_PER_CHUNK = 10'000'000;
+// counting grid and window size of the refinement of oversized chunks
+static const int64_t REFINE_GRID_SIZE = 128;
+static const int64_t REFINE_BATCH_SIZE = 1'000'000;
+static const int64_t REFINE_MAX_BACKLOG_MB = 1'000;
 
-void write_metadata(const std::string& path, const vector3& min, const vector3& max, const attributes& attrs) {
+void write_metadata(const std::string& path, const vector3& min, const vector3& max, const attributes& attrs, const std::shared_ptr<chunk_codec>& codec) {
 	json js;
 
 	js["min"] = { min.x, min.y, min.z };
 	js["max"] = { max.x, max.y, max.z };
 
+	js["encoding"] = codec != nullptr ? "COMPRESSED" : "RAW";
+	if (codec != nullptr) {
+		js["blockSize"] = codec->get_block_size();
+	}
+
 	js["attributes"] = {};
 	for (const auto& attribute : attrs.m_list) {
 
@@ -45,6 +61,16 @@ void write_metadata(const std::string& path, const vector3& min, const vector3&
 			js_attr["offset"] = std::vector<double>{ attribute.offset.x, attribute.offset.y, attribute.offset.z };
 		}
 
+		// 64 bit integers keep their exact range
+		int numRangeElements = std::min(attribute.numElements, 3);
+		if (attribute.has_int64_range()) {
+			js_attr["min"] = std::vector<int64_t>(attribute.min_int64.begin(), attribute.min_int64.begin() + numRangeElements);
+			js_attr["max"] = std::vector<int64_t>(attribute.max_int64.begin(), attribute.max_int64.begin() + numRangeElements);
+		} else if (attribute.has_uint64_range()) {
+			js_attr["min"] = std::vector<uint64_t>(attribute.min_uint64.begin(), attribute.min_uint64.begin() + numRangeElements);
+			js_attr["max"] = std::vector<uint64_t>(attribute.max_uint64.begin(), attribute.max_uint64.begin() + numRangeElements);
+		}
+
 		bool emptyHistogram = true;
 		for(int i = 0; i < attribute.histogram.size(); i++){
 			if(attribute.histogram[i] != 0){
@@ -76,143 +102,273 @@ void write_metadata(const std::string& path, const vector3& min, const vector3&
 	file_utils::write_text(path, content);
 }
 
-void for_xyz(int64_t size, std::function<void(int64_t, int64_t, int64_t)> callback) {
-  for(int64_t x = 0; x < size; x++) {
-    for(int64_t y = 0; y < size; y++) {
-      for(int64_t z = 0; z < size; z++) {
-        callback(x, y, z);
-      }
-    }
-  }
-}
-
 struct refine_task : public task {
   int64_t start = 0;
   int64_t size = 0;
   int64_t numPoints = 0;
 };
 
-struct grid_info {
-  int64_t m_high;
-  int64_t m_low;
-  int64_t m_size_low;
-  int64_t m_size_high;
-  int64_t m_level_low;
-  int64_t m_level_max;
-  int64_t m_level_high;
-  std::vector<int64_t> m_grid_high;
-  std::vector<int64_t> m_grid_low;
-  int64_t m_max_points_per_chunk = 5'000'000;
-  std::vector<potree::node> m_nodes;
-};
+// runs callback(i) for i in [0, count) on the parallel execution policy.
+// used to split grid passes into independent slabs along z.
+template<typename F>
+static void for_each_slab(int64_t count, F&& callback) {
+  std::vector<int64_t> slabs(count);
+  std::iota(slabs.begin(), slabs.end(), int64_t(0));
+  std::for_each(std::execution::par, slabs.begin(), slabs.end(), callback);
+}
 
-void process_grid(grid_info& info, int64_t x, int64_t y, int64_t z) {
-  int64_t size_high = info.m_size_high;
-  int64_t idx_low = x + y * info.m_size_low + z * info.m_size_low * info.m_size_low;
-  int64_t sum = 0;
-  int64_t max = 0;
-  bool mergeable = true;
- 
-  // loop through the 8 enclosed cells of the higher detailed grid
-  for(int64_t j = 0; j < 8; j++) {
-    int64_t ox = (j & 0b100) >> 2;
-    int64_t oy = (j & 0b010) >> 1;
-    int64_t oz = (j & 0b001) >> 0;
-
-    int64_t nx = 2 * x + ox;
-    int64_t ny = 2 * y + oy;
-    int64_t nz = 2 * z + oz;
-    int64_t index_high = nx + ny * size_high + nz * size_high * size_high;
-
-    int64_t value = info.m_grid_high[index_high];
-
-    if (value == -1) {
-      mergeable = false;
-    } else {
-      sum += value;
+static inline int64_t cell_value(const std::atomic_int32_t& value) { return value.load(std::memory_order_relaxed); }
+static inline int64_t cell_value(int64_t value) { return value; }
+
+// evaluates one level of the counting pyramid.
+// every cell of the lower detail grid sums up its 8 enclosed cells of the higher detail grid.
+// cells that can't be merged (too many points, or an enclosed cell is already unmergeable)
+// are flagged with -1 and their non-empty enclosed cells become chunks.
+// chunks are collected per slab and appended in slab order, so the node order is deterministic.
+template<typename T>
+static void reduce_level(const T* grid_high, std::vector<int64_t>& grid_low, int64_t level_high, int64_t level_max, int64_t max_points_per_chunk, std::vector<potree::node>& nodes) {
+  int64_t size_high = int64_t(1) << level_high;
+  int64_t size_low = size_high / 2;
+  int64_t node_size = int64_t(1) << (level_max - level_high);
+  std::vector<std::vector<potree::node>> slab_nodes(size_low);
+
+  for_each_slab(size_low, [&](int64_t z) {
+    auto& emitted = slab_nodes[z];
+
+    for (int64_t y = 0; y < size_low; y++) {
+      // the 4 rows of the higher detail grid enclosed by row (y, z) of the lower detail grid
+      const T* rows[4] = {
+        grid_high + (2 * y + 0) * size_high + (2 * z + 0) * size_high * size_high,
+        grid_high + (2 * y + 1) * size_high + (2 * z + 0) * size_high * size_high,
+        grid_high + (2 * y + 0) * size_high + (2 * z + 1) * size_high * size_high,
+        grid_high + (2 * y + 1) * size_high + (2 * z + 1) * size_high * size_high,
+      };
+      int64_t* row_low = grid_low.data() + y * size_low + z * size_low * size_low;
+
+      for (int64_t x = 0; x < size_low; x++) {
+        int64_t values[8] = {
+          cell_value(rows[0][2 * x]), cell_value(rows[0][2 * x + 1]),
+          cell_value(rows[1][2 * x]), cell_value(rows[1][2 * x + 1]),
+          cell_value(rows[2][2 * x]), cell_value(rows[2][2 * x + 1]),
+          cell_value(rows[3][2 * x]), cell_value(rows[3][2 * x + 1]),
+        };
+
+        int64_t sum = 0;
+        bool mergeable = true;
+        for (int64_t j = 0; j < 8; j++) {
+          mergeable = mergeable && values[j] >= 0;
+          sum += values[j];
+        }
+
+        if (mergeable && sum <= max_points_per_chunk) {
+          row_low[x] = sum;
+          continue;
+        }
+
+        // finished chunks, in the same child order as bounding_box::child_of()
+        for (int64_t j = 0; j < 8; j++) {
+          int64_t ox = (j & 0b100) >> 2;
+          int64_t oy = (j & 0b010) >> 1;
+          int64_t oz = (j & 0b001) >> 0;
+          int64_t value = values[ox + 2 * oy + 4 * oz];
+
+          if (value <= 0) continue;
+
+          int64_t nx = 2 * x + ox;
+          int64_t ny = 2 * y + oy;
+          int64_t nz = 2 * z + oz;
+
+          std::string node_id = chunk_utils::build_id(level_high, size_high, nx, ny, nz);
+          potree::node node(node_id, value);
+          node.x = nx;
+          node.y = ny;
+          node.z = nz;
+          node.size = node_size;
+          emitted.push_back(node);
+        }
+
+        // invalidate the field to show the parent that nothing can be merged with it
+        row_low[x] = -1;
+      }
     }
+  });
 
-    max = std::max(max, value);
+  for (auto& emitted : slab_nodes) {
+    nodes.insert(nodes.end(), emitted.begin(), emitted.end());
   }
+}
+
+// sparse counterpart of reduce_level(), over cells sorted by morton code.
+// the 8 enclosed cells of a lower detail cell share the morton prefix code >> 3,
+// so they are adjacent in the sorted list and each level is a single linear pass.
+// absent cells are empty, the resulting grid is sorted by morton code again.
+static void reduce_level_sparse(const sparse_grid& grid_high, sparse_grid& grid_low, int64_t level_high, int64_t level_max, int64_t max_points_per_chunk, std::vector<potree::node>& nodes) {
+  int64_t size_high = int64_t(1) << level_high;
+  int64_t node_size = int64_t(1) << (level_max - level_high);
+
+  for (size_t i = 0; i < grid_high.size();) {
+    uint64_t parent = grid_high[i].m_code >> 3;
+    size_t first = i;
+    int64_t sum = 0;
+    bool mergeable = true;
+
+    for (; i < grid_high.size() && (grid_high[i].m_code >> 3) == parent; i++) {
+      mergeable = mergeable && grid_high[i].m_count >= 0;
+      sum += grid_high[i].m_count;
+    }
+
+    if (mergeable && sum <= max_points_per_chunk) {
+      grid_low.push_back({ parent, sum });
+      continue;
+    }
 
-  if (!mergeable || sum > info.m_max_points_per_chunk) {
     // finished chunks
-    for (int64_t j = 0; j < 8; j++) {
-      int64_t ox = (j & 0b100) >> 2;
-      int64_t oy = (j & 0b010) >> 1;
-      int64_t oz = (j & 0b001) >> 0;
-      int64_t nx = 2 * x + ox;
-      int64_t ny = 2 * y + oy;
-      int64_t nz = 2 * z + oz;
-
-      int64_t index_high = nx + ny * size_high + nz * size_high * size_high;
-      int64_t value = info.m_grid_high[index_high];
-
-      if (value > 0) {
-        std::string nodeID = chunk_utils::build_id(info.m_level_high, size_high, nx, ny, nz);
-        potree::node node(nodeID, value);
-        node.x = nx;
-        node.y = ny;
-        node.z = nz;
-        node.size = pow(2, (info.m_level_max - info.m_level_high));
-        info.m_nodes.push_back(node);
-      }
+    for (size_t j = first; j < i; j++) {
+      int64_t value = grid_high[j].m_count;
+      if (value <= 0) continue;
+
+      unsigned int nx, ny, nz;
+      gen_utils::morton_decode(grid_high[j].m_code, nx, ny, nz);
+
+      std::string node_id = chunk_utils::build_id(level_high, size_high, nx, ny, nz);
+      potree::node node(node_id, value);
+      node.x = nx;
+      node.y = ny;
+      node.z = nz;
+      node.size = node_size;
+      nodes.push_back(node);
     }
 
     // invalidate the field to show the parent that nothing can be merged with it
-    info.m_grid_low[idx_low] = -1;
-  }
-  else {
-    info.m_grid_low[idx_low] = sum;
+    grid_low.push_back({ parent, -1 });
   }
 }
 
 struct node_lookup_table {
 public:
-  int64_t m_grid_size;
+  int64_t m_grid_size = 0;
   std::vector<int32_t> m_grid;
+  std::vector<potree::node> m_nodes;
 
-  static node_lookup_table create(std::vector<std::atomic_int32_t>& grid, int64_t grid_size) {
+  // sparse tables map sorted, disjoint morton code ranges to nodes instead of storing grid_size³ cells
+  bool m_sparse = false;
+  int64_t m_grid_bits = 0;
+  std::vector<uint64_t> m_range_begin;
+  std::vector<uint64_t> m_range_end;
+  std::vector<int32_t> m_range_node;
+
+  // node index of the cell at the given linear grid index, or -1
+  inline int32_t find(int64_t index) const {
+    if (!m_sparse) return m_grid[index];
+
+    int64_t mask = m_grid_size - 1;
+    unsigned int x = (unsigned int)(index & mask);
+    unsigned int y = (unsigned int)((index >> m_grid_bits) & mask);
+    unsigned int z = (unsigned int)(index >> (2 * m_grid_bits));
+    uint64_t code = gen_utils::morton_encode(x, y, z);
+
+    auto it = std::upper_bound(m_range_begin.begin(), m_range_begin.end(), code);
+    if (it == m_range_begin.begin()) return -1;
+
+    size_t range = (it - m_range_begin.begin()) - 1;
+
+    return code < m_range_end[range] ? m_range_node[range] : -1;
+  }
+
+  static node_lookup_table create(sparse_grid grid, int64_t grid_size, int64_t max_points_per_chunk = 5'000'000) {
+    gen_utils::profiler pr("node_lookup_table::create(sparse)");
+    int64_t level_max = int64_t(log2(grid_size));
+    std::vector<potree::node> nodes;
+
+    for (int64_t level_low = level_max - 1; level_low >= 0; level_low--) {
+      sparse_grid grid_low;
+      grid_low.reserve(grid.size() / 2);
+      reduce_level_sparse(grid, grid_low, level_low + 1, level_max, max_points_per_chunk, nodes);
+      grid = std::move(grid_low);
+    }
+
+    // a node of size s at (x, y, z) covers the morton codes [morton(x, y, z) * s³, (morton(x, y, z) + 1) * s³)
+    std::vector<int32_t> order(nodes.size());
+    std::vector<uint64_t> begins(nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++) {
+      int64_t shift = 3 * int64_t(log2(nodes[i].size));
+      order[i] = int32_t(i);
+      begins[i] = gen_utils::morton_encode(nodes[i].x, nodes[i].y, nodes[i].z) << shift;
+    }
+
+    std::sort(order.begin(), order.end(), [&begins](int32_t a, int32_t b) { return begins[a] < begins[b]; });
+
+    node_lookup_table table;
+    table.m_grid_size = grid_size;
+    table.m_grid_bits = level_max;
+    table.m_sparse = true;
+
+    for (int32_t i : order) {
+      uint64_t size = uint64_t(nodes[i].size);
+      table.m_range_begin.push_back(begins[i]);
+      table.m_range_end.push_back(begins[i] + size * size * size);
+      table.m_range_node.push_back(i);
+    }
+
+    table.m_nodes = std::move(nodes);
+
+    return table;
+  }
+
+  static node_lookup_table create(std::vector<std::atomic_int32_t>& grid, int64_t grid_size, int64_t max_points_per_chunk = 5'000'000) {
     gen_utils::profiler pr("node_lookup_table::create()");
-    grid_info info;
-    info.m_grid_high.reserve(grid.size());
-    info.m_grid_high.insert(info.m_grid_high.begin(), grid.begin(), grid.end());
-    info.m_level_max= int64_t(log2(grid_size));
+    int64_t level_max = int64_t(log2(grid_size));
+    std::vector<potree::node> nodes;
+    std::vector<int64_t> grid_high;
 
 		// - evaluate counting grid in "image pyramid" fashion
 		// - merge smaller cells into larger ones
 		// - unmergeable cells are resulting chunks; push them to "nodes" array.
-    for(info.m_level_low = info.m_level_max - 1; info.m_level_low >= 0; info.m_level_low--) {
-      info.m_level_high = info.m_level_low + 1;
-      info.m_size_high = pow(2, info.m_level_high);
-      info.m_size_low = pow(2, info.m_level_low);
-      std::vector<int64_t> grid_low(info.m_size_low * info.m_size_low * info.m_size_low, 0);
-
-      // loop through all cells of the lower detail target grid, 
-      // and for each cell through the 8 enclosed cells of the higher level grid.
-      for_xyz(info.m_size_low, [&info](int64_t x, int64_t y, int64_t z){
-        process_grid(info, x, y, z);
-      });
+    // the first level reads the atomic counters directly, so the full resolution grid is never copied.
+    for (int64_t level_low = level_max - 1; level_low >= 0; level_low--) {
+      int64_t size_low = int64_t(1) << level_low;
+      std::vector<int64_t> grid_low(size_low * size_low * size_low, 0);
+
+      if (level_low == level_max - 1) {
+        reduce_level(grid.data(), grid_low, level_low + 1, level_max, max_points_per_chunk, nodes);
+      }
+      else {
+        reduce_level(grid_high.data(), grid_low, level_low + 1, level_max, max_points_per_chunk, nodes);
+      }
 
-      info.m_grid_high = info.m_grid_low;
+      grid_high = std::move(grid_low);
     }
 
     // - create lookup table
 		// - loop through nodes, add pointers to node/chunk for all enclosed cells in LUT.
-    std::vector<int32_t> lut(grid_size * grid_size * grid_size, -1);
-    for(size_t i = 0; i < info.m_nodes.size(); i++) {
-      auto& node = info.m_nodes[i];
-
-      for_xyz(node.size, [&node, &lut, grid_size, i](int64_t ox, int64_t oy, int64_t oz) {
-      	int64_t x = node.size * node.x + ox;
-				int64_t y = node.size * node.y + oy;
-				int64_t z = node.size * node.z + oz;
-				int64_t index = x + y * grid_size + z * grid_size * grid_size;
-				lut[index] = i;
-      });
-    }
+    // nodes cover disjoint cells, so they can be written in parallel, one x-run at a time.
+    int64_t num_cells = grid_size * grid_size * grid_size;
+    std::vector<int32_t> lut(num_cells);
+
+    for_each_slab(grid_size, [&lut, grid_size](int64_t z) {
+      std::fill_n(lut.data() + z * grid_size * grid_size, grid_size * grid_size, int32_t(-1));
+    });
+
+    for_each_slab(nodes.size(), [&nodes, &lut, grid_size](int64_t i) {
+      auto& node = nodes[i];
+
+      for (int64_t oz = 0; oz < node.size; oz++) {
+        for (int64_t oy = 0; oy < node.size; oy++) {
+          int64_t x = node.size * node.x;
+          int64_t y = node.size * node.y + oy;
+          int64_t z = node.size * node.z + oz;
+          int64_t index = x + y * grid_size + z * grid_size * grid_size;
+          std::fill_n(lut.data() + index, node.size, int32_t(i));
+        }
+      }
+    });
+
+    node_lookup_table table;
+    table.m_grid_size = grid_size;
+    table.m_grid = std::move(lut);
+    table.m_nodes = std::move(nodes);
 
-    return {grid_size, lut};
+    return table;
   }
 
 };
@@ -230,6 +386,27 @@ struct distribution_task : public task {
   attributes inputAttributes;
 };
 
+// chunk with the bounding box that its id describes within the cube min, max
+static std::shared_ptr<chunk> create_chunk(const std::string& id, const std::string& file, const vector3& min, const vector3& max, const std::shared_ptr<chunk_codec>& codec) {
+  auto chunk = std::make_shared<potree::chunk>();
+  chunk->m_file = file;
+  chunk->m_id = id;
+  chunk->m_codec = codec;
+
+  bounding_box box = { min, max };
+
+  for (int i = 1; i < id.size(); i++) {
+    // this feels so wrong...
+    int index = id[i] - '0';
+    box = box.child_of(index);
+  }
+
+  chunk->min = box.min;
+  chunk->max = box.max;
+
+  return chunk;
+}
+
 struct point_distributor {
 public:
   std::vector<file_source> m_sources;
@@ -244,6 +421,14 @@ public:
   std::vector<potree::node> m_nodes;
   std::unique_ptr<task_pool> m_pool;
   std::shared_ptr<concurrent_writer> m_writer;
+  // appends chunks to a packed store instead of one file per chunk if set
+  std::shared_ptr<chunk_store> m_store;
+  // encodes the chunks if set
+  std::shared_ptr<chunk_codec> m_codec;
+  // pipelined mode: receives every chunk as soon as all of its counted points are written
+  std::function<void(const std::shared_ptr<chunk>&)> m_on_chunk_complete;
+  // ids of the chunks that were passed to m_on_chunk_complete
+  std::unordered_set<std::string> m_completed_ids;
 
   double get_cube_size() const {
     return (m_max - m_min).max();
@@ -260,21 +445,140 @@ public:
 
   void distribute() {
     gen_utils::profiler pr("point_distributor::distribute()");
-    size_t num_processors = gen_utils::get_num_processors();
+    auto& exec = executor::instance();
     m_state->pointsProcessed = 0;
     m_state->bytesProcessed = 0;
     m_state->duration = 0;
-    m_writer = std::make_shared<concurrent_writer>(num_processors, m_state);
+    m_writer = std::make_shared<concurrent_writer>(exec.get_io_threads(), m_state, m_store, m_codec);
+    init_tracking();
+    replicate_lut();
     init_processor();
-    m_pool = std::make_unique<task_pool>(num_processors, m_processor);
+    m_pool = std::make_unique<task_pool>(exec.get_compute_threads(), m_processor);
     process_sources();
     m_pool->close();
     m_writer->join();
+    merge_stats();
+    m_lut_replicas.clear();
+    check_tracking();
   }
 
 private:
   std::function<void(std::shared_ptr<task>)> m_processor;
-  std::mutex m_mtx;
+  // pipelined mode: node index of each writer path, and the points of each node that are written so far
+  std::unordered_map<std::string, size_t> m_node_index;
+  std::vector<std::atomic_int64_t> m_written;
+  std::atomic_int64_t m_num_completed = 0;
+  std::mutex m_completed_mtx;
+
+  // the counting pass assigned the same cells as the distribution, so a chunk is complete once as many points
+  // were written as were counted. the writer writes a path on one thread at a time, so no buffer is in flight then.
+  void init_tracking() {
+    if (!m_on_chunk_complete) return;
+
+    m_written = std::vector<std::atomic_int64_t>(m_nodes.size());
+
+    for (size_t i = 0; i < m_nodes.size(); i++) {
+      std::string path = m_store != nullptr ? m_nodes[i].id : m_target_dir + "/chunks/" + m_nodes[i].id + ".bin";
+      m_node_index[path] = i;
+    }
+
+    m_writer->set_on_written([this](const std::string& path, int64_t bytes) {
+      size_t index = m_node_index.at(path);
+      int64_t written = m_written[index] += bytes / m_out_attributes.bytes;
+
+      if (written == m_nodes[index].numPoints) seal(index);
+    });
+  }
+
+  void seal(size_t index) {
+    const auto& node = m_nodes[index];
+
+    // too large for the indexer, refine() splits it once all points are distributed
+    if (node.numPoints > MAX_POINTS_PER_CHUNK) return;
+
+    std::string file = m_store != nullptr ? m_target_dir + "/chunks/" + chunk_store::PACK_FILE : m_target_dir + "/chunks/" + node.id + ".bin";
+    auto c = create_chunk(node.id, file, m_min, get_cube_max(), m_codec);
+    if (m_store != nullptr) c->m_extents = m_store->get_extents(node.id);
+
+    {
+      std::lock_guard<std::mutex> lock(m_completed_mtx);
+      m_completed_ids.insert(node.id);
+    }
+
+    m_num_completed++;
+    m_on_chunk_complete(c);
+  }
+
+  // chunks with fewer points than counted are left for the indexing after chunking,
+  // more points than counted means that a chunk was indexed before all of its points were written
+  void check_tracking() {
+    if (!m_on_chunk_complete) return;
+
+    for (size_t i = 0; i < m_nodes.size(); i++) {
+      if (m_written[i] > m_nodes[i].numPoints) {
+        throw std::runtime_error("chunk " + m_nodes[i].id + " received " + std::to_string(int64_t(m_written[i])) + " points, "
+          + std::to_string(m_nodes[i].numPoints) + " were counted");
+      }
+    }
+
+    MINFO << "point_distributor: " << m_num_completed << " of " << m_nodes.size() << " chunks were handed to the indexer during chunking" << std::endl;
+  }
+  // numa mode: a copy of the lookup table on each node, every point of every batch is looked up
+  std::vector<std::unique_ptr<node_lookup_table>> m_lut_replicas;
+  std::mutex m_stats_mtx;
+  // attribute ranges and histograms of each thread, merged once after all tasks are done
+  std::unordered_map<std::thread::id, std::unique_ptr<attributes>> m_stats;
+
+  attributes& get_stats() {
+    std::lock_guard<std::mutex> lock(m_stats_mtx);
+    auto& stats = m_stats[std::this_thread::get_id()];
+
+    if (stats == nullptr) {
+      stats = std::make_unique<attributes>(m_out_attributes);
+
+      for (auto& attr : stats->m_list) {
+        attr = attribute(attr.name, attr.size, attr.numElements, attr.elementSize, attr.type);
+      }
+    }
+
+    return *stats;
+  }
+
+  // copies the lookup table from a thread that is bound to the target node, so that its pages are allocated there
+  void replicate_lut() {
+    if (!numa_utils::is_enabled()) return;
+
+    int num_nodes = numa_utils::get_num_nodes();
+    m_lut_replicas.resize(num_nodes);
+    std::vector<std::thread> threads;
+
+    for (int node = 0; node < num_nodes; node++) {
+      threads.emplace_back([this, node]() {
+        numa_utils::bind_thread(node);
+        m_lut_replicas[node] = std::make_unique<node_lookup_table>(m_lut);
+      });
+    }
+
+    for (auto& t : threads) {
+      t.join();
+    }
+  }
+
+  const node_lookup_table& get_lut(const distribution_task& task) const {
+    if (m_lut_replicas.empty()) return *task.lut;
+
+    return *m_lut_replicas[numa_utils::get_current_node()];
+  }
+
+  void merge_stats() {
+    for (const auto& [id, stats] : m_stats) {
+      for (size_t i = 0; i < m_out_attributes.m_list.size(); i++) {
+        m_out_attributes.m_list[i].merge(stats->m_list[i]);
+      }
+    }
+
+    m_stats.clear();
+  }
 
   void init_processor() {
     m_processor = [this](std::shared_ptr<task> t) {
@@ -282,8 +586,8 @@ private:
 
       int bpp = m_out_attributes.bytes;
       auto num_bytes = bpp * task->batchSize;
-      int64_t grid_size = task->lut->m_grid_size;
-      auto& grid = task->lut->m_grid;
+      const auto& lut = get_lut(*task);
+      int64_t grid_size = lut.m_grid_size;
 
 			thread_local unique_ptr<void, void(*)(void*)> buffer(nullptr, free);
 			thread_local int64_t buffer_size = -1;
@@ -303,18 +607,8 @@ private:
 			memset(data, 0, buffer_size);
       m_writer->wait_for_memory_threshold(2'000);
 
-			int point_format = -1;
-			// per-thread copy of outputAttributes to compute min/max in a thread-safe way
-			// will be merged to global outputAttributes instance at the end of this function
-			auto out_attrs = m_out_attributes;
-			
-      for(auto& attribute: out_attrs.m_list){
-				if(attribute.is_classification()){
-					for(int i = 0; i < attribute.histogram.size(); i++){
-						attribute.histogram[i] = 0;
-					}
-				}
-			}
+			// ranges and histograms go to this thread's statistics, no locks while decoding
+			auto& out_attrs = get_stats();
 
       las_utils::process_position(task->path, task->batchSize, task->scale, m_out_attributes, task->inputAttributes, out_attrs, data, task->firstPoint);
     
@@ -328,7 +622,7 @@ private:
       // count points per bucket
       for(int64_t i = 0; i < task->batchSize; i++) {
         auto idx = m_out_attributes.get_index(data, task->scale, grid_size, size, m_min, i * bpp);
-        auto node_idx = grid[idx];
+        auto node_idx = lut.find(idx);
 
         if (node_idx == -1) {
           throw std::runtime_error("Point to node lookup failed, no node found.");
@@ -348,7 +642,7 @@ private:
       for(int64_t i = 0; i < task->batchSize; i++) {
       	int64_t pt_offset = i * bpp;
 				auto idx = m_out_attributes.get_index(data, task->scale, grid_size, size, m_min, pt_offset);
-				auto node_idx = grid[idx];
+				auto node_idx = lut.find(idx);
 				auto& node = m_nodes[node_idx];
 
 				if (node_idx == prev_node_idx) {
@@ -365,47 +659,19 @@ private:
 			m_state->bytesProcessed += num_bytes;
 			//m_state->duration = gen_utils::now() - tStart;
       chunk_utils::add_buckets(m_nodes, buckets, m_writer, m_target_dir);
-      
-			// merge attribute metadata of this batch into global attribute metadata
-			for (int i = 0; i < out_attrs.m_list.size(); i++) {
-				auto& source = out_attrs.m_list[i];
-				auto& target = m_out_attributes.m_list[i];
-
-				lock_guard<mutex> lock(m_mtx);
-				target.min.x = std::min(target.min.x, source.min.x);
-				target.min.y = std::min(target.min.y, source.min.y);
-				target.min.z = std::min(target.min.z, source.min.z);
-
-				target.max.x = std::max(target.max.x, source.max.x);
-				target.max.y = std::max(target.max.y, source.max.y);
-				target.max.z = std::max(target.max.z, source.max.z);
-
-				// target.mask = target.mask | source.mask;
-				
-				for(int j = 0; j < target.histogram.size(); j++){
-					target.histogram[j] = target.histogram[j] + source.histogram[j];
-				}
-			}
 
     };
   }
 
   void process_sources() {
-		for (auto& source : m_sources) {
-
-			laszip_POINTER laszip_reader;
-			laszip_header* header;
-			{
-				laszip_BOOL request_reader = 1;
-				laszip_BOOL is_compressed = string_utils::iends_with(source.path, ".laz") ? 1 : 0;
-
-				laszip_create(&laszip_reader);
-				laszip_request_compatibility_mode(laszip_reader, request_reader);
-				laszip_open_reader(laszip_reader, source.path.c_str(), &is_compressed);
-				laszip_get_header_pointer(laszip_reader, &header);
-			}
+		bool numa = numa_utils::is_enabled();
+		int num_nodes = numa_utils::get_num_nodes();
+
+		for (size_t source_index = 0; source_index < m_sources.size(); source_index++) {
+			auto& source = m_sources[source_index];
 
-			int64_t numPoints = std::max(uint64_t(header->number_of_point_records), header->extended_number_of_point_records);
+			auto header = las_header::load(source.path);
+			int64_t numPoints = header.numPoints;
 			int64_t pointsLeft = numPoints;
 			int64_t maxBatchSize = 1'000'000;
 			int64_t numRead = 0;
@@ -437,19 +703,48 @@ private:
 				task->min = m_min;
 				task->max = m_max;
 				task->inputAttributes = inputAttributes;
+				task->m_numa_node = numa ? int(source_index % num_nodes) : -1;
 
 				m_pool->add(task);
 
 				numRead += numToRead;
 			}
-
-			laszip_close_reader(laszip_reader);
-			laszip_destroy(laszip_reader);
-
 		}
   }
 };
 
+// ranges of attributes that didn't receive any points are written as null and keep their defaults
+static void read_range(const json& js, attribute& attr) {
+  if (js.contains("min") && js.contains("max")) {
+    int num_elements = std::min({ attr.numElements, 3, int(js["min"].size()), int(js["max"].size()) });
+
+    for (int i = 0; i < num_elements; i++) {
+      const auto& js_min = js["min"][i];
+      const auto& js_max = js["max"][i];
+      if (!js_min.is_number() || !js_max.is_number()) continue;
+
+      double min = js_min.get<double>();
+      double max = js_max.get<double>();
+
+      if (attr.type == attribute_type::INT64) {
+        attr.min_int64[i] = js_min.get<int64_t>();
+        attr.max_int64[i] = js_max.get<int64_t>();
+      } else if (attr.type == attribute_type::UINT64) {
+        attr.min_uint64[i] = js_min.get<uint64_t>();
+        attr.max_uint64[i] = js_max.get<uint64_t>();
+      }
+
+      if (i == 0) { attr.min.x = min; attr.max.x = max; }
+      else if (i == 1) { attr.min.y = min; attr.max.y = max; }
+      else { attr.min.z = min; attr.max.z = max; }
+    }
+  }
+
+  if (js.contains("histogram")) {
+    attr.histogram = js["histogram"].get<std::vector<int64_t>>();
+  }
+}
+
 std::shared_ptr<chunks> chunk_utils::load_chunks(const std::string& path_in) {
   gen_utils::profiler pr("chunk_utils::load_chunks");
 
@@ -479,6 +774,7 @@ std::shared_ptr<chunks> chunk_utils::load_chunks(const std::string& path_in) {
 
     attribute_type type = attribute_utils::get_type(jsAttribute["type"]);
     attribute attribute(name, size, numElements, elementSize, type);
+    read_range(jsAttribute, attribute);
 
     attributeList.push_back(attribute);
   }
@@ -495,37 +791,46 @@ std::shared_ptr<chunks> chunk_utils::load_chunks(const std::string& path_in) {
   attrs.m_pos_scale = { scaleX, scaleY, scaleZ };
   attrs.m_pos_offset = { offsetX, offsetY, offsetZ };
 
+  std::shared_ptr<chunk_codec> codec;
+  if (js.value("encoding", "RAW") == "COMPRESSED") {
+    codec = std::make_shared<chunk_codec>(attrs.bytes, js.value("blockSize", chunk_codec::DEFAULT_BLOCK_SIZE));
+  }
+
 
   auto toID = [](std::string filename) -> std::string {
     std::string strID = string_utils::replace(filename, "chunk_", "");
     return string_utils::replace(strID, ".bin", "");
   };
 
+  auto createChunk = [&min, &max, &codec](const std::string& chunkID, const std::string& file) {
+    return create_chunk(chunkID, file, min, max, codec);
+  };
+
   std::vector<std::shared_ptr<potree::chunk>> chunksToLoad;
-  for (const auto& entry : std::filesystem::directory_iterator(chunkDirectory)) {
-    std::string filename = entry.path().filename().string();
-    std::string chunkID = toID(filename);
 
-    if (!string_utils::iends_with(filename, ".bin")) {
-      continue;
+  if (chunk_store::exists(chunkDirectory)) {
+    // packed chunks are listed in the store's index, sorted so the order doesn't depend on the hash map
+    std::string packFile = chunkDirectory + "/" + chunk_store::PACK_FILE;
+
+    for (auto& [chunkID, extents] : chunk_store::read_index(chunkDirectory)) {
+      auto chunk = createChunk(chunkID, packFile);
+      chunk->m_extents = std::move(extents);
+      chunksToLoad.push_back(chunk);
     }
 
-    auto chunk = std::make_shared<potree::chunk>();
-    chunk->m_file = entry.path().string();
-    chunk->m_id = chunkID;
+    std::sort(chunksToLoad.begin(), chunksToLoad.end(), [](const auto& a, const auto& b) { return a->m_id < b->m_id; });
+  }
+  else {
+    for (const auto& entry : std::filesystem::directory_iterator(chunkDirectory)) {
+      std::string filename = entry.path().filename().string();
+      std::string chunkID = toID(filename);
 
-    bounding_box box = { min, max };
+      if (!string_utils::iends_with(filename, ".bin")) {
+        continue;
+      }
 
-    for (int i = 1; i < chunkID.size(); i++) {
-      // this feels so wrong...
-      int index = chunkID[i] - '0';
-      box = box.child_of(index);
+      chunksToLoad.push_back(createChunk(chunkID, entry.path().string()));
     }
-
-    chunk->min = box.min;
-    chunk->max = box.max;
-
-    chunksToLoad.push_back(chunk);
   }
 
   auto chunks = std::make_shared<potree::chunks>(chunksToLoad, min, max);
@@ -534,57 +839,236 @@ std::shared_ptr<chunks> chunk_utils::load_chunks(const std::string& path_in) {
   return chunks;
 }
 
-void chunk_utils::refine_chunk(const std::shared_ptr<chunk>& chunk, const attributes& attrs) {
+int64_t chunk_utils::get_size(const chunk& c) {
+  if (c.m_extents.empty()) return int64_t(file_utils::size(c.m_file));
+
+  int64_t size = 0;
+  for (const auto& extent : c.m_extents) size += extent.m_size;
+
+  return size;
+}
+
+int64_t chunk_utils::get_num_points(const chunk& c, int64_t bpp) {
+  if (c.m_codec == nullptr) return get_size(c) / bpp;
+
+  // walks the block headers
+  int64_t size = get_size(c);
+  int64_t num_points = 0;
+
+  for (int64_t offset = 0; offset + chunk_codec::HEADER_SIZE <= size;) {
+    auto data = read_chunk(c, offset, chunk_codec::HEADER_SIZE);
+    auto header = chunk_codec::read_header(data.data());
+    num_points += header.m_num_points;
+    offset += chunk_codec::HEADER_SIZE + header.m_payload_size;
+  }
+
+  return num_points;
+}
+
+std::shared_ptr<potree::buffer> chunk_utils::read_chunk(const chunk& c) {
+  std::shared_ptr<potree::buffer> buffer;
+
+  if (c.m_extents.empty()) {
+    // chunks are read once, they may bypass the page cache
+    buffer = io_utils::read_buffer(c.m_file, 0, -1, true);
+  }
+  else {
+    buffer = std::make_shared<potree::buffer>(get_size(c));
+    chunk_store::read(c, 0, buffer->size, buffer->data_u8);
+  }
+
+  if (c.m_codec != nullptr) {
+    buffer = chunk_codec::decode(buffer->data_u8, buffer->size);
+  }
+
+  return buffer;
+}
+
+std::vector<uint8_t> chunk_utils::read_chunk(const chunk& c, int64_t start, int64_t size) {
+  if (c.m_extents.empty()) return file_utils::read_binary(c.m_file, start, size);
+
+  size = std::max(int64_t(0), std::min(size, get_size(c) - start));
+  std::vector<uint8_t> data(size);
+  chunk_store::read(c, start, size, data.data());
+
+  return data;
+}
+
+void chunk_utils::advise_chunk(const chunk& c) {
+  if (c.m_extents.empty()) {
+    file_utils::advise_willneed(c.m_file);
+    return;
+  }
+
+  for (const auto& extent : c.m_extents) {
+    file_utils::advise_willneed(c.m_file, extent.m_offset, extent.m_size);
+  }
+}
+
+void chunk_utils::remove_chunk(const chunk& c) {
+  // packed chunks are removed together with the pack file
+  if (c.m_extents.empty()) {
+    io_utils::forget(c.m_file);
+    std::filesystem::remove(c.m_file);
+  }
+}
+
+// windows of about REFINE_BATCH_SIZE points. windows of compressed chunks consist of whole blocks
+static std::vector<std::shared_ptr<refine_task>> get_refine_windows(const chunk& c, int64_t bpp) {
+  std::vector<std::shared_ptr<refine_task>> windows;
+  int64_t size = chunk_utils::get_size(c);
+
+  if (c.m_codec == nullptr) {
+    int64_t num_points = size / bpp;
+
+    for (int64_t first = 0; first < num_points; first += REFINE_BATCH_SIZE) {
+      auto window = std::make_shared<refine_task>();
+      window->numPoints = std::min(REFINE_BATCH_SIZE, num_points - first);
+      window->start = first * bpp;
+      window->size = window->numPoints * bpp;
+      windows.push_back(window);
+    }
+
+    return windows;
+  }
+
+  std::shared_ptr<refine_task> window;
+  for (int64_t offset = 0; offset + chunk_codec::HEADER_SIZE <= size;) {
+    auto data = chunk_utils::read_chunk(c, offset, chunk_codec::HEADER_SIZE);
+    auto header = chunk_codec::read_header(data.data());
+
+    if (window == nullptr || window->numPoints >= REFINE_BATCH_SIZE) {
+      window = std::make_shared<refine_task>();
+      window->start = offset;
+      windows.push_back(window);
+    }
+
+    int64_t block_size = chunk_codec::HEADER_SIZE + header.m_payload_size;
+    window->size += block_size;
+    window->numPoints += header.m_num_points;
+    offset += block_size;
+  }
+
+  return windows;
+}
+
+// points of a refinement window, decoded if the chunk is compressed
+static std::vector<uint8_t> read_refine_window(const chunk& c, const refine_task& window, int64_t bpp) {
+  std::vector<uint8_t> data = chunk_utils::read_chunk(c, window.start, window.size);
+  if (c.m_codec == nullptr) return data;
+
+  std::vector<uint8_t> points(window.numPoints * bpp);
+  chunk_codec::decode(data.data(), data.size(), points.data());
+
+  return points;
+}
+
+void chunk_utils::refine_chunk(const std::shared_ptr<chunk>& chunk, const attributes& attrs, const std::string& target_dir, const std::shared_ptr<status>& state, const std::shared_ptr<chunk_store>& store) {
   gen_utils::profiler pr("chunk_utils::refine_chunk");
-  MINFO << "Refining large chunk file: " << chunk->m_file << std::endl;
+  MINFO << "Refining large chunk: " << chunk->m_id << std::endl;
+
+  int64_t bpp = attrs.bytes;
+  auto windows = get_refine_windows(*chunk, bpp);
+  int64_t grid_size = REFINE_GRID_SIZE;
+  size_t num_processors = executor::instance().get_compute_threads();
+  vector3 scale = attrs.m_pos_scale;
+  vector3 min = chunk->min;
+  vector3 size = chunk->max - chunk->min;
+
+  // the chunk is streamed twice in windows of REFINE_BATCH_SIZE points, so memory is bounded by
+  // one window per thread plus the writer backlog, independent of the chunk size
+  auto add_windows = [&windows](task_pool& pool) {
+    for (const auto& window : windows) {
+      pool.add(window);
+    }
 
-  std::vector<std::vector<uint8_t>> chunk_parts;
+    pool.close();
+  };
 
-  int64_t grid_size = 128;
+  // pass 1: count points in a grid over the chunk's bounding box
   std::vector<std::atomic_int32_t> counters(grid_size * grid_size * grid_size);
 
-  task_pool pool(16, [&chunk, &chunk_parts, &attrs, &counters, grid_size](std::shared_ptr<task> t) {
-    auto task = std::static_pointer_cast<refine_task>(t);
-    std::vector<uint8_t> points = file_utils::read_binary(chunk->m_file, task->start, task->size);
+  {
+    task_pool pool(num_processors, [&chunk, &attrs, &counters, bpp, grid_size, scale, min, size](std::shared_ptr<task> t) {
+      auto task = std::static_pointer_cast<refine_task>(t);
+      std::vector<uint8_t> points = read_refine_window(*chunk, *task, bpp);
+
+      for (int64_t i = 0; i < task->numPoints; i++) {
+        auto index = attrs.get_index(points.data(), scale, grid_size, size, min, i * bpp);
+        counters[index].fetch_add(1, std::memory_order_relaxed);
+      }
+    });
 
-    auto min = chunk->min;
-    auto size = chunk->max - min;
-    auto scale = attrs.m_pos_scale;
-    auto offset = attrs.m_pos_offset;
-    auto bpp = attrs.bytes;
+    add_windows(pool);
+  }
 
-    auto gridIndexOf = [&points, bpp, scale, offset, min, size, grid_size](int64_t pointIndex) {
+  // sub-chunks target half the limit, like the chunks of the first chunking pass
+  auto lut = node_lookup_table::create(counters, grid_size, MAX_POINTS_PER_CHUNK / 2);
+  counters = std::vector<std::atomic_int32_t>();
 
-      int64_t pointOffset = pointIndex * bpp;
-      int32_t* xyz = reinterpret_cast<int32_t*>(&points[0] + pointOffset);
+  if (lut.m_nodes.empty()) return;
 
-      double x = (xyz[0] * scale.x) + offset.x;
-      double y = (xyz[1] * scale.y) + offset.y;
-      double z = (xyz[2] * scale.z) + offset.z;
+  // sub-chunk ids continue the id of the refined chunk, e.g. r024 -> r02413
+  for (auto& node : lut.m_nodes) {
+    node.id = chunk->m_id + node.id.substr(1);
 
-      int64_t ix = double(grid_size) * (x - min.x) / size.x;
-      int64_t iy = double(grid_size) * (y - min.y) / size.y;
-      int64_t iz = double(grid_size) * (z - min.z) / size.z;
+    if (node.numPoints > MAX_POINTS_PER_CHUNK) {
+      MWARNING << "Chunk " << node.id << " still has " << gen_utils::format_number(node.numPoints) << " points after refinement" << std::endl;
+    }
+  }
 
-      ix = std::max(0ll, std::min(ix, grid_size - 1));
-      iy = std::max(0ll, std::min(iy, grid_size - 1));
-      iz = std::max(0ll, std::min(iz, grid_size - 1));
+  // pass 2: stream the points into the sub-chunks
+  auto writer_state = state;
+  auto writer = std::make_shared<concurrent_writer>(executor::instance().get_io_threads(), writer_state, store, chunk->m_codec);
 
-      int64_t index = gen_utils::morton_encode(iz, iy, ix);
+  {
+    task_pool pool(num_processors, [&chunk, &attrs, &lut, &writer, &target_dir, bpp, grid_size, scale, min, size](std::shared_ptr<task> t) {
+      auto task = std::static_pointer_cast<refine_task>(t);
+      writer->wait_for_memory_threshold(REFINE_MAX_BACKLOG_MB);
+      std::vector<uint8_t> points = read_refine_window(*chunk, *task, bpp);
 
-      return index;
-    };
+      const auto& nodes = lut.m_nodes;
+      std::vector<int32_t> node_indices(task->numPoints);
+      std::vector<int64_t> counts(nodes.size(), 0);
 
-    for(int64_t i = 0; i < task->numPoints; i++){
-      auto index = gridIndexOf(i);
-      counters[index]++;
-    }
+      for (int64_t i = 0; i < task->numPoints; i++) {
+        auto index = attrs.get_index(points.data(), scale, grid_size, size, min, i * bpp);
+        auto node_idx = lut.find(index);
+
+        if (node_idx == -1) {
+          throw std::runtime_error("Point to node lookup failed while refining chunk " + chunk->m_id);
+        }
+
+        node_indices[i] = node_idx;
+        counts[node_idx]++;
+      }
 
-    chunk_parts.push_back(std::move(points));
-  }); 
+      std::vector<std::shared_ptr<potree::buffer>> buckets(nodes.size());
+      for (size_t i = 0; i < nodes.size(); i++) {
+        buckets[i] = std::make_shared<potree::buffer>(counts[i] * bpp);
+      }
+
+      for (int64_t i = 0; i < task->numPoints; i++) {
+        buckets[node_indices[i]]->write(points.data() + i * bpp, bpp);
+      }
+
+      chunk_utils::add_buckets(nodes, buckets, writer, target_dir);
+    });
+
+    add_windows(pool);
+  }
+
+  writer->join();
+
+  if (store != nullptr) {
+    store->remove(chunk->m_id);
+  }
+  else {
+    std::filesystem::remove(chunk->m_file);
+  }
 }
 
-void chunk_utils::refine(const std::string& target_dir, const status& state) {
+void chunk_utils::refine(const std::string& target_dir, const std::shared_ptr<status>& state, const std::unordered_set<std::string>& skip) {
   gen_utils::profiler pr("chunk_utils::refine");
   
   auto chunks = load_chunks(target_dir);
@@ -594,13 +1078,26 @@ void chunk_utils::refine(const std::string& target_dir, const status& state) {
   std::vector<std::shared_ptr<chunk>> too_large_chunks;
 
   for(auto& chunk : chunks->m_list) {
-    auto file_size = std::filesystem::file_size(chunk->m_file);
+    if (skip.count(chunk->m_id) > 0) continue;
+
+    auto file_size = get_num_points(*chunk, bytes) * bytes;
     if (file_size > max_file_size) too_large_chunks.push_back(chunk);
   }
 
+  if (too_large_chunks.empty()) return;
+
+  // sub-chunks of packed chunks are appended to the same store
+  std::shared_ptr<chunk_store> store;
+  if (chunk_store::exists(target_dir + "/chunks")) {
+    store = std::make_shared<chunk_store>(target_dir + "/chunks", true);
+  }
+
+  // one chunk at a time, each refinement is parallel on its own
   for(auto& chunk : too_large_chunks) {
-    refine_chunk(chunk, chunks->m_attributes);
+    refine_chunk(chunk, chunks->m_attributes, target_dir, state, store);
   }
+
+  if (store != nullptr) store->close();
 }
 
 std::string chunk_utils::build_id(int level, int grid_size, int64_t x, int64_t y, int64_t z) {
@@ -647,7 +1144,8 @@ void chunk_utils::add_buckets(const std::vector<potree::node>& nodes, const std:
     }
 
     auto& node = nodes[nodeIndex];
-    std::string path = target_dir + "/chunks/" + node.id + ".bin";
+    // packed stores are keyed by chunk id
+    std::string path = writer->has_store() ? node.id : target_dir + "/chunks/" + node.id + ".bin";
     auto buffer = buckets[nodeIndex];
 
     writer->write(path, buffer);
@@ -655,10 +1153,11 @@ void chunk_utils::add_buckets(const std::vector<potree::node>& nodes, const std:
 
 }
 
-void chunk_utils::chunker::do_chunking(const std::vector<file_source>& sources, const std::string& target_dir, const vector3& min, const vector3& max, const std::shared_ptr<status>& state, attributes& out_attrs, const std::shared_ptr<gen_utils::monitor>& monitor) {
+void chunk_utils::chunker::do_chunking(const std::vector<file_source>& sources, const std::string& target_dir, const options& opts, const vector3& min, const vector3& max, const std::shared_ptr<status>& state, attributes& out_attrs, const std::shared_ptr<gen_utils::monitor>& monitor, const std::function<void(const std::shared_ptr<chunk>&)>& on_chunk_complete) {
  gen_utils::profiler pr("chunker::do_chunking()");
 
  int64_t tmp = state->pointsTotal / 20;
+ bool sparse = opts.m_count_method == "SPARSE";
  int grid_size = 512; // default
   if (state->pointsTotal < 100'000'000) {
     grid_size = 128;
@@ -666,6 +1165,10 @@ void chunk_utils::chunker::do_chunking(const std::vector<file_source>& sources,
   else if (state->pointsTotal < 500'000'000) {
     grid_size = 256;
   }
+  else if (sparse && state->pointsTotal >= 2'000'000'000) {
+    // only affordable without the dense grid_size³ counting grid and lookup table
+    grid_size = 1024;
+  }
 
   state->currentPass = 1;
 
@@ -678,28 +1181,59 @@ void chunk_utils::chunker::do_chunking(const std::vector<file_source>& sources,
     }
   }
 
-  las_utils::cell_point_counter pt_ctr(sources, min, max, grid_size, state, out_attrs, monitor);
-  auto grid = pt_ctr.count();
+  std::shared_ptr<chunk_store> store;
+  if (opts.m_chunk_store == "PACKED") {
+    store = std::make_shared<chunk_store>(target_dir + "/chunks");
+  }
+
+  std::shared_ptr<chunk_codec> codec;
+  if (opts.m_chunk_encoding == "COMPRESSED") {
+    codec = std::make_shared<chunk_codec>(out_attrs.bytes, opts.m_chunk_block_size);
+  }
+
+  las_utils::cell_point_counter pt_ctr(sources, min, max, grid_size, state, out_attrs, monitor, sparse);
+  node_lookup_table lut;
+
+  if (sparse) {
+    lut = node_lookup_table::create(pt_ctr.count_sparse(), grid_size);
+  }
+  else {
+    auto grid = pt_ctr.count();
+    lut = node_lookup_table::create(grid, grid_size);
+  }
+
+  // chunks that the pipelined indexer took over
+  std::unordered_set<std::string> handed_off;
 
   {
-    node_lookup_table lut = node_lookup_table::create(grid, grid_size);
     state->currentPass = 2;
     point_distributor pt_dtr;
     pt_dtr.m_sources = sources;
     pt_dtr.m_min = min;
     pt_dtr.m_max = max;
     pt_dtr.m_target_dir = target_dir;
-    pt_dtr.m_lut = lut;
+    pt_dtr.m_nodes = lut.m_nodes;
+    pt_dtr.m_lut = std::move(lut);
     pt_dtr.m_state = state;
     pt_dtr.m_out_attributes = out_attrs;
     pt_dtr.m_monitor = monitor;
+    pt_dtr.m_store = store;
+    pt_dtr.m_codec = codec;
+    pt_dtr.m_on_chunk_complete = on_chunk_complete;
 
     // distribute points
     pt_dtr.distribute();
+    out_attrs = pt_dtr.m_out_attributes;
+    handed_off = std::move(pt_dtr.m_completed_ids);
   }
 
+  if (store != nullptr) store->close();
+
   std::string metadataPath = target_dir + "/chunks/metadata.json";
   double cubeSize = (max - min).max();
   vector3 size = { cubeSize, cubeSize, cubeSize };
-  write_metadata(metadataPath, min, min + cubeSize, out_attrs);
+  write_metadata(metadataPath, min, min + cubeSize, out_attrs, codec);
+
+  // split chunks that are too large for the indexer
+  refine(target_dir, state, handed_off);
 }
@@ -1,19 +1,38 @@
 #pragma once
 
+#include <unordered_set>
+
 #include "common/status.h"
+#include "common/options.h"
 #include "common/buffer.h"
 #include "geometry/chunk.h"
 #include "utils/concurrent_writer.h"
+#include "utils/chunk_store.h"
 
 namespace potree {
 namespace chunk_utils {
   namespace chunker {
-    void do_chunking(const std::vector<file_source>& sources, const std::string& target_dir, const vector3& min, const vector3& max, const std::shared_ptr<status>& state, attributes& out_attrs, const std::shared_ptr<gen_utils::monitor>& monitor);
+    // on_chunk_complete enables pipelined indexing: it receives each chunk as soon as all of its points are written,
+    // on a writer thread, while other chunks are still distributed. chunks that need refining aren't passed.
+    void do_chunking(const std::vector<file_source>& sources, const std::string& target_dir, const options& opts, const vector3& min, const vector3& max, const std::shared_ptr<status>& state, attributes& out_attrs, const std::shared_ptr<gen_utils::monitor>& monitor, const std::function<void(const std::shared_ptr<chunk>&)>& on_chunk_complete = nullptr);
   }
 
   std::shared_ptr<chunks> load_chunks(const std::string& path_in);
-  void refine_chunk(const std::shared_ptr<chunk>& chunk, const attributes& attrs);
-  void refine(const std::string& target_dir, const status& state);
+  // size in bytes, reading and removing of chunks, whether they have a file of their own or are part of a chunk_store
+  // sizes and ranges are in stored bytes, read_chunk(c) returns the decoded points of compressed chunks
+  int64_t get_size(const chunk& c);
+  int64_t get_num_points(const chunk& c, int64_t bpp);
+  std::shared_ptr<potree::buffer> read_chunk(const chunk& c);
+  std::vector<uint8_t> read_chunk(const chunk& c, int64_t start, int64_t size);
+  void remove_chunk(const chunk& c);
+  // hints the os to read the chunk's file or extents ahead, see file_utils::advise_willneed
+  void advise_chunk(const chunk& c);
+  // splits a chunk into sub-chunks, streaming the points in windows with bounded memory.
+  // sub-chunks go to the store if given, otherwise to files of their own
+  void refine_chunk(const std::shared_ptr<chunk>& chunk, const attributes& attrs, const std::string& target_dir, const std::shared_ptr<status>& state, const std::shared_ptr<chunk_store>& store = nullptr);
+  // refines all chunks in target_dir that exceed the chunk size limit.
+  // chunks in skip aren't looked at, in pipelined mode the indexer may be reading and removing them
+  void refine(const std::string& target_dir, const std::shared_ptr<status>& state, const std::unordered_set<std::string>& skip = {});
   std::string build_id(int level, int grid_size, int64_t x, int64_t y, int64_t z);
   void add_buckets(const std::vector<potree::node>& nodes, const std::vector<std::shared_ptr<potree::buffer>>& buckets, const std::shared_ptr<concurrent_writer>& writer, const std::string& target_dir);
 
@@ -5,8 +5,10 @@
 using namespace potree;
 using namespace std::chrono_literals;
 
-concurrent_writer::concurrent_writer(size_t num_threads, std::shared_ptr<status>& state) {
+concurrent_writer::concurrent_writer(size_t num_threads, std::shared_ptr<status>& state, const std::shared_ptr<chunk_store>& store, const std::shared_ptr<chunk_codec>& codec) {
   m_num_threads = num_threads;
+  m_store = store;
+  m_codec = codec;
   m_t_start = gen_utils::now();
   init(state);
 }
@@ -16,34 +18,14 @@ concurrent_writer::~concurrent_writer() {
 }
 
 void concurrent_writer::init(std::shared_ptr<status>& state) {
+  state->name = "DISTRIBUITING";
+
+  // num_threads flush threads and nothing else, the thread count is part of the executor's budget
   for (int64_t i = 0; i < m_num_threads; i++) {
     m_threads.emplace_back([&]() {
       flush_thread();
     });
   }
-
-  m_threads.emplace_back([&]() {
-    for(;;) {
-      {
-        std::lock_guard<std::mutex> lock_t(m_todo_mtx);
-        std::lock_guard<std::mutex> lock_j(m_join_mtx);
-
-        bool nothing_todo = m_todo.empty();
-
-        if (nothing_todo && m_join_requested) return;
-
-        int64_t mb_todo = m_bytes_todo / (1024 * 1024);
-        int64_t mb_done = m_bytes_written / (1024 * 1024);
-
-        double duration = gen_utils::now() - m_t_start;
-        double throughput = mb_done / duration;
-
-        state->name = "DISTRIBUITING";
-      }
-
-      std::this_thread::sleep_for(100ms);
-    }
-  });
 }
 
 void concurrent_writer::join() {
@@ -113,17 +95,34 @@ void concurrent_writer::flush_thread() {
       continue;
     } 
 
-    std::fstream fout;
-    fout.open(path, std::ios::out | std::ios::app | std::ios::binary);
+    int64_t work_size = 0;
+    for (auto batch : work) work_size += batch->size;
+
+    // the backlog is counted in raw bytes, encoding happens here on the flush threads
+    std::vector<std::shared_ptr<potree::buffer>> output = work;
+    if (m_codec != nullptr) {
+      output = { m_codec->encode(work) };
+    }
+
+    if (m_store != nullptr) {
+      // all pending buffers of a chunk become a single extent
+      m_store->append(path, output);
+    }
+    else {
+      std::fstream fout;
+      fout.open(path, std::ios::out | std::ios::app | std::ios::binary);
 
-    for (auto batch : work) {
-      fout.write(batch->data_char, batch->size);
+      for (auto batch : output) {
+        fout.write(batch->data_char, batch->size);
+      }
 
-      m_bytes_todo -= batch->size;
-      m_bytes_written += batch->size;
+      fout.close();
     }
 
-    fout.close();
+    m_bytes_todo -= work_size;
+    m_bytes_written += work_size;
+
+    if (m_on_written) m_on_written(path, work_size);
 
     {
       std::lock_guard<std::mutex> lockT(m_todo_mtx);
@@ -1,21 +1,33 @@
 #pragma once
 #include <unordered_map>
 #include <atomic>
+#include <functional>
 #include "gen_utils.h"
 #include "common/buffer.h"
+#include "chunk_store.h"
+#include "chunk_codec.h"
 
 namespace potree {
 
   struct concurrent_writer {
   public:
-    concurrent_writer(size_t num_threads, std::shared_ptr<status>& state);
+    // with a store, buffers are appended to the store and paths are chunk ids.
+    // with a codec, the pending buffers of a path are encoded together before they are written
+    concurrent_writer(size_t num_threads, std::shared_ptr<status>& state, const std::shared_ptr<chunk_store>& store = nullptr, const std::shared_ptr<chunk_codec>& codec = nullptr);
     ~concurrent_writer();
 
     void wait_for_memory_threshold(int64_t threshold);
     void write(const std::string& path, const std::shared_ptr<potree::buffer>& data);
     void join();
+    bool has_store() const { return m_store != nullptr; }
+    // called on a flush thread after buffers of a path were written, with their size before encoding.
+    // has to be set before the first write
+    void set_on_written(const std::function<void(const std::string& path, int64_t bytes)>& callback) { m_on_written = callback; }
   private:
     std::shared_ptr<potree::status> m_state;
+    std::shared_ptr<chunk_store> m_store;
+    std::shared_ptr<chunk_codec> m_codec;
+    std::function<void(const std::string& path, int64_t bytes)> m_on_written;
     std::unordered_map<std::string, std::vector<std::shared_ptr<potree::buffer>>> m_todo;
     std::unordered_map<std::string, int> m_locks;
     std::atomic_int64_t m_bytes_todo = 0;
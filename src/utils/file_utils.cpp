@@ -1,13 +1,12 @@
 #include "file_utils.h"
+#include "io_utils.h"
 #include <fstream>
+#include <algorithm>
 #include <filesystem>
 
 #if defined(__linux__)
-constexpr auto fseek_64_all_platforms = fseeko64;
-#elif defined(WIN32)
-constexpr auto fseek_64_all_platforms = _fseeki64;
-#elif defined(_WIN32)
-constexpr auto fseek_64_all_platforms = _fseeki64;
+#include <fcntl.h>
+#include <unistd.h>
 #endif
 
 using namespace potree;
@@ -23,56 +22,22 @@ std::string file_utils::read_text(const std::string& path) {
 }
 
 std::shared_ptr<potree::buffer> file_utils::read_binary(const std::string& path) {
-  auto file = fopen(path.c_str(), "rb");
-  auto size = std::filesystem::file_size(path);
-  auto buffer = std::make_shared<potree::buffer>(size);
-  fread(buffer->data, 1, size, file);
-  fclose(file);
-  return buffer;
+  return io_utils::read_buffer(path);
 }
 
 std::vector<uint8_t> file_utils::read_binary(const std::string& path, uint64_t start, uint64_t size) {
-  auto file = fopen(path.c_str(), "rb");
-  auto total_size = std::filesystem::file_size(path);
+  // the range is clamped to the file before anything is allocated
+  uint64_t file_size = file_utils::size(path);
+  if (start >= file_size) return {};
+  size = std::min(size, file_size - start);
 
-  if (start >= total_size) return std::vector<uint8_t>();
-  
-  if (start + size > total_size) {
-    auto clamped_size = total_size - start;
-    std::vector<uint8_t> b(clamped_size);
-    fseek_64_all_platforms(file, start, SEEK_SET);
-    fread(b.data(), 1, clamped_size, file);
-    fclose(file);
-    return b;
-  } 
-  else {
-    std::vector<uint8_t> b(size);
-    fseek_64_all_platforms(file, start, SEEK_SET);
-    fread(b.data(), 1, size, file);
-    fclose(file);
-    return b;
-  }
+  std::vector<uint8_t> b(size);
+  b.resize(io_utils::read(path, start, size, b.data()));
+  return b;
 }
 
 void file_utils::read_binary(const std::string& path, uint64_t start, uint64_t size, void* target) {
-	auto file = fopen(path.c_str(), "rb");
-
-	auto total_size = std::filesystem::file_size(path);
-
-	if (start >= total_size) return;
-	
-  if (start + size > total_size) {
-		auto clamped_size = total_size - start;
-		fseek_64_all_platforms(file, start, SEEK_SET);
-		fread(target, 1, clamped_size, file);
-		fclose(file);
-	} 
-  else {
-		fseek_64_all_platforms(file, start, SEEK_SET);
-		fread(target, 1, size, file);
-		fclose(file);
-	}
-
+  io_utils::read(path, start, size, target);
 }
 
 json file_utils::read_json(const std::string& path) {
@@ -89,3 +54,14 @@ void file_utils::write_text(const std::string& path, const std::string& text) {
 size_t file_utils::size(const std::string& file_path) {
   return std::filesystem::file_size(file_path);
 }
+
+void file_utils::advise_willneed(const std::string& path, uint64_t start, uint64_t size) {
+#if defined(__linux__)
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return;
+
+  // the hint outlives the descriptor, readahead continues after close
+  posix_fadvise(fd, off_t(start), off_t(size), POSIX_FADV_WILLNEED);
+  close(fd);
+#endif
+}
@@ -9,6 +9,7 @@ using namespace nlohmann;
 namespace potree {
 namespace file_utils {
 
+  // binary reads go through io_utils, which keeps descriptors open between reads
   std::shared_ptr<buffer> read_binary(const std::string& path);
   std::vector<uint8_t> read_binary(const std::string& path, uint64_t start, uint64_t size);
   void read_binary(const std::string& path, uint64_t start, uint64_t size, void* target);
@@ -16,5 +17,8 @@ namespace file_utils {
   std::string read_text(const std::string& path);
   void write_text(const std::string& path, const std::string& text);
   size_t size(const std::string& file_path);
+  // asks the os to read a range of a file into the page cache in the background, size 0 for the rest of the file.
+  // does nothing where posix_fadvise isn't available
+  void advise_willneed(const std::string& path, uint64_t start = 0, uint64_t size = 0);
 }
 }
\ No newline at end of file
@@ -126,6 +126,23 @@ uint64_t gen_utils::morton_encode(unsigned int x, unsigned int y, unsigned int z
 	return answer;
 }
 
+// inverse of split_by_3: gathers every third bit back into a 21 bit integer
+unsigned int gen_utils::compact_by_3(uint64_t a) {
+	uint64_t x = a & 0x1249249249249249;
+	x = (x ^ (x >> 2)) & 0x10c30c30c30c30c3;
+	x = (x ^ (x >> 4)) & 0x100f00f00f00f00f;
+	x = (x ^ (x >> 8)) & 0x1f0000ff0000ff;
+	x = (x ^ (x >> 16)) & 0x1f00000000ffff;
+	x = (x ^ (x >> 32)) & 0x1fffff;
+	return (unsigned int)x;
+}
+
+void gen_utils::morton_decode(uint64_t code, unsigned int& x, unsigned int& y, unsigned int& z) {
+	x = compact_by_3(code);
+	y = compact_by_3(code >> 1);
+	z = compact_by_3(code >> 2);
+}
+
 double gen_utils::now() {
 	auto now = std::chrono::high_resolution_clock::now();
 	long long nanosSinceStart = now.time_since_epoch().count() - start_time;
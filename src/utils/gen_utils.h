@@ -88,6 +88,8 @@ namespace gen_utils {
   
   uint64_t split_by_3(unsigned int a);
   uint64_t morton_encode(unsigned int x, unsigned int y, unsigned int z);
+  unsigned int compact_by_3(uint64_t a);
+  void morton_decode(uint64_t code, unsigned int& x, unsigned int& y, unsigned int& z);
 
   memory_data get_memory_data();
   cpu_data get_cpu_data();
@@ -0,0 +1,294 @@
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include <algorithm>
+#include <unordered_map>
+#include "io_utils.h"
+
+#if defined(_WIN32)
+// keeps windows.h from defining min and max macros, which break std::min and std::max
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+using namespace potree;
+
+// descriptors kept open, the least recently used one is closed when the cache is full
+static const size_t MAX_DESCRIPTORS = 64;
+// O_DIRECT needs offsets, sizes and buffers aligned to the logical block size, 4096 covers common devices
+static const int64_t DIRECT_IO_ALIGNMENT = 4096;
+// smaller reads go through the page cache, the alignment overhead isn't worth it
+static const int64_t DIRECT_IO_MIN_SIZE = 4ll * 1024 * 1024;
+
+static std::atomic<bool> DIRECT_IO = false;
+
+static std::atomic_int64_t BYTES_READ = 0;
+static std::atomic_int64_t SYSCALLS = 0;
+static std::atomic_int64_t OPENS = 0;
+static std::atomic_int64_t CACHE_HITS = 0;
+static std::atomic_int64_t DIRECT_READS = 0;
+
+#if defined(_WIN32)
+
+int64_t io_utils::read(const std::string& path, int64_t offset, int64_t size, void* target) {
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) throw std::runtime_error("failed to open " + path);
+  OPENS++;
+
+  uint8_t* data = reinterpret_cast<uint8_t*>(target);
+  int64_t done = 0;
+
+  while (done < size) {
+    OVERLAPPED overlapped = {};
+    overlapped.Offset = DWORD((offset + done) & 0xFFFFFFFF);
+    overlapped.OffsetHigh = DWORD((offset + done) >> 32);
+    DWORD count = DWORD(std::min(size - done, int64_t(1) << 30));
+    DWORD transferred = 0;
+
+    BOOL ok = ReadFile(file, data + done, count, &transferred, &overlapped);
+    SYSCALLS++;
+
+    if (!ok && GetLastError() == ERROR_HANDLE_EOF) break;
+    if (!ok) {
+      CloseHandle(file);
+      throw std::runtime_error("failed to read " + path);
+    }
+    if (transferred == 0) break;
+
+    done += transferred;
+  }
+
+  CloseHandle(file);
+  SYSCALLS += 2;
+  BYTES_READ += done;
+
+  return done;
+}
+
+std::shared_ptr<buffer> io_utils::read_buffer(const std::string& path, int64_t offset, int64_t size, bool sequential) {
+  WIN32_FILE_ATTRIBUTE_DATA attributes;
+  if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &attributes)) throw std::runtime_error("failed to open " + path);
+  SYSCALLS++;
+
+  int64_t file_size = (int64_t(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+  int64_t available = std::max(int64_t(0), file_size - offset);
+  size = size < 0 ? available : std::min(size, available);
+
+  auto result = std::make_shared<buffer>(size);
+  result->size = read(path, offset, size, result->data);
+
+  return result;
+}
+
+void io_utils::forget(const std::string& path) { }
+
+void io_utils::close_all() { }
+
+#else
+
+struct descriptor {
+  std::string m_path;
+  int m_fd = -1;
+  // opened on the first direct read, -2 if the file system doesn't support O_DIRECT
+  int m_direct_fd = -1;
+  dev_t m_device = 0;
+  ino_t m_inode = 0;
+  uint64_t m_last_use = 0;
+  std::mutex m_mtx;
+
+  ~descriptor() {
+    if (m_fd >= 0) close(m_fd);
+    if (m_direct_fd >= 0) close(m_direct_fd);
+    SYSCALLS += (m_fd >= 0) + (m_direct_fd >= 0);
+  }
+
+  int get_direct_fd() {
+#if defined(O_DIRECT)
+    std::lock_guard<std::mutex> lock(m_mtx);
+
+    if (m_direct_fd == -1) {
+      m_direct_fd = open(m_path.c_str(), O_RDONLY | O_DIRECT);
+      SYSCALLS++;
+      OPENS++;
+
+      if (m_direct_fd < 0) m_direct_fd = -2;
+    }
+
+    return m_direct_fd;
+#else
+    return -2;
+#endif
+  }
+};
+
+static std::mutex CACHE_MTX;
+static std::unordered_map<std::string, std::shared_ptr<descriptor>> CACHE;
+static uint64_t USE_COUNTER = 0;
+
+// cached descriptor of the file that is currently at path, and its size.
+// a file that was replaced since it was opened has a different inode and is opened again.
+static std::shared_ptr<descriptor> acquire(const std::string& path, int64_t& file_size) {
+  struct stat st;
+  int result = stat(path.c_str(), &st);
+  SYSCALLS++;
+
+  if (result != 0) {
+    io_utils::forget(path);
+    throw std::runtime_error("failed to open " + path);
+  }
+
+  file_size = st.st_size;
+
+  {
+    std::lock_guard<std::mutex> lock(CACHE_MTX);
+    auto it = CACHE.find(path);
+
+    if (it != CACHE.end() && it->second->m_device == st.st_dev && it->second->m_inode == st.st_ino) {
+      it->second->m_last_use = ++USE_COUNTER;
+      CACHE_HITS++;
+      return it->second;
+    }
+  }
+
+  auto d = std::make_shared<descriptor>();
+  d->m_path = path;
+  d->m_fd = open(path.c_str(), O_RDONLY);
+  d->m_device = st.st_dev;
+  d->m_inode = st.st_ino;
+  SYSCALLS++;
+  OPENS++;
+
+  if (d->m_fd < 0) throw std::runtime_error("failed to open " + path);
+
+  std::lock_guard<std::mutex> lock(CACHE_MTX);
+  d->m_last_use = ++USE_COUNTER;
+  CACHE[path] = d;
+
+  // readers that still hold an evicted descriptor keep it open until they are done
+  if (CACHE.size() > MAX_DESCRIPTORS) {
+    auto oldest = std::min_element(CACHE.begin(), CACHE.end(), [](const auto& a, const auto& b) {
+      return a.second->m_last_use < b.second->m_last_use;
+    });
+    CACHE.erase(oldest);
+  }
+
+  return d;
+}
+
+// preads until size bytes are read or the file ends
+static int64_t read_fully(int fd, int64_t offset, int64_t size, uint8_t* target, bool direct, const std::string& path) {
+  int64_t done = 0;
+
+  while (done < size) {
+    ssize_t n = pread(fd, target + done, size_t(size - done), off_t(offset + done));
+    SYSCALLS++;
+
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) throw std::runtime_error("failed to read " + path);
+    if (n == 0) break;
+
+    done += n;
+
+    // direct reads continue only from aligned positions, a partial block means the end of the file
+    if (direct && n % DIRECT_IO_ALIGNMENT != 0) break;
+  }
+
+  BYTES_READ += done;
+
+  return done;
+}
+
+// reads the aligned blocks around the range into an aligned allocation, the buffer is a view of the range within it.
+// returns nullptr if direct i/o isn't available for the file
+static std::shared_ptr<buffer> read_direct(descriptor& d, int64_t offset, int64_t size) {
+  int fd = d.get_direct_fd();
+  if (fd < 0) return nullptr;
+
+  int64_t first = offset - offset % DIRECT_IO_ALIGNMENT;
+  int64_t last = ((offset + size + DIRECT_IO_ALIGNMENT - 1) / DIRECT_IO_ALIGNMENT) * DIRECT_IO_ALIGNMENT;
+
+  void* block = nullptr;
+  if (posix_memalign(&block, DIRECT_IO_ALIGNMENT, size_t(last - first)) != 0) {
+    throw std::runtime_error("failed to allocate " + std::to_string(last - first) + " bytes for a direct read");
+  }
+
+  std::shared_ptr<void> owner(block, free);
+  int64_t num_read = 0;
+
+  try {
+    num_read = read_fully(fd, first, last - first, reinterpret_cast<uint8_t*>(block), true, d.m_path);
+  }
+  catch (const std::exception&) {
+    // e.g. EINVAL if the device needs a larger alignment, buffered reads still work
+    return nullptr;
+  }
+
+  DIRECT_READS++;
+  int64_t available = std::clamp(num_read - (offset - first), int64_t(0), size);
+
+  return std::make_shared<buffer>(reinterpret_cast<uint8_t*>(block) + (offset - first), available, owner);
+}
+
+int64_t io_utils::read(const std::string& path, int64_t offset, int64_t size, void* target) {
+  int64_t file_size = 0;
+  auto d = acquire(path, file_size);
+
+  size = std::min(size, file_size - offset);
+  if (size <= 0) return 0;
+
+  return read_fully(d->m_fd, offset, size, reinterpret_cast<uint8_t*>(target), false, path);
+}
+
+std::shared_ptr<buffer> io_utils::read_buffer(const std::string& path, int64_t offset, int64_t size, bool sequential) {
+  int64_t file_size = 0;
+  auto d = acquire(path, file_size);
+
+  int64_t available = std::max(int64_t(0), file_size - offset);
+  size = size < 0 ? available : std::min(size, available);
+
+  if (sequential && DIRECT_IO && size >= DIRECT_IO_MIN_SIZE) {
+    auto result = read_direct(*d, offset, size);
+    if (result != nullptr) return result;
+  }
+
+  auto result = std::make_shared<buffer>(size);
+  result->size = read_fully(d->m_fd, offset, size, result->data_u8, false, path);
+
+  return result;
+}
+
+void io_utils::forget(const std::string& path) {
+  std::lock_guard<std::mutex> lock(CACHE_MTX);
+  CACHE.erase(path);
+}
+
+void io_utils::close_all() {
+  std::lock_guard<std::mutex> lock(CACHE_MTX);
+  CACHE.clear();
+}
+
+#endif
+
+void io_utils::set_direct_io(bool enabled) {
+  DIRECT_IO = enabled;
+}
+
+bool io_utils::is_direct_io() {
+  return DIRECT_IO;
+}
+
+io_utils::io_stats io_utils::get_stats() {
+  io_stats stats;
+  stats.m_bytes_read = BYTES_READ;
+  stats.m_syscalls = SYSCALLS;
+  stats.m_opens = OPENS;
+  stats.m_cache_hits = CACHE_HITS;
+  stats.m_direct_reads = DIRECT_READS;
+
+  return stats;
+}
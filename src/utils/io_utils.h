@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include "common/buffer.h"
+
+namespace potree {
+namespace io_utils {
+
+  // positional reads of whole files and ranges, the layer below file_utils' binary reads.
+  // descriptors stay open in a small cache, a read costs a stat, which detects replaced files, and the preads themselves.
+  // short reads are continued until the range or the end of the file is reached.
+  // windows opens the file per read, there is no descriptor cache.
+
+  // counters since the start of the process
+  struct io_stats {
+    int64_t m_bytes_read = 0;
+    int64_t m_syscalls = 0; // stat, open, pread and close calls of this layer
+    int64_t m_opens = 0;
+    int64_t m_cache_hits = 0;
+    int64_t m_direct_reads = 0;
+  };
+
+  // direct i/o is off by default. when on, large sequential reads use O_DIRECT into aligned buffers,
+  // so chunks that are read once don't push the octree out of the page cache. linux only, falls back to
+  // buffered reads where the file system doesn't support it.
+  void set_direct_io(bool enabled);
+  bool is_direct_io();
+
+  // reads up to size bytes at offset into target. returns the number of bytes read, fewer than size only at the end of the file
+  int64_t read(const std::string& path, int64_t offset, int64_t size, void* target);
+  // reads the range into a new buffer, size -1 reads to the end of the file.
+  // sequential marks large reads of data that isn't read again, they may use direct i/o
+  std::shared_ptr<buffer> read_buffer(const std::string& path, int64_t offset = 0, int64_t size = -1, bool sequential = false);
+
+  // closes the cached descriptor of a file, before it is removed, so its space is released right away
+  void forget(const std::string& path);
+  void close_all();
+
+  io_stats get_stats();
+}
+}
@@ -41,6 +41,23 @@ namespace json_utils {
 		return ss.str();  
   }
 
+  static inline std::string to_json(const std::vector<uint64_t>& values) {
+  	std::stringstream ss;
+		ss << "[";
+
+		for (size_t i = 0; i < values.size(); i++) {
+
+			ss << values[i];
+
+			if (i < values.size() - 1) {
+				ss << ", ";
+			}
+		}
+		ss << "]";
+
+		return ss.str();  
+  }
+
   static inline std::string str_value(const std::string& value) {
     return "\"" + value + "\"";
   }
@@ -3,20 +3,24 @@
 #include "geometry/bounding_box.h"
 #include "geometry/node.h"
 #include "common/file_source.h"
+#include "common/executor.h"
 #include "las/las_info.h"
+#include "las/las_catalog.h"
+#include "las/las_exporter.h"
+#include "las/las_reader_pool.h"
+#include "las/las_point_decoder.h"
 #include "las_utils.h"
 #include "gen_utils.h"
 #include "string_utils.h"
 #include "file_utils.h"
 #include "attribute_utils.h"
+#include "numa_utils.h"
 #include <unordered_map>
 #include <execution>
 #include <filesystem>
 
 using namespace potree;
 
-static const size_t NUM_PROCESSORS = gen_utils::get_num_processors();
-
 struct morton_comparer {
 	vector3 m_min;
 	vector3 m_max; // TODO unused variable
@@ -130,23 +134,58 @@ private:
 
 las_utils::cell_point_counter::cell_point_counter(
 	const std::vector<file_source>& sources, const vector3& min, const vector3& max,
-	int64_t grid_size, const std::shared_ptr<status>& state, attributes& out_attributes, const std::shared_ptr<gen_utils::monitor>& monitor
+	int64_t grid_size, const std::shared_ptr<status>& state, attributes& out_attributes, const std::shared_ptr<gen_utils::monitor>& monitor,
+	bool sparse
 ) {
 	m_sources = sources;
 	m_min = min;
 	m_max = max;
 	m_grid_size = grid_size;		
-	std::vector<std::atomic_int32_t> grid(grid_size * grid_size * grid_size);
-	m_grid = std::move(grid);
+	m_sparse = sparse;
+
+	if (!m_sparse) {
+		std::vector<std::atomic_int32_t> grid(grid_size * grid_size * grid_size);
+		m_grid = std::move(grid);
+		// all workers increment the grid, spread it over the numa nodes instead of the node that zeroed it
+		numa_utils::interleave(m_grid.data(), m_grid.size() * sizeof(std::atomic_int32_t));
+	}
+
 	m_out_attributes = out_attributes;
 	m_monitor = monitor;
 	m_state = state;
 	init_processor();
-	m_pool = std::make_unique<task_pool>(NUM_PROCESSORS, m_processor);
+	m_pool = std::make_unique<task_pool>(executor::instance().get_compute_threads(), m_processor);
 }
 
 std::vector<std::atomic_int32_t> las_utils::cell_point_counter::count() {
 	gen_utils::profiler pr("cell_point_counter::count()");
+	if (m_sparse) throw std::runtime_error("cell_point_counter::count(): counter was created in sparse mode");
+
+	process();
+
+	return std::move(m_grid);
+}
+
+sparse_grid las_utils::cell_point_counter::count_sparse() {
+	gen_utils::profiler pr("cell_point_counter::count_sparse()");
+	if (!m_sparse) throw std::runtime_error("cell_point_counter::count_sparse(): counter was created in dense mode");
+
+	process();
+
+	std::vector<const sparse_histogram*> histograms;
+	for (const auto& [id, histogram] : m_histograms) {
+		histograms.push_back(histogram.get());
+	}
+
+	auto grid = sparse_histogram::merge(histograms);
+	m_histograms.clear();
+
+	MINFO << "non-empty cells: " << gen_utils::format_number(grid.size()) << std::endl;
+
+	return grid;
+}
+
+void las_utils::cell_point_counter::process() {
 	MINFO << "START COUNTING" << std::endl;
 
 	m_t_start = gen_utils::now();
@@ -154,8 +193,17 @@ std::vector<std::atomic_int32_t> las_utils::cell_point_counter::count() {
 
 	m_pool->wait();
 	m_pool->close();
+}
 
-	return std::move(m_grid);
+sparse_histogram* las_utils::cell_point_counter::get_histogram() {
+	std::lock_guard<std::mutex> lock(m_histograms_mtx);
+	auto& histogram = m_histograms[std::this_thread::get_id()];
+
+	if (histogram == nullptr) {
+		histogram = std::make_unique<sparse_histogram>();
+	}
+
+	return histogram.get();
 }
 
 void las_utils::cell_point_counter::init_processor() {
@@ -191,16 +239,8 @@ void las_utils::cell_point_counter::init_processor() {
 			bufferSize = numBytes;
 		}
 
-		laszip_POINTER reader;
-		{
-			laszip_BOOL is_compressed = string_utils::iends_with(path, ".laz") ? 1 : 0;
-			laszip_BOOL request_reader = 1;
-
-			laszip_create(&reader);
-			laszip_request_compatibility_mode(reader, request_reader);
-			laszip_open_reader(reader, path.c_str(), &is_compressed);
-			laszip_seek_point(reader, task->firstPoint);
-		}
+		// consecutive tasks of a file usually end up on the same thread, which keeps its reader open
+		auto& reader = las_reader_pool::acquire(path, task->firstPoint);
 
 		double cubeSize = (max - min).max();
 		vector3 size = { cubeSize, cubeSize, cubeSize };
@@ -213,11 +253,14 @@ void las_utils::cell_point_counter::init_processor() {
 		auto pos_scale = this->m_out_attributes.m_pos_scale;
 		auto pos_offset = this->m_out_attributes.m_pos_offset;
 
+		// sparse mode: thread-private histogram, no shared writes while counting
+		sparse_histogram* histogram = m_sparse ? get_histogram() : nullptr;
+
 		for (int i = 0; i < numToRead; i++) {
 			int64_t pointOffset = i * bpp;
 
-			laszip_read_point(reader);
-			laszip_get_coordinates(reader, coordinates);
+			reader.read_point();
+			reader.get_coordinates(coordinates);
 
 			{
 				// transfer las integer coordinates to new scale/offset/box values
@@ -252,16 +295,17 @@ void las_utils::cell_point_counter::init_processor() {
 				int64_t iy = int64_t(std::min(d_grid_size * uy, d_grid_size - 1.0));
 				int64_t iz = int64_t(std::min(d_grid_size * uz, d_grid_size - 1.0));
 
-				int64_t index = ix + iy * m_grid_size + iz * m_grid_size * m_grid_size;
-
-				m_grid[index]++;
+				if (histogram != nullptr) {
+					histogram->add(gen_utils::morton_encode(ix, iy, iz));
+				}
+				else {
+					int64_t index = ix + iy * m_grid_size + iz * m_grid_size * m_grid_size;
+					m_grid[index]++;
+				}
 			}
 
 		}
 
-		laszip_close_reader(reader);
-		laszip_destroy(reader);
-
 		static int64_t pointsProcessed = 0;
 		pointsProcessed += task->numPoints;
 
@@ -273,21 +317,15 @@ void las_utils::cell_point_counter::init_processor() {
 
 void las_utils::cell_point_counter::assembly_sources() {
 	gen_utils::profiler pr("cell_point_counter::assembly_sources()");
-	for (const auto& source : m_sources) {
-		laszip_POINTER laszip_reader;
-		laszip_header* header;
-		
-		{
-			laszip_create(&laszip_reader);
-			laszip_BOOL request_reader = 1;
-			laszip_BOOL is_compressed = string_utils::iends_with(source.path, ".laz") ? 1 : 0;
-			laszip_request_compatibility_mode(laszip_reader, request_reader);
-			laszip_open_reader(laszip_reader, source.path.c_str(), &is_compressed);
-			laszip_get_header_pointer(laszip_reader, &header);
-		}
+	bool numa = numa_utils::is_enabled();
+	int num_nodes = numa_utils::get_num_nodes();
+
+	for (size_t source_index = 0; source_index < m_sources.size(); source_index++) {
+		const auto& source = m_sources[source_index];
+		auto header = las_header::load(source.path);
 		
-		int64_t bpp = header->point_data_record_length;
-		int64_t numPoints = std::max(uint64_t(header->number_of_point_records), header->extended_number_of_point_records);
+		int64_t bpp = header.pointDataRecordLength;
+		int64_t numPoints = header.numPoints;
 		int64_t pointsLeft = numPoints;
 		int64_t batch_size = 1'000'000;
 		int64_t numRead = 0;
@@ -304,7 +342,7 @@ void las_utils::cell_point_counter::assembly_sources() {
 				pointsLeft = pointsLeft - batch_size;
 			}
 			
-			int64_t firstByte = header->offset_to_point_data + numRead * bpp;
+			int64_t firstByte = header.offsetToPointData + numRead * bpp;
 			int64_t numBytes = numToRead * bpp;
 
 			auto task = std::make_shared<point_count_task>();
@@ -314,19 +352,18 @@ void las_utils::cell_point_counter::assembly_sources() {
 			task->firstByte = firstByte;
 			task->numBytes = numBytes;
 			task->numPoints = numToRead;
-			task->bpp = header->point_data_record_length; 
+			task->bpp = bpp;
 			//task->scale = { header->x_scale_factor, header->y_scale_factor, header->z_scale_factor };
 			//task->offset = { header->x_offset, header->y_offset, header->z_offset };
 			task->min = m_min;
 			task->max = m_max;
+			// the batches of a file stay on one numa node
+			task->m_numa_node = numa ? int(source_index % num_nodes) : -1;
 
 			m_pool->add(task);
 
 			numRead += batch_size;
 		}
-
-		laszip_close_reader(laszip_reader);
-		laszip_destroy(laszip_reader);
 	}
 }
 
@@ -439,7 +476,7 @@ std::vector<attribute> las_utils::compute_output_attributes(const las_header& he
 }
 
 attributes las_utils::compute_output_attributes(std::vector<file_source>& sources, std::vector<std::string>& requested_attributes) {
-	// TODO: a bit wasteful to iterate over source files and load headers twice
+	// headers come from las_catalog, the files are not opened again
 	vector3 scaleMin = { gen_utils::INF, gen_utils::INF, gen_utils::INF };
 	//vector3 offset = { gen_utils::INF, gen_utils::INF, gen_utils::INF};
 	vector3 min = { gen_utils::INF, gen_utils::INF, gen_utils::INF };
@@ -594,413 +631,26 @@ void las_utils::save(const std::string& target, const point_level& points, const
 	process_points(points, writer, target);
 }
 
-void las_utils::to_laz(const std::string& potree_path) {
-	json metadata = file_utils::read_json(potree_path + "/metadata.json");
-	auto bbox = bounding_box::parse(metadata["boundingBox"]);
-	auto attrs = node::parse_attributes(metadata);
-	auto root = node::load_hierarchy(potree_path, metadata);
-	point_levels levels(10);
-
-	root->traverse([potree_path, attrs, &levels](const std::shared_ptr<potree::node>& node, int level){
-		std::vector<colored_point>& points = levels[level];
-		auto buffer = file_utils::read_binary(potree_path + "/octree.bin", node->byteOffset, node->byteSize);
-		int bpp = attrs.bytes;
-		int num_points = buffer.size() / bpp;
-
-		int64_t rgbOffset = 0;
-		int64_t rgbOffsetFind = 0;
-		for (const auto& attribute : attrs.m_list) {
-			if (attribute.name == "rgb") {
-				rgbOffset = rgbOffsetFind;
-				break;
-			}
-
-			rgbOffsetFind += attribute.size;
-		}
-
-		for (int64_t i = 0; i < num_points; i++) {
-			int64_t pointOffset = i * bpp;
-			
-			int32_t ix = gen_utils::read_value<int32_t>(buffer, pointOffset + 0);
-			int32_t iy = gen_utils::read_value<int32_t>(buffer, pointOffset + 4);
-			int32_t iz = gen_utils::read_value<int32_t>(buffer, pointOffset + 8);
-
-			double x = double(ix) * attrs.m_pos_scale.x + attrs.m_pos_offset.x;
-			double y = double(iy) * attrs.m_pos_scale.y + attrs.m_pos_offset.y;
-			double z = double(iz) * attrs.m_pos_scale.z + attrs.m_pos_offset.z;
-
-			uint16_t r = gen_utils::read_value<uint16_t>(buffer, pointOffset + rgbOffset + 0);
-			uint16_t g = gen_utils::read_value<uint16_t>(buffer, pointOffset + rgbOffset + 2);
-			uint16_t b = gen_utils::read_value<uint16_t>(buffer, pointOffset + rgbOffset + 4);
-
-			colored_point point;
-			point.x = x;
-			point.y = y;
-			point.z = z;
-			point.r = r;
-			point.g = g;
-			point.b = b;
-
-			points.push_back(point);
-		}
-	});
-
-	int level = -1;
-	for(const auto& points : levels) {
-		++level;
-		if (points.empty()) continue;
-		std::string target = potree_path + "/level_" + std::to_string(level) + ".laz";
-		save(target, points, bbox.min, bbox.max);
-	}
-
+void las_utils::to_laz(const std::string& potree_path, const las_export_options& opts) {
+	las_exporter exporter(potree_path, opts);
+	exporter.run();
 }
 
-std::vector<las_utils::attribute_handler> las_utils::create_attribute_handlers(
-	laszip_header* header, uint8_t* data, laszip_point* point, 
-	attributes& inputAttributes, attributes& outputAttributes
-) {
-	std::vector<las_utils::attribute_handler> handlers;
-
-	int attributeOffset = 0;
-
-	// reset min/max, we're writing the values to a per-thread copy anyway
-	for (auto& attribute : outputAttributes.m_list) {
-		attribute.min = { gen_utils::INF, gen_utils::INF, gen_utils::INF };
-		attribute.max = { -gen_utils::INF, -gen_utils::INF, -gen_utils::INF };
-	}
-
-	{ // STANDARD LAS ATTRIBUTES
-
-		int offsetRGB = outputAttributes.get_offset("rgb");
-		attribute* attributeRGB = outputAttributes.get("rgb");
-		auto rgb = [data, point, header, offsetRGB, attributeRGB](int64_t offset) {
-			if (offsetRGB >= 0) {
-
-				uint16_t rgb[] = { 0, 0, 0 };
-				memcpy(rgb, &point->rgb, 6);
-				memcpy(data + offset + offsetRGB, rgb, 6);
-				
-				attributeRGB->min.x = std::min(attributeRGB->min.x, double(rgb[0]));
-				attributeRGB->min.y = std::min(attributeRGB->min.y, double(rgb[1]));
-				attributeRGB->min.z = std::min(attributeRGB->min.z, double(rgb[2]));
-
-				attributeRGB->max.x = std::max(attributeRGB->max.x, double(rgb[0]));
-				attributeRGB->max.y = std::max(attributeRGB->max.y, double(rgb[1]));
-				attributeRGB->max.z = std::max(attributeRGB->max.z, double(rgb[2]));
-			}
-		};
-
-		int offsetIntensity = outputAttributes.get_offset("intensity");
-		attribute* attributeIntensity = outputAttributes.get("intensity");
-		auto intensity = [data, point, header, offsetIntensity, attributeIntensity](int64_t offset) {
-			memcpy(data + offset + offsetIntensity, &point->intensity, 2);
-
-			attributeIntensity->min.x = std::min(attributeIntensity->min.x, double(point->intensity));
-			attributeIntensity->max.x = std::max(attributeIntensity->max.x, double(point->intensity));
-		};
-
-		int offsetReturnNumber = outputAttributes.get_offset("return number");
-		attribute* attributeReturnNumber = outputAttributes.get("return number");
-		auto returnNumber = [data, point, header, offsetReturnNumber, attributeReturnNumber](int64_t offset) {
-			uint8_t value = point->return_number;
-
-			memcpy(data + offset + offsetReturnNumber, &value, 1);
-
-			attributeReturnNumber->min.x = std::min(attributeReturnNumber->min.x, double(value));
-			attributeReturnNumber->max.x = std::max(attributeReturnNumber->max.x, double(value));
-		};
-
-		int offsetNumberOfReturns = outputAttributes.get_offset("number of returns");
-		attribute* attributeNumberOfReturns = outputAttributes.get("number of returns");
-		auto numberOfReturns = [data, point, header, offsetNumberOfReturns, attributeNumberOfReturns](int64_t offset) {
-			uint8_t value = point->number_of_returns;
-
-			memcpy(data + offset + offsetNumberOfReturns, &value, 1);
-
-			attributeNumberOfReturns->min.x = std::min(attributeNumberOfReturns->min.x, double(value));
-			attributeNumberOfReturns->max.x = std::max(attributeNumberOfReturns->max.x, double(value));
-		};
-
-		int offsetScanAngleRank = outputAttributes.get_offset("scan angle rank");
-		attribute* attributeScanAngleRank = outputAttributes.get("scan angle rank");
-		auto scanAngleRank = [data, point, header, offsetScanAngleRank, attributeScanAngleRank](int64_t offset) {
-			memcpy(data + offset + offsetScanAngleRank, &point->scan_angle_rank, 1);
-
-			attributeScanAngleRank->min.x = std::min(attributeScanAngleRank->min.x, double(point->scan_angle_rank));
-			attributeScanAngleRank->max.x = std::max(attributeScanAngleRank->max.x, double(point->scan_angle_rank));
-		};
-
-		int offsetScanAngle= outputAttributes.get_offset("scan angle");
-		attribute* attributeScanAngle = outputAttributes.get("scan angle");
-		auto scanAngle = [data, point, header, offsetScanAngle, attributeScanAngle](int64_t offset) {
-			memcpy(data + offset + offsetScanAngle, &point->extended_scan_angle, 2);
-
-			attributeScanAngle->min.x = std::min(attributeScanAngle->min.x, double(point->extended_scan_angle));
-			attributeScanAngle->max.x = std::max(attributeScanAngle->max.x, double(point->extended_scan_angle));
-		};
-
-		int offsetUserData = outputAttributes.get_offset("user data");
-		attribute* attributeUserData = outputAttributes.get("user data");
-		auto userData = [data, point, header, offsetUserData, attributeUserData](int64_t offset) {
-			memcpy(data + offset + offsetUserData, &point->user_data, 1);
-
-			attributeUserData->min.x = std::min(attributeUserData->min.x, double(point->user_data));
-			attributeUserData->max.x = std::max(attributeUserData->max.x, double(point->user_data));
-		};
-
-		int offsetClassification = outputAttributes.get_offset("classification");
-		attribute* attributeClassification = outputAttributes.get("classification");
-		auto classification = [data, point, header, offsetClassification, attributeClassification](int64_t offset) {
-			
-			uint8_t value = 0;
-			if (point->extended_classification > 31){
-				value = point->extended_classification;
-			}else{
-				value = point->classification;
-			}
-
-			data[offset + offsetClassification] = value;
-			attributeClassification->histogram[value]++;
-
-			attributeClassification->min.x = std::min(attributeClassification->min.x, double(value));
-			attributeClassification->max.x = std::max(attributeClassification->max.x, double(value));
-		};
-
-		int offsetSourceId = outputAttributes.get_offset("point source id");
-		attribute* attributePointSourceId = outputAttributes.get("point source id");
-		auto pointSourceId = [data, point, header, offsetSourceId, attributePointSourceId](int64_t offset) {
-			memcpy(data + offset + offsetSourceId, &point->point_source_ID, 2);
-
-			attributePointSourceId->min.x = std::min(attributePointSourceId->min.x, double(point->point_source_ID));
-			attributePointSourceId->max.x = std::max(attributePointSourceId->max.x, double(point->point_source_ID));
-		};
-
-		int offsetGpsTime= outputAttributes.get_offset("gps-time");
-		attribute* attributeGpsTime = outputAttributes.get("gps-time");
-		auto gpsTime = [data, point, header, offsetGpsTime, attributeGpsTime](int64_t offset) {
-			memcpy(data + offset + offsetGpsTime, &point->gps_time, 8);
-
-			attributeGpsTime->min.x = std::min(attributeGpsTime->min.x, point->gps_time);
-			attributeGpsTime->max.x = std::max(attributeGpsTime->max.x, point->gps_time);
-		};
-
-		int offsetClassificationFlags = outputAttributes.get_offset("classification flags");
-		attribute* attributeClassificationFlags = outputAttributes.get("classification flags");
-		auto classificationFlags = [data, point, header, offsetClassificationFlags, attributeClassificationFlags](int64_t offset) {
-			uint8_t value = point->extended_classification_flags;
-
-			memcpy(data + offset + offsetClassificationFlags, &value, 1);
-
-			attributeClassificationFlags->min.x = std::min(attributeClassificationFlags->min.x, double(point->extended_classification_flags));
-			attributeClassificationFlags->max.x = std::max(attributeClassificationFlags->max.x, double(point->extended_classification_flags));
-		};
-
-		unordered_map<string, function<void(int64_t)>> mapping = {
-			{"rgb", rgb},
-			{"intensity", intensity},
-			{"return number", returnNumber},
-			{"number of returns", numberOfReturns},
-			{"classification", classification},
-			{"scan angle rank", scanAngleRank},
-			{"scan angle", scanAngle},
-			{"user data", userData},
-			{"point source id", pointSourceId},
-			{"gps-time", gpsTime},
-			{"classification flags", classificationFlags},
-		};
-
-		for (auto& attribute : inputAttributes.m_list) {
-
-			attributeOffset += attribute.size;
-
-			if (attribute.name == "position") {
-				continue;
-			}
-
-			bool standardMappingExists = mapping.find(attribute.name) != mapping.end();
-			bool isIncludedInOutput = outputAttributes.get(attribute.name) != nullptr;
-			if (standardMappingExists && isIncludedInOutput) {
-				handlers.push_back(mapping[attribute.name]);
-			}
-		}
-	}
-
-	{ // EXTRA ATTRIBUTES
-
-		// mapping from las format to index of first extra attribute
-		// +1 for all formats with returns, which is split into return number and number of returns
-		unordered_map<int, int> formatToExtraIndex = {
-			{0, 8},
-			{1, 9},
-			{2, 9},
-			{3, 10},
-			{4, 14},
-			{5, 15},
-			{6, 10},
-			{7, 11},
-		};
-
-		bool noMapping = formatToExtraIndex.find(header->point_data_format) == formatToExtraIndex.end();
-		if (noMapping) {
-			string msg = "ERROR: las format not supported: " + gen_utils::format_number(header->point_data_format) + "\n";
-			cout << msg;
-
-			exit(123);
-		}
-
-		// handle extra bytes individually to compute per-attribute information
-		int firstExtraIndex = formatToExtraIndex[header->point_data_format];
-		int sourceOffset = 0;
-
-		int attributeOffset = 0;
-		for (int i = 0; i < firstExtraIndex; i++) {
-			attributeOffset += inputAttributes.m_list[i].size;
-		}
-
-		for (int i = firstExtraIndex; i < inputAttributes.m_list.size(); i++) {
-			attribute& inputAttribute = inputAttributes.m_list[i];
-			attribute* attribute = outputAttributes.get(inputAttribute.name);
-			int targetOffset = outputAttributes.get_offset(inputAttribute.name);
-
-			int attributeSize = inputAttribute.size;
-
-			if (attribute != nullptr) {
-				auto handleAttribute = [data, point, header, attributeSize, attributeOffset, sourceOffset, attribute](int64_t offset) {
-					memcpy(data + offset + attributeOffset, point->extra_bytes + sourceOffset, attributeSize);
-
-					std::function<double(uint8_t*)> f;
-
-					// TODO: shouldn't use DOUBLE as a unifying type
-					// it won't work with uint64_t and int64_t
-					if (attribute->type == attribute_type::INT8) {
-						f = gen_utils::read_double<int8_t>;
-					} else if (attribute->type == attribute_type::INT16) {
-						f = gen_utils::read_double<int16_t>;
-					} else if (attribute->type == attribute_type::INT32) {
-						f = gen_utils::read_double<int32_t>;
-					} else if (attribute->type == attribute_type::INT64) {
-						f = gen_utils::read_double<int64_t>;
-					} else if (attribute->type == attribute_type::UINT8) {
-						f = gen_utils::read_double<uint8_t>;
-					} else if (attribute->type == attribute_type::UINT16) {
-						f = gen_utils::read_double<uint16_t>;
-					} else if (attribute->type == attribute_type::UINT32) {
-						f = gen_utils::read_double<uint32_t>;
-					} else if (attribute->type == attribute_type::UINT64) {
-						f = gen_utils::read_double<uint64_t>;
-					} else if (attribute->type == attribute_type::FLOAT) {
-						f = gen_utils::read_double<float>;
-					} else if (attribute->type == attribute_type::DOUBLE) {
-						f = gen_utils::read_double<double>;
-					}
-
-					if (attribute->numElements == 1) {
-						double x = f(point->extra_bytes + sourceOffset);
-
-						attribute->min.x = std::min(attribute->min.x, x);
-						attribute->max.x = std::max(attribute->max.x, x);
-					} else if (attribute->numElements == 2) {
-						double x = f(point->extra_bytes + sourceOffset + 0 * attribute->elementSize);
-						double y = f(point->extra_bytes + sourceOffset + 1 * attribute->elementSize);
-
-						attribute->min.x = std::min(attribute->min.x, x);
-						attribute->min.y = std::min(attribute->min.y, y);
-						attribute->max.x = std::max(attribute->max.x, x);
-						attribute->max.y = std::max(attribute->max.y, y);
-
-					} else if (attribute->numElements == 3) {
-						double x = f(point->extra_bytes + sourceOffset + 0 * attribute->elementSize);
-						double y = f(point->extra_bytes + sourceOffset + 1 * attribute->elementSize);
-						double z = f(point->extra_bytes + sourceOffset + 2 * attribute->elementSize);
-
-						attribute->min.x = std::min(attribute->min.x, x);
-						attribute->min.y = std::min(attribute->min.y, y);
-						attribute->min.z = std::min(attribute->min.z, z);
-						attribute->max.x = std::max(attribute->max.x, x);
-						attribute->max.y = std::max(attribute->max.y, y);
-						attribute->max.z = std::max(attribute->max.z, z);
-					}
-
-
-				};
-
-				handlers.push_back(handleAttribute);
-				attributeOffset += attribute->size;
-			}
-
-			sourceOffset += inputAttribute.size;
-		}
-
-	}
-	
-	return handlers;
+void las_utils::to_copc(const std::string& potree_path, const copc_options& opts) {
+	copc_writer writer(potree_path, opts);
+	writer.run();
 }
 
 int las_utils::process_position(
 	const std::string& path, int64_t batch_size, const vector3& scale, 
 	const attributes& attrs, attributes& in_attrs, attributes& out_attrs, uint8_t* data, int64_t first_point
 ) {
-	laszip_POINTER laszip_reader;
-	laszip_header* header;
-	laszip_point* point;
-
-	laszip_BOOL request_reader = 1;
-	laszip_BOOL is_compressed = string_utils::iends_with(path, ".laz") ? 1 : 0;
+	auto& reader = las_reader_pool::acquire(path, first_point);
 
-	laszip_create(&laszip_reader);
-	laszip_request_compatibility_mode(laszip_reader, request_reader);
-	laszip_open_reader(laszip_reader, path.c_str(), &is_compressed);
-	laszip_get_header_pointer(laszip_reader, &header);
-	laszip_get_point_pointer(laszip_reader, &point);
-
-	laszip_seek_point(laszip_reader, first_point);
-	
-	auto attributeHandlers = create_attribute_handlers(header, data, point, in_attrs, out_attrs);
+	las_point_decoder decoder(reader.m_header, in_attrs, out_attrs);
+	decoder.decode(reader, batch_size, data, attrs.bytes, scale, attrs.m_pos_offset);
 
-	double coordinates[3];
-	auto aPosition = out_attrs.get("position");
-
-	for (int64_t i = 0; i < batch_size; i++) {
-		laszip_read_point(laszip_reader);
-		laszip_get_coordinates(laszip_reader, coordinates);
-
-		int64_t offset = i * attrs.bytes;
-
-		{ // copy position
-			double x = coordinates[0];
-			double y = coordinates[1];
-			double z = coordinates[2];
-
-			int32_t X = int32_t((x - attrs.m_pos_offset.x) / scale.x);
-			int32_t Y = int32_t((y - attrs.m_pos_offset.y) / scale.y);
-			int32_t Z = int32_t((z - attrs.m_pos_offset.z) / scale.z);
-
-			memcpy(data + offset + 0, &X, 4);
-			memcpy(data + offset + 4, &Y, 4);
-			memcpy(data + offset + 8, &Z, 4);
-
-			aPosition->min.x = std::min(aPosition->min.x, x);
-			aPosition->min.y = std::min(aPosition->min.y, y);
-			aPosition->min.z = std::min(aPosition->min.z, z);
-
-			aPosition->max.x = std::max(aPosition->max.x, x);
-			aPosition->max.y = std::max(aPosition->max.y, y);
-			aPosition->max.z = std::max(aPosition->max.z, z);
-		}
-
-		// copy other attributes
-		for (auto& handler : attributeHandlers) {
-			handler(offset);
-		}
-
-	}
-
-	int pointFormat = header->point_data_format;
-
-	laszip_close_reader(laszip_reader);
-	laszip_destroy(laszip_reader);
-
-	return pointFormat;
+	return reader.m_header->point_data_format;
 }
 
 file_source_container las_utils::curate_sources(std::vector<std::string>& paths) {
@@ -1034,11 +684,16 @@ file_source_container las_utils::curate_sources(std::vector<std::string>& paths)
 	std::vector<file_source> sources;
 	sources.reserve(paths.size());
 
+	// headers of new or changed files are read once here, every later pass gets them from the catalog
+	auto& catalog = las_catalog::instance();
+	catalog.update(paths);
+
 	std::mutex mtx;
 	auto parallel = std::execution::par;
-	for_each(parallel, paths.begin(), paths.end(), [&mtx, &sources](const std::string& path) {
-		auto header = las_header::load(path);
-		auto filesize = std::filesystem::file_size(path);
+	for_each(parallel, paths.begin(), paths.end(), [&mtx, &sources, &catalog](const std::string& path) {
+		auto entry = catalog.get(path);
+		const auto& header = entry.m_header;
+		auto filesize = entry.m_filesize;
 
 		vector3 min = { header.min.x, header.min.y, header.min.z };
 		vector3 max = { header.max.x, header.max.y, header.max.z };
@@ -1048,6 +703,7 @@ file_source_container las_utils::curate_sources(std::vector<std::string>& paths)
 		source.min = min;
 		source.max = max;
 		source.numPoints = header.numPoints;
+		source.bytesPerPoint = header.pointDataRecordLength;
 		source.filesize = filesize;
 
 		std::lock_guard<std::mutex> lock(mtx);
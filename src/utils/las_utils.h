@@ -1,10 +1,16 @@
 #pragma once
 
 #include <functional>
+#include <thread>
+#include <mutex>
+#include <unordered_map>
 #include "laszip/laszip_api.h"
 #include "geometry/attributes.h"
+#include "geometry/sparse_grid.h"
 #include "common/task.h"
 #include "las/las_header.h"
+#include "las/las_exporter.h"
+#include "las/copc_writer.h"
 #include "gen_utils.h"
 
 namespace potree {
@@ -29,10 +35,14 @@ namespace las_utils {
     
     cell_point_counter(
       const std::vector<file_source>& sources, const vector3& min, const vector3& max,
-      int64_t grid_size, const std::shared_ptr<status>& state, attributes& out_attributes, const std::shared_ptr<gen_utils::monitor>& monitor
+      int64_t grid_size, const std::shared_ptr<status>& state, attributes& out_attributes, const std::shared_ptr<gen_utils::monitor>& monitor,
+      bool sparse = false
     );
 
+    // dense grid of grid_size³ atomic counters
     std::vector<std::atomic_int32_t> count();
+    // non-empty cells only, counted in per-thread histograms that are merged once at the end
+    sparse_grid count_sparse();
 
   private:
     std::vector<file_source> m_sources;
@@ -46,24 +56,25 @@ namespace las_utils {
     std::unique_ptr<task_pool> m_pool;
     task_processor m_processor;
     double m_t_start = 0;
+    bool m_sparse = false;
+    std::mutex m_histograms_mtx;
+    std::unordered_map<std::thread::id, std::unique_ptr<sparse_histogram>> m_histograms;
 
     void init_processor();
     void assembly_sources();
+    void process();
+    sparse_histogram* get_histogram();
   };
 
   typedef std::vector<colored_point> point_level;
   typedef std::vector<point_level> point_levels;
-  typedef std::function<void(int64_t)> attribute_handler;
   std::vector<attribute> parse_extra_attributes(const las_header& header);
   std::vector<attribute> compute_output_attributes(const las_header& header);
   attributes compute_output_attributes(std::vector<file_source>& sources, std::vector<std::string>& requested_attributes);
   void save(const laszip_header* header, const std::vector<colored_point>& points, const std::string& target);
   void save(const std::string& target, const point_level& points, const vector3& min, const vector3& max);
-  void to_laz(const std::string& potree_path);
-  std::vector<attribute_handler> create_attribute_handlers(
-    laszip_header* header, uint8_t* data, laszip_point* point, 
-    attributes& inputAttributes, attributes& outputAttributes
-  );
+  void to_laz(const std::string& potree_path, const las_export_options& opts = las_export_options());
+  void to_copc(const std::string& potree_path, const copc_options& opts = copc_options());
   int process_position(
     const std::string& path, int64_t batch_size, const vector3& scale, 
     const attributes& attrs, attributes& in_attrs, attributes& out_attrs, uint8_t* data, int64_t first_point
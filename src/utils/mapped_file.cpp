@@ -0,0 +1,63 @@
+#include <stdexcept>
+#include <filesystem>
+#include "mapped_file.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+using namespace potree;
+
+mapped_file::mapped_file(const std::string& path) {
+  m_path = path;
+  m_size = int64_t(std::filesystem::file_size(path));
+
+  // an empty file can't be mapped, data() stays null
+  if (m_size == 0) return;
+
+#if defined(_WIN32)
+  m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+  if (m_file == INVALID_HANDLE_VALUE) throw std::runtime_error("failed to open " + path);
+
+  m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (m_mapping == nullptr) {
+    CloseHandle(m_file);
+    throw std::runtime_error("failed to map " + path);
+  }
+
+  m_data = reinterpret_cast<uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+  if (m_data == nullptr) {
+    CloseHandle(m_mapping);
+    CloseHandle(m_file);
+    throw std::runtime_error("failed to map " + path);
+  }
+#else
+  m_fd = open(path.c_str(), O_RDONLY);
+  if (m_fd < 0) throw std::runtime_error("failed to open " + path);
+
+  void* data = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, m_fd, 0);
+  if (data == MAP_FAILED) {
+    close(m_fd);
+    throw std::runtime_error("failed to map " + path);
+  }
+
+  // accesses follow the hierarchy, not the file order. don't read ahead.
+  madvise(data, m_size, MADV_RANDOM);
+  m_data = reinterpret_cast<uint8_t*>(data);
+#endif
+}
+
+mapped_file::~mapped_file() {
+#if defined(_WIN32)
+  if (m_data != nullptr) UnmapViewOfFile(m_data);
+  if (m_mapping != nullptr) CloseHandle(m_mapping);
+  if (m_file != nullptr && m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+#else
+  if (m_data != nullptr) munmap(m_data, m_size);
+  if (m_fd >= 0) close(m_fd);
+#endif
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace potree {
+
+  // read-only memory mapping of a whole file. pages are only read once they are accessed.
+  class mapped_file {
+  public:
+    mapped_file(const std::string& path);
+    ~mapped_file();
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    const uint8_t* data() const { return m_data; }
+    int64_t size() const { return m_size; }
+    const std::string& path() const { return m_path; }
+
+  private:
+    std::string m_path;
+    uint8_t* m_data = nullptr;
+    int64_t m_size = 0;
+
+#if defined(_WIN32)
+    void* m_file = nullptr;
+    void* m_mapping = nullptr;
+#else
+    int m_fd = -1;
+#endif
+  };
+
+}
@@ -0,0 +1,203 @@
+#include <atomic>
+#include <string>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <filesystem>
+#include <algorithm>
+#include "numa_utils.h"
+#include "file_utils.h"
+#include "gen_utils.h"
+
+#if defined(__linux__)
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+using namespace potree;
+
+#if defined(__linux__)
+// memory policies of linux/mempolicy.h, the syscalls are used directly so that libnuma isn't required
+static const int MPOL_PREFERRED_MODE = 1;
+static const int MPOL_INTERLEAVE_MODE = 3;
+static const unsigned MPOL_MF_MOVE_FLAG = 1 << 1;
+#endif
+
+static std::atomic<bool> NUMA_ENABLED = false;
+
+// parses cpu and node lists of sysfs, e.g. "0-3,8-11"
+static std::vector<int> parse_list(const std::string& text) {
+  std::vector<int> values;
+  std::stringstream ss(text);
+  std::string range;
+
+  while (std::getline(ss, range, ',')) {
+    range.erase(std::remove_if(range.begin(), range.end(), ::isspace), range.end());
+    if (range.empty()) continue;
+
+    size_t dash = range.find('-');
+    int first = std::stoi(range.substr(0, dash));
+    int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+
+    for (int i = first; i <= last; i++) {
+      values.push_back(i);
+    }
+  }
+
+  return values;
+}
+
+// node ids of the system and their cpus. nodes are addressed by their index in this list,
+// node ids of sysfs don't have to be contiguous.
+struct topology {
+  std::vector<int> m_node_ids;
+  std::vector<std::vector<int>> m_cpus;
+  std::vector<int> m_node_of_cpu;
+
+  static const topology& get() {
+    static topology instance = load();
+    return instance;
+  }
+
+private:
+  static topology load() {
+    topology t;
+
+#if defined(__linux__)
+    std::string dir = "/sys/devices/system/node";
+
+    try {
+      if (std::filesystem::exists(dir + "/online")) {
+        t.m_node_ids = parse_list(file_utils::read_text(dir + "/online"));
+      }
+
+      for (int id : t.m_node_ids) {
+        auto cpus = parse_list(file_utils::read_text(dir + "/node" + std::to_string(id) + "/cpulist"));
+        int node = int(t.m_cpus.size());
+
+        for (int cpu : cpus) {
+          if (cpu >= int(t.m_node_of_cpu.size())) t.m_node_of_cpu.resize(cpu + 1, 0);
+          t.m_node_of_cpu[cpu] = node;
+        }
+
+        t.m_cpus.push_back(cpus);
+      }
+    }
+    catch (const std::exception& e) {
+      MWARNING << "numa_utils: failed to read the numa topology, assuming a single node: " << e.what() << std::endl;
+      t = topology();
+    }
+#endif
+
+    if (t.m_node_ids.empty()) {
+      t.m_node_ids = { 0 };
+      t.m_cpus = { {} };
+    }
+
+    return t;
+  }
+};
+
+#if defined(__linux__)
+static void set_policy(void* data, size_t size, int mode, const std::vector<int>& nodes, unsigned flags) {
+  if (data == nullptr || size == 0) return;
+
+  const auto& t = topology::get();
+  int max_id = *std::max_element(t.m_node_ids.begin(), t.m_node_ids.end());
+  std::vector<unsigned long> mask(max_id / (8 * sizeof(unsigned long)) + 1, 0);
+
+  for (int node : nodes) {
+    int id = t.m_node_ids[node];
+    mask[id / (8 * sizeof(unsigned long))] |= 1ul << (id % (8 * sizeof(unsigned long)));
+  }
+
+  // policies apply to whole pages
+  uintptr_t page_size = uintptr_t(sysconf(_SC_PAGESIZE));
+  uintptr_t start = reinterpret_cast<uintptr_t>(data) & ~(page_size - 1);
+  uintptr_t end = (reinterpret_cast<uintptr_t>(data) + size + page_size - 1) & ~(page_size - 1);
+  unsigned long max_node = mask.size() * 8 * sizeof(unsigned long) + 1;
+
+  if (syscall(SYS_mbind, start, end - start, mode, mask.data(), max_node, flags) != 0) {
+    MWARNING << "numa_utils: mbind failed: " << strerror(errno) << std::endl;
+  }
+}
+#endif
+
+void numa_utils::set_enabled(bool enabled) {
+  NUMA_ENABLED = enabled;
+
+  if (enabled && get_num_nodes() < 2) {
+    MINFO << "numa_utils: single numa node, numa mode has no effect" << std::endl;
+  }
+}
+
+bool numa_utils::is_enabled() {
+  return NUMA_ENABLED && get_num_nodes() > 1;
+}
+
+int numa_utils::get_num_nodes() {
+  return int(topology::get().m_node_ids.size());
+}
+
+std::vector<int> numa_utils::get_cpus(int node) {
+  const auto& t = topology::get();
+  if (node < 0 || node >= int(t.m_cpus.size())) return {};
+
+  return t.m_cpus[node];
+}
+
+int numa_utils::get_current_node() {
+#if defined(__linux__)
+  const auto& t = topology::get();
+  int cpu = sched_getcpu();
+
+  if (cpu >= 0 && cpu < int(t.m_node_of_cpu.size())) return t.m_node_of_cpu[cpu];
+#endif
+
+  return 0;
+}
+
+bool numa_utils::bind_thread(int node) {
+#if defined(__linux__)
+  auto cpus = get_cpus(node);
+  if (cpus.empty()) return false;
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+
+  for (int cpu : cpus) {
+    CPU_SET(cpu, &set);
+  }
+
+  if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+    MWARNING << "numa_utils: failed to bind thread to node " << node << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  return true;
+#else
+  return false;
+#endif
+}
+
+void numa_utils::bind_memory(void* data, size_t size, int node) {
+#if defined(__linux__)
+  if (!is_enabled() || node < 0 || node >= get_num_nodes()) return;
+
+  set_policy(data, size, MPOL_PREFERRED_MODE, { node }, 0);
+#endif
+}
+
+void numa_utils::interleave(void* data, size_t size) {
+#if defined(__linux__)
+  if (!is_enabled()) return;
+
+  std::vector<int> nodes(get_num_nodes());
+  for (int i = 0; i < int(nodes.size()); i++) {
+    nodes[i] = i;
+  }
+
+  set_policy(data, size, MPOL_INTERLEAVE_MODE, nodes, MPOL_MF_MOVE_FLAG);
+#endif
+}
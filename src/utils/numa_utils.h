@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace potree {
+namespace numa_utils {
+
+  // numa mode is off by default, workers then float freely and memory is placed by the os.
+  // with numa mode on, task_pool workers are pinned round-robin to the numa nodes and prefer tasks of their node.
+  // all functions fall back to no-ops on systems with a single node or without numa support.
+  void set_enabled(bool enabled);
+  // true if numa mode was enabled and the system has more than one node
+  bool is_enabled();
+
+  // nodes are numbered 0 to get_num_nodes() - 1, independent of the node ids of the os
+  int get_num_nodes();
+  // cpus of a node, empty if the node doesn't exist
+  std::vector<int> get_cpus(int node);
+  // node of the cpu the calling thread currently runs on, 0 if unknown
+  int get_current_node();
+
+  // restricts the calling thread to the cpus of a node. memory the thread touches first is then allocated on that node.
+  bool bind_thread(int node);
+  // prefers the node for pages of the range that aren't allocated yet
+  void bind_memory(void* data, size_t size, int node);
+  // spreads the pages of the range over all nodes, pages that are already allocated are migrated.
+  // meant for large shared structures that are accessed from every node, like the counting grid.
+  void interleave(void* data, size_t size);
+
+}
+}
@@ -0,0 +1,195 @@
+#include <vector>
+#include <stdexcept>
+#include <filesystem>
+#include <fstream>
+#include "octree_layout.h"
+#include "file_utils.h"
+#include "gen_utils.h"
+#include "geometry/node.h"
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace potree;
+
+static const int64_t RECORD_SIZE = 22;
+
+// runs are copied in pieces of at most this size if copy_file_range is not available
+static const int64_t COPY_BUFFER_SIZE = 16ll * 1024 * 1024;
+
+// a range of octree.bin that is copied to the new file as a whole
+struct copy_run {
+  int64_t m_source = 0;
+  int64_t m_target = 0;
+  int64_t m_size = 0;
+};
+
+#if defined(_WIN32)
+
+static void copy_runs(const std::string& source, const std::string& target, const std::vector<copy_run>& runs) {
+  std::ifstream fin(source, std::ios::binary);
+  std::ofstream fout(target, std::ios::binary | std::ios::trunc);
+  if (!fin.good()) throw std::runtime_error("failed to open " + source);
+  if (!fout.good()) throw std::runtime_error("failed to open " + target);
+
+  std::vector<char> data(COPY_BUFFER_SIZE);
+
+  // runs are in target order, so the new file is written sequentially
+  for (const auto& run : runs) {
+    fin.seekg(run.m_source);
+
+    for (int64_t done = 0; done < run.m_size;) {
+      int64_t size = std::min(run.m_size - done, COPY_BUFFER_SIZE);
+      fin.read(data.data(), size);
+      if (!fin.good()) throw std::runtime_error("failed to read " + source);
+
+      fout.write(data.data(), size);
+      done += size;
+    }
+  }
+
+  if (!fout.good()) throw std::runtime_error("failed to write " + target);
+}
+
+#else
+
+static void copy_buffered(int fd_in, int fd_out, const copy_run& run, std::vector<uint8_t>& data, const std::string& source) {
+  if (data.empty()) data.resize(COPY_BUFFER_SIZE);
+
+  for (int64_t done = 0; done < run.m_size;) {
+    int64_t size = std::min(run.m_size - done, COPY_BUFFER_SIZE);
+    ssize_t num_read = pread(fd_in, data.data(), size, run.m_source + done);
+
+    if (num_read < 0 && errno == EINTR) continue;
+    if (num_read <= 0) throw std::runtime_error("failed to read " + source);
+
+    for (ssize_t written = 0; written < num_read;) {
+      ssize_t n = pwrite(fd_out, data.data() + written, num_read - written, run.m_target + done + written);
+
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) throw std::runtime_error("failed to write octree layout");
+
+      written += n;
+    }
+
+    done += num_read;
+  }
+}
+
+static void copy_runs(const std::string& source, const std::string& target, const std::vector<copy_run>& runs) {
+  int fd_in = open(source.c_str(), O_RDONLY);
+  if (fd_in < 0) throw std::runtime_error("failed to open " + source);
+
+  int fd_out = open(target.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd_out < 0) {
+    close(fd_in);
+    throw std::runtime_error("failed to open " + target);
+  }
+
+  std::vector<uint8_t> data;
+  bool use_buffer = false;
+
+  try {
+    for (const auto& run : runs) {
+#if defined(__linux__)
+      // the kernel copies between the page caches, or shares extents on file systems that support reflinks
+      loff_t offset_in = run.m_source;
+      loff_t offset_out = run.m_target;
+      int64_t remaining = run.m_size;
+
+      while (!use_buffer && remaining > 0) {
+        ssize_t copied = copy_file_range(fd_in, &offset_in, fd_out, &offset_out, size_t(remaining), 0);
+
+        if (copied < 0 && errno == EINTR) continue;
+        if (copied < 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP)) {
+          use_buffer = true;
+          break;
+        }
+        if (copied <= 0) throw std::runtime_error("failed to copy " + source);
+
+        remaining -= copied;
+      }
+
+      if (remaining == 0) continue;
+
+      copy_run rest = { run.m_source + (run.m_size - remaining), run.m_target + (run.m_size - remaining), remaining };
+      copy_buffered(fd_in, fd_out, rest, data, source);
+#else
+      copy_buffered(fd_in, fd_out, run, data, source);
+#endif
+    }
+  }
+  catch (...) {
+    close(fd_in);
+    close(fd_out);
+    throw;
+  }
+
+  close(fd_in);
+  if (close(fd_out) != 0) throw std::runtime_error("failed to write " + target);
+}
+
+#endif
+
+int64_t octree_layout::optimize(const std::string& dir) {
+  gen_utils::profiler pr("octree_layout::optimize()");
+
+  std::string hierarchy_path = dir + "/hierarchy.bin";
+  std::string octree_path = dir + "/octree.bin";
+
+  auto hierarchy = file_utils::read_binary(hierarchy_path);
+  int64_t num_records = hierarchy->size / RECORD_SIZE;
+  int64_t octree_size = int64_t(std::filesystem::file_size(octree_path));
+
+  // hierarchy.bin holds the chunks in the order hierarchy_builder wrote them and each chunk in breadth-first order.
+  // proxy records point into hierarchy.bin, every other record owns one payload in octree.bin.
+  std::vector<copy_run> runs;
+  int64_t target = 0;
+  bool in_order = true;
+
+  for (int64_t i = 0; i < num_records; i++) {
+    int64_t record = RECORD_SIZE * i;
+    if (static_cast<node_type>(hierarchy->get<uint8_t>(record)) == node_type::PROXY) continue;
+
+    int64_t source = hierarchy->get<int64_t>(record + 6);
+    int64_t size = hierarchy->get<int64_t>(record + 14);
+
+    if (source < 0 || size < 0 || source + size > octree_size) {
+      throw std::runtime_error("node payload exceeds " + octree_path);
+    }
+
+    hierarchy->set<int64_t>(target, record + 6);
+    in_order = in_order && source == target;
+
+    // nodes that are already adjacent in octree.bin are copied as one run
+    if (!runs.empty() && runs.back().m_source + runs.back().m_size == source) {
+      runs.back().m_size += size;
+    }
+    else if (size > 0) {
+      runs.push_back({ source, target, size });
+    }
+
+    target += size;
+  }
+
+  if (in_order && target == octree_size) return 0;
+
+  std::string octree_tmp = octree_path + ".layout";
+  std::string hierarchy_tmp = hierarchy_path + ".layout";
+
+  copy_runs(octree_path, octree_tmp, runs);
+
+  {
+    std::ofstream fout(hierarchy_tmp, std::ios::binary | std::ios::trunc);
+    fout.write(hierarchy->data_char, hierarchy->size);
+    if (!fout.good()) throw std::runtime_error("failed to write " + hierarchy_tmp);
+  }
+
+  std::filesystem::rename(octree_tmp, octree_path);
+  std::filesystem::rename(hierarchy_tmp, hierarchy_path);
+
+  return target;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+
+namespace potree {
+namespace octree_layout {
+
+  // rewrites octree.bin in dir so that node payloads follow the record order of hierarchy.bin,
+  // i.e. the nodes of each hierarchy chunk are contiguous and in breadth-first order.
+  // the byte offsets in hierarchy.bin are updated to match, so clients can fetch a hierarchy chunk's nodes
+  // with a few large range requests. returns the number of bytes copied, 0 if the layout was already in order.
+  int64_t optimize(const std::string& dir);
+
+}
+}
@@ -0,0 +1,133 @@
+#include <stdexcept>
+#include <algorithm>
+#include <filesystem>
+#include "spill_store.h"
+
+#if defined(_WIN32)
+// keeps windows.h from defining min and max macros, which break std::min and std::max
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+using namespace potree;
+
+// private, copy-on-write mapping of the sealed file
+struct spill_store::mapping {
+  uint8_t* m_data = nullptr;
+  int64_t m_size = 0;
+#if defined(_WIN32)
+  void* m_handle = nullptr;
+#endif
+
+  ~mapping() {
+#if defined(_WIN32)
+    if (m_data != nullptr) UnmapViewOfFile(m_data);
+    if (m_handle != nullptr) CloseHandle(m_handle);
+#else
+    if (m_data != nullptr) munmap(m_data, m_size);
+#endif
+  }
+};
+
+spill_store::spill_store(const std::string& path, bool append) {
+  m_path = path;
+
+#if defined(_WIN32)
+  DWORD disposition = append ? OPEN_ALWAYS : CREATE_ALWAYS;
+  m_file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, disposition, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (m_file == INVALID_HANDLE_VALUE) throw std::runtime_error("failed to open " + path);
+#else
+  m_file = open(path.c_str(), O_RDWR | O_CREAT | (append ? 0 : O_TRUNC), 0644);
+  if (m_file < 0) throw std::runtime_error("failed to open " + path);
+#endif
+
+  m_end = append ? int64_t(std::filesystem::file_size(path)) : 0;
+}
+
+spill_store::~spill_store() {
+  close();
+}
+
+int64_t spill_store::append(const void* data, int64_t size) {
+  if (m_sealed) throw std::runtime_error("spill_store::append(): " + m_path + " is sealed");
+  if (size <= 0) return m_end;
+
+  int64_t offset = m_end.fetch_add(size);
+  const uint8_t* source = reinterpret_cast<const uint8_t*>(data);
+  int64_t done = 0;
+
+  while (done < size) {
+#if defined(_WIN32)
+    OVERLAPPED overlapped = {};
+    overlapped.Offset = DWORD((offset + done) & 0xFFFFFFFF);
+    overlapped.OffsetHigh = DWORD((offset + done) >> 32);
+    DWORD count = DWORD(std::min(size - done, int64_t(1) << 30));
+    DWORD written = 0;
+
+    if (!WriteFile(m_file, source + done, count, &written, &overlapped) || written == 0) {
+      throw std::runtime_error("failed to write " + m_path);
+    }
+#else
+    ssize_t written = pwrite(m_file, source + done, size_t(size - done), off_t(offset + done));
+
+    if (written < 0 && errno == EINTR) continue;
+    if (written <= 0) throw std::runtime_error("failed to write " + m_path);
+#endif
+
+    done += written;
+  }
+
+  return offset;
+}
+
+void spill_store::seal() {
+  if (m_sealed) return;
+  m_sealed = true;
+
+  m_mapping = std::make_shared<mapping>();
+  m_mapping->m_size = m_end;
+
+  // an empty file can't be mapped, there is nothing to view either
+  if (m_mapping->m_size == 0) return;
+
+#if defined(_WIN32)
+  m_mapping->m_handle = CreateFileMappingA(m_file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+  if (m_mapping->m_handle == nullptr) throw std::runtime_error("failed to map " + m_path);
+
+  m_mapping->m_data = reinterpret_cast<uint8_t*>(MapViewOfFile(m_mapping->m_handle, FILE_MAP_COPY, 0, 0, 0));
+  if (m_mapping->m_data == nullptr) throw std::runtime_error("failed to map " + m_path);
+#else
+  void* data = mmap(nullptr, size_t(m_mapping->m_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, m_file, 0);
+  if (data == MAP_FAILED) throw std::runtime_error("failed to map " + m_path);
+
+  m_mapping->m_data = reinterpret_cast<uint8_t*>(data);
+#endif
+}
+
+std::shared_ptr<buffer> spill_store::view(int64_t offset, int64_t size) const {
+  if (!m_sealed) throw std::runtime_error("spill_store::view(): " + m_path + " isn't sealed");
+
+  if (offset < 0 || size < 0 || offset + size > m_mapping->m_size) {
+    throw std::runtime_error("spill_store::view(): range " + std::to_string(offset) + "+" + std::to_string(size) + " is outside of " + m_path);
+  }
+
+  return std::make_shared<buffer>(m_mapping->m_data + offset, size, m_mapping);
+}
+
+void spill_store::close() {
+  // the mapping stays valid for views that still exist
+  m_mapping = nullptr;
+
+#if defined(_WIN32)
+  if (m_file != nullptr && m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+  m_file = nullptr;
+#else
+  if (m_file >= 0) ::close(m_file);
+  m_file = -1;
+#endif
+}
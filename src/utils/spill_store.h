@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include "common/buffer.h"
+
+namespace potree {
+
+  // append-only temporary file for data that is written once and read back later, like the flushed chunk roots.
+  // appends reserve their range with an atomic add and write it with a positional write, so concurrent appends
+  // don't wait for each other. after seal(), the file is mapped and ranges are read back as views into the mapping,
+  // without opening the file, allocating or copying per read.
+  class spill_store {
+  public:
+    // an existing file is replaced unless append is set
+    spill_store(const std::string& path, bool append = false);
+    ~spill_store();
+
+    spill_store(const spill_store&) = delete;
+    spill_store& operator=(const spill_store&) = delete;
+
+    // writes size bytes and returns their offset
+    int64_t append(const void* data, int64_t size);
+    int64_t size() const { return m_end; }
+    const std::string& path() const { return m_path; }
+
+    // ends writing and maps the file, later appends throw
+    void seal();
+    bool is_sealed() const { return m_sealed; }
+    // view of size bytes at offset. the mapping is copy-on-write, so writes to a view stay private to the process.
+    // views keep the mapping alive, also after the store is closed
+    std::shared_ptr<buffer> view(int64_t offset, int64_t size) const;
+    void close();
+
+  private:
+    struct mapping;
+
+    std::string m_path;
+    std::atomic_int64_t m_end = 0;
+    std::shared_ptr<mapping> m_mapping;
+    bool m_sealed = false;
+
+#if defined(_WIN32)
+    void* m_file = nullptr;
+#else
+    int m_file = -1;
+#endif
+  };
+
+}